@@ -205,8 +205,30 @@ QByteArray QInstaller::retrieveCompressedData(QIODevice *in, qint64 size)
 }
 
 /*!
-    Search through 1MB, if smaller through the whole file. Note: QFile::map() does
-    not change QFile::pos(). Fallback to read the file content in case we can't map it.
+    Returns the position of \a magicCookie if it forms the last eight bytes of \a in, which is
+    where all writers of the binary layout put it. Otherwise returns -1. Leaves QFile::pos()
+    unchanged.
+*/
+static qint64 magicCookieAtEnd(QFile *in, quint64 magicCookie)
+{
+    const qint64 cookiePos = in->size() - qint64(sizeof(qint64));
+    if (cookiePos < 0)
+        return -1;
+
+    const qint64 pos = in->pos();
+    quint64 trailer = 0;
+    const bool found = in->seek(cookiePos)
+        && in->read(reinterpret_cast<char *>(&trailer), sizeof(trailer)) == qint64(sizeof(trailer))
+        && trailer == magicCookie;
+    in->seek(pos);
+    return found ? cookiePos : -1;
+}
+
+/*!
+    Checks the end of the file first, using a single small read. Only if the cookie is not found
+    there, for example because a signature was appended to the file afterwards, search through
+    1MB, if smaller through the whole file. Note: QFile::map() does not change QFile::pos().
+    Fallback to read the file content in case we can't map it.
 */
 qint64 QInstaller::findMagicCookie(QFile *in, quint64 magicCookie)
 {
@@ -214,6 +236,10 @@ qint64 QInstaller::findMagicCookie(QFile *in, quint64 magicCookie)
     Q_ASSERT(in->isOpen());
     Q_ASSERT(in->isReadable());
 
+    const qint64 cookiePos = magicCookieAtEnd(in, magicCookie);
+    if (cookiePos >= 0)
+        return cookiePos;
+
     const qint64 fileSize = in->size();
     const size_t markerSize = sizeof(qint64);
     const qint64 maxSearch = qMin((1024LL * 1024LL), fileSize);
@@ -235,12 +261,10 @@ qint64 QInstaller::findMagicCookie(QFile *in, quint64 magicCookie)
         in->unmap(mapped);
     }
 
-    qint64 searched = maxSearch - markerSize;
-    while (searched >= 0) {
-        if (memcmp(&magicCookie, (data.data() + searched), markerSize) == 0)
-            return (fileSize - maxSearch) + searched;
-        --searched;
-    }
+    const int found = data.lastIndexOf(QByteArray::fromRawData(reinterpret_cast<const char *>
+        (&magicCookie), markerSize));
+    if (found >= 0)
+        return (fileSize - maxSearch) + found;
     throw Error(QObject::tr("No marker found, stopped after %1.").arg(humanReadableSize(maxSearch)));
 
     return -1; // never reached
@@ -299,6 +323,36 @@ bool Archive::seek(qint64 pos)
     return QIODevice::seek(pos);
 }
 
+/*!
+    Writes the whole content of the archive to the open file \a out. Archives stored in the
+    installer binary are copied straight out of its data segment, inside the kernel if possible.
+
+    Throws QInstaller::Error on failure.
+*/
+void Archive::copyTo(QFile *out)
+{
+    if (!isOpen() && !open(QIODevice::ReadOnly)) {
+        throw Error(tr("Could not open archive %1: %2").arg(QString::fromUtf8(m_name),
+            errorString()));
+    }
+
+    QFile *const in = m_device ? m_device.data() : &m_inputFile;
+    const qint64 start = m_device ? m_segment.start() : 0;
+    const qint64 devicePos = in->pos();
+
+    qint64 copied = 0;
+    if (in->seek(start)) {
+        kernelCopy(in, out, size());
+        copied = in->pos() - start;
+    }
+    if (m_device)
+        m_device->seek(devicePos);
+
+    // copy whatever the kernel could not
+    seek(copied);
+    blockingCopy(this, out, size() - copied);
+}
+
 QByteArray Archive::name() const
 {
     return m_name;
@@ -649,6 +703,18 @@ void ComponentIndex::removeComponent(const QByteArray &name)
     m_components.remove(name);
 }
 
+/*!
+    Appends \a archive to the component \a name, creating the component if it is not part of the
+    index yet. The component is modified in place.
+ */
+void ComponentIndex::appendArchive(const QByteArray &name, const QSharedPointer<Archive> &archive)
+{
+    Component &component = m_components[name];
+    if (component.name().isEmpty())
+        component.setName(name);
+    component.appendArchive(archive);
+}
+
 QVector<Component> ComponentIndex::components() const
 {
     return m_components.values().toVector();
@@ -105,6 +105,7 @@ public:
     qint64 size() const;
 
     bool createZippedFile();
+    void copyTo(QFile *out);
 
     QByteArray name() const;
     void setName(const QByteArray &name);
@@ -174,6 +175,7 @@ public:
     Component componentByName(const QByteArray &name) const;
     void insertComponent(const Component &name);
     void removeComponent(const QByteArray &name);
+    void appendArchive(const QByteArray &name, const QSharedPointer<Archive> &archive);
     QVector<Component> components() const;
     int componentCount() const;
 
@@ -80,8 +80,10 @@ private:
 
 } // anon namespace
 
-BinaryFormatEngine::BinaryFormatEngine(const ComponentIndex &index, const QString &fileName)
+BinaryFormatEngine::BinaryFormatEngine(const ComponentIndex &index, const ArchiveLookup &archives,
+        const QString &fileName)
     : m_index(index)
+    , m_archives(archives)
     , m_hasComponent(false)
     , m_hasArchive(false)
     , m_archive(0)
@@ -98,23 +100,29 @@ void BinaryFormatEngine::setArchive(const QString &file)
     m_fileNamePath = file;
 
     static const QChar sep = QLatin1Char('/');
-    static const QString prefix = QLatin1String("installer://");
-    Q_ASSERT(file.toLower().startsWith(prefix));
-
-    // cut the prefix
-    QString path = file.mid(prefix.length());
-    while (path.endsWith(sep))
-        path.chop(1);
-
-    QString arch;
-    const QString comp = path.section(sep, 0, 0);
-    m_hasComponent = !comp.isEmpty();
-    m_hasArchive = path.contains(sep);
-    if (m_hasArchive)
-        arch = path.section(sep, 1, 1);
-
-    m_component = m_index.componentByName(comp.toUtf8());
-    m_archive = m_component.archiveByName(arch.toUtf8());
+    static const int prefixLength = 12; // installer://
+    Q_ASSERT(file.startsWith(QLatin1String("installer://"), Qt::CaseInsensitive));
+
+    // ignore trailing separators
+    int end = file.length();
+    while (end > prefixLength && file.at(end - 1) == sep)
+        --end;
+
+    const int componentEnd = file.indexOf(sep, prefixLength);
+    m_hasArchive = componentEnd >= 0 && componentEnd < end;
+    m_hasComponent = (m_hasArchive ? componentEnd : end) > prefixLength;
+
+    if (m_hasArchive) {
+        // installer://component/archive[/...], a single lookup in the pre-parsed archive table
+        int archiveEnd = file.indexOf(sep, componentEnd + 1);
+        if (archiveEnd < 0 || archiveEnd > end)
+            archiveEnd = end;
+        m_component = Component();
+        m_archive = m_archives.value(file.mid(prefixLength, archiveEnd - prefixLength));
+    } else {
+        m_component = m_index.componentByName(file.mid(prefixLength, end - prefixLength).toUtf8());
+        m_archive.clear();
+    }
 }
 
 /**
@@ -46,10 +46,14 @@
 
 namespace QInstallerCreator {
 
+// maps "component/archive" to the archive, pre-parsed by BinaryFormatEngineHandler
+typedef QHash<QString, QSharedPointer<Archive> > ArchiveLookup;
+
 class BinaryFormatEngine : public QAbstractFileEngine
 {
 public:
-    BinaryFormatEngine(const ComponentIndex &index, const QString &fileName);
+    BinaryFormatEngine(const ComponentIndex &index, const ArchiveLookup &archives,
+        const QString &fileName);
     ~BinaryFormatEngine();
 
     void setFileName(const QString &file);
@@ -73,6 +77,7 @@ protected:
 
 private:
     const ComponentIndex m_index;
+    const ArchiveLookup m_archives;
     bool m_hasComponent;
     bool m_hasArchive;
     Component m_component;
@@ -57,9 +57,21 @@ public:
     Private(const ComponentIndex &i)
         : index(i)
     {
+        updateArchives();
+    }
+
+    void updateArchives()
+    {
+        archives.clear();
+        foreach (const Component &component, index.components()) {
+            const QString name = QString::fromUtf8(component.name()) + QLatin1Char('/');
+            foreach (const QSharedPointer<Archive> &archive, component.archives())
+                archives.insert(name + QString::fromUtf8(archive->name()), archive);
+        }
     }
 
     ComponentIndex index;
+    ArchiveLookup archives;
 };
 
 BinaryFormatEngineHandler::BinaryFormatEngineHandler(const ComponentIndex &index)
@@ -85,11 +97,20 @@ BinaryFormatEngineHandler::~BinaryFormatEngineHandler()
 void BinaryFormatEngineHandler::setComponentIndex(const ComponentIndex &index)
 {
     d->index = index;
+    d->updateArchives();
 }
 
 QAbstractFileEngine *BinaryFormatEngineHandler::create(const QString &fileName) const
 {
-    return fileName.startsWith(QLatin1String("installer://"), Qt::CaseInsensitive ) ? new BinaryFormatEngine(d->index, fileName) : 0;
+    // Called for every QFile, QDir and QFileInfo in the process, so reject ordinary paths by
+    // looking at the first character before doing the full prefix comparison.
+    if (fileName.length() < 12 || (fileName.at(0) != QLatin1Char('i')
+        && fileName.at(0) != QLatin1Char('I'))) {
+        return 0;
+    }
+    if (!fileName.startsWith(QLatin1String("installer://"), Qt::CaseInsensitive))
+        return 0;
+    return new BinaryFormatEngine(d->index, d->archives, fileName);
 }
     
 BinaryFormatEngineHandler *BinaryFormatEngineHandler::instance()
@@ -108,24 +129,22 @@ void BinaryFormatEngineHandler::registerArchive(const QString &pathName, const Q
     while (path.endsWith(sep))
         path.chop(1);
 
-    const QString comp = path.section(sep, 0, 0);
-    const QString archiveName = path.section(sep, 1, 1);
-    
-    Component c = d->index.componentByName(comp.toUtf8());
-    if (c.name().isEmpty())
-        c.setName(comp.toUtf8());
+    const int archiveStart = path.indexOf(sep) + 1;
+    int archiveEnd = path.indexOf(sep, archiveStart);
+    if (archiveEnd < 0)
+        archiveEnd = path.length();
+    const QString comp = path.left(archiveStart > 0 ? archiveStart - 1 : path.length());
+    const QString archiveName = archiveStart > 0
+        ? path.mid(archiveStart, archiveEnd - archiveStart) : QString();
 
-    QList< QSharedPointer<Archive> > registered;
     QSharedPointer<Archive> newArchive(new Archive(archive));
     newArchive->setName(archiveName.toUtf8());
-    registered.push_back(newArchive);
-    c.appendArchive(newArchive);
-    d->index.insertComponent(c);
+    d->index.appendArchive(comp.toUtf8(), newArchive);
+    d->archives.insert(comp + sep + archiveName, newArchive);
 }
 
 void BinaryFormatEngineHandler::resetRegisteredArchives()
 {
-    QVector<QInstallerCreator::Component> registeredComponents = d->index.components();
-    foreach (const QInstallerCreator::Component &component, registeredComponents)
-        d->index.removeComponent(component.name());
+    d->index = ComponentIndex();
+    d->archives.clear();
 }
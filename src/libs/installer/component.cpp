@@ -221,6 +221,7 @@ Component::Component(PackageManagerCore *core)
     setPrivate(d);
 
     connect(this, SIGNAL(valueChanged(QString, QString)), this, SLOT(updateModelData(QString, QString)));
+    connect(core, SIGNAL(valueChanged(QString, QString)), this, SLOT(invalidateScriptCache()));
     qRegisterMetaType<QList<QInstaller::Component*> >("QList<QInstaller::Component*>");
 }
 
@@ -400,6 +401,7 @@ void Component::setValue(const QString &key, const QString &value)
         d->m_componentName = normalizedValue;
 
     d->m_vars[key] = normalizedValue;
+    invalidateScriptCache();
     emit valueChanged(key, normalizedValue);
 }
 
@@ -522,12 +524,12 @@ void Component::loadComponentScript()
 */
 void Component::loadComponentScript(const QString &fileName)
 {
-    // introduce the component object as javascript value and call the name to check that it
-    // was successful
-    QString scriptInjection(QString::fromLatin1(
-        "var component = installer.componentByName('%1'); component.name;").arg(name()));
-
-    d->m_scriptContext = d->scriptEngine()->loadInConext(QLatin1String("Component"), fileName, scriptInjection);
+    // introduce the component object as javascript value, the compiled script is shared by all
+    // components using the same script
+    ScriptEngine *const engine = d->scriptEngine();
+    d->m_scriptContext = engine->loadInConext(QLatin1String("Component"), fileName,
+        engine->newQObject(this));
+    invalidateScriptCache();
 
     emit loaded();
     languageChanged();
@@ -701,8 +703,10 @@ QWidget *Component::userInterface(const QString &name) const
     \note If you call this method from a script, it will not call the script's method with the same
     name.
 
-    The default implementation is recursively creating Copy and Mkdir operations for all files
-    and folders within \a path.
+    The default implementation creates a Copy operation if \a path is a file. For a folder, one
+    CopyTree operation copies all files and folders within \a path. If the component script
+    implements createOperationsForPath, a Mkdir operation is created for the folder instead, and
+    this method is called recursively for its entries, so that the script sees each of them.
 
     \sa {component::createOperationsForPath}{component.createOperationsForPath}
 */
@@ -728,13 +732,19 @@ void Component::createOperationsForPath(const QString &path)
         static const QString copy = QString::fromLatin1("Copy");
         addOperation(copy, fi.filePath(), target);
     } else if (fi.isDir()) {
-        qApp->processEvents();
-        static const QString mkdir = QString::fromLatin1("Mkdir");
-        addOperation(mkdir, target);
-
-        QDirIterator it(fi.filePath());
-        while (it.hasNext())
-            createOperationsForPath(it.next());
+        if (d->m_scriptContext.property(QLatin1String("createOperationsForPath")).isValid()) {
+            qApp->processEvents();
+            static const QString mkdir = QString::fromLatin1("Mkdir");
+            addOperation(mkdir, target);
+
+            QDirIterator it(fi.filePath());
+            while (it.hasNext())
+                createOperationsForPath(it.next());
+        } else {
+            // one operation for the whole tree instead of a Copy or Mkdir operation per entry
+            static const QString copyTree = QString::fromLatin1("CopyTree");
+            addOperation(copyTree, fi.filePath(), target, QLatin1String("skipChecksumFiles"));
+        }
     }
 }
 
@@ -1241,6 +1251,13 @@ bool Component::isAutoDependOn(const QSet<QString> &componentsToInstall) const
     return false;
 }
 
+/*!
+    Returns whether the component is selected by default. If the \c Default value is \c script,
+    the result of the script method isDefault() is used. It is cached until
+    invalidateScriptCache() is called.
+
+    \sa {component::isDefault}{component.isDefault}
+*/
 bool Component::isDefault() const
 {
      if (isVirtual())
@@ -1250,8 +1267,7 @@ bool Component::isDefault() const
     if (d->m_vars.value(scDefault).compare(QLatin1String("script"), Qt::CaseInsensitive) == 0) {
         QScriptValue valueFromScript;
         try {
-            valueFromScript = d->scriptEngine()->callScriptMethod(d->m_scriptContext,
-                QLatin1String("isDefault"));
+            valueFromScript = d->callCachedScriptMethod(QLatin1String("isDefault"));
         } catch (const Error &error) {
             MessageBoxHandler::critical(MessageBoxHandler::currentBestSuitParent(),
                 QLatin1String("isDefaultError"), tr("Cannot resolve isDefault in %1").arg(name()),
@@ -1267,6 +1283,18 @@ bool Component::isDefault() const
     return d->m_vars.value(scDefault).compare(scTrue, Qt::CaseInsensitive) == 0;
 }
 
+/*!
+    Discards the cached results of script methods, for example isDefault(). This happens
+    automatically whenever a value of the component or of the installer changes, or the component
+    script is loaded. Call it from a script if the result depends on any other state that changed.
+
+    \sa {component::invalidateScriptCache}{component.invalidateScriptCache}
+*/
+void Component::invalidateScriptCache()
+{
+    d->m_scriptValueCache.clear();
+}
+
 bool Component::isInstalled() const
 {
     return scInstalled == d->m_vars.value(scCurrentState);
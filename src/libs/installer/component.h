@@ -223,6 +223,7 @@ public:
 
 public Q_SLOTS:
     void setAutoCreateOperations(bool autoCreateOperations);
+    void invalidateScriptCache();
 
 Q_SIGNALS:
     void loaded();
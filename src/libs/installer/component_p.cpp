@@ -44,6 +44,7 @@
 #include "component.h"
 #include "messageboxhandler.h"
 #include "packagemanagercore.h"
+#include "scriptengine.h"
 
 #include <QApplication>
 
@@ -92,6 +93,23 @@ ScriptEngine *ComponentPrivate::scriptEngine() const
     return m_core->componentScriptEngine();
 }
 
+/*!
+    Calls the script method \a methodName without arguments and caches valid results, so that
+    properties derived from the script do not re-enter the interpreter on every query. The cache
+    is cleared by Component::invalidateScriptCache().
+*/
+QScriptValue ComponentPrivate::callCachedScriptMethod(const QString &methodName)
+{
+    const QHash<QString, QScriptValue>::const_iterator it = m_scriptValueCache.constFind(methodName);
+    if (it != m_scriptValueCache.constEnd())
+        return it.value();
+
+    const QScriptValue value = scriptEngine()->callScriptMethod(m_scriptContext, methodName);
+    if (value.isValid())
+        m_scriptValueCache.insert(methodName, value);
+    return value;
+}
+
 // -- ComponentModelHelper
 
 ComponentModelHelper::ComponentModelHelper()
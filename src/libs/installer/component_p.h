@@ -64,6 +64,7 @@ public:
     ~ComponentPrivate();
 
     ScriptEngine *scriptEngine() const;
+    QScriptValue callCachedScriptMethod(const QString &methodName);
 
     PackageManagerCore *m_core;
     Component *m_parentComponent;
@@ -81,6 +82,7 @@ public:
     QUrl m_repositoryUrl;
     QString m_localTempPath;
     QScriptValue m_scriptContext;
+    QHash<QString, QScriptValue> m_scriptValueCache;
     QHash<QString, QString> m_vars;
     QList<Component*> m_childComponents;
     QList<Component*> m_allChildComponents;
@@ -90,6 +90,8 @@ static const QLatin1String scRepositorySettingsPageVisible("RepositorySettingsPa
 static const QLatin1String scAllowSpaceInPath("AllowSpaceInPath");
 static const QLatin1String scWizardStyle("WizardStyle");
 static const QLatin1String scTitleColor("TitleColor");
+static const QLatin1String scRepositoryCacheBusting("RepositoryCacheBusting");
+static const QLatin1String scDownloadSegments("DownloadSegments");
 }
 
 #endif  // CONSTANTS_H
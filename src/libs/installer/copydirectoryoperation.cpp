@@ -28,10 +28,15 @@
 
 #include "copydirectoryoperation.h"
 
+#include "errors.h"
+#include "fileutils.h"
+
 #include <QtCore/QDir>
 #include <QtCore/QDirIterator>
 #include <QtCore/QFileInfo>
 
+#include <algorithm>
+
 using namespace QInstaller;
 
 class AutoPush
@@ -39,12 +44,20 @@ class AutoPush
 public:
     AutoPush(CopyDirectoryOperation *op)
         : m_op(op) {}
-    ~AutoPush() { m_op->setValue(QLatin1String("files"), m_files); }
+    ~AutoPush()
+    {
+        m_op->setValue(QLatin1String("files"), fileManifest(m_files));
+    }
 
     QStringList m_files;
     CopyDirectoryOperation *m_op;
 };
 
+static bool longerPathFirst(const QString &left, const QString &right)
+{
+    return left.length() > right.length();
+}
+
 
 CopyDirectoryOperation::CopyDirectoryOperation()
 {
@@ -112,8 +125,8 @@ bool CopyDirectoryOperation::performOperation()
                 QFile(linkTarget).link(targetDir.absoluteFilePath(relativePath));
             }
             // add file entry
-            autoPush.m_files.prepend(targetDir.absoluteFilePath(relativePath));
-            emit outputTextChanged(autoPush.m_files.first());
+            autoPush.m_files.append(targetDir.absoluteFilePath(relativePath));
+            emit outputTextChanged(autoPush.m_files.last());
         } else if (itemInfo.isDir()) {
             if (!targetDir.mkpath(targetDir.absoluteFilePath(relativePath))) {
                 setError(InvalidArguments);
@@ -127,16 +140,27 @@ bool CopyDirectoryOperation::performOperation()
                 setErrorString(tr("Failed to overwrite %1").arg(absolutePath));
                 return false;
             }
-            QFile file(sourceDir.absoluteFilePath(itemName));
-            if (!file.copy(absolutePath)) {
+            // like QFile::copy(), do not replace a file we were not asked to overwrite
+            QString errorString;
+            if (QFile::exists(absolutePath)) {
+                errorString = tr("Destination file exists");
+            } else {
+                try {
+                    copyFile(sourceDir.absoluteFilePath(itemName), absolutePath);
+                } catch (const QInstaller::Error &e) {
+                    errorString = e.message();
+                    QFile::remove(absolutePath);    // did not exist before, drop the partial copy
+                }
+            }
+            if (!errorString.isEmpty()) {
                 setError(UserDefinedError);
                 setErrorString(tr("Could not copy %0 to %1, error was: %3").arg(sourceDir.absoluteFilePath(itemName),
                                targetDir.absoluteFilePath(relativePath),
-                               file.errorString()));
+                               errorString));
                 return false;
             }
-            autoPush.m_files.prepend(targetDir.absoluteFilePath(relativePath));
-            emit outputTextChanged(autoPush.m_files.first());
+            autoPush.m_files.append(absolutePath);
+            emit outputTextChanged(absolutePath);
         }
     }
     return true;
@@ -146,19 +170,37 @@ bool CopyDirectoryOperation::undoOperation()
 {
     Q_ASSERT(arguments().count() == 2);
 
-    QDir dir;
-    const QStringList files = value(QLatin1String("files")).toStringList();
+    QStringList files;
+    try {
+        files = fileManifestPaths(value(QLatin1String("files")));
+    } catch (const QInstaller::Error &e) {
+        setError(UserDefinedError);
+        setErrorString(e.message());
+        return false;
+    }
+    const QStringList failed = removeConcurrently(files);
+
+    // clean up each directory once after all files are gone, deepest first
+    QSet<QString> directories;
     foreach (const QString &file, files) {
-        if (!QFile::remove(file)) {
-            setError(InvalidArguments);
-            setErrorString(tr("Could not remove %0").arg(file));
-            return false;
-        }
-        dir.rmpath(QFileInfo(file).absolutePath());
+        directories.insert(QFileInfo(file).absolutePath());
         emit outputTextChanged(file);
     }
+    QStringList sortedDirectories = directories.toList();
+    std::sort(sortedDirectories.begin(), sortedDirectories.end(), longerPathFirst);
+    QDir dir;
+    foreach (const QString &directory, sortedDirectories)
+        dir.rmpath(directory);
+
+    if (!failed.isEmpty()) {
+        // keep the files which could not be removed, so another undo can try again
+        setValue(QLatin1String("files"), fileManifest(failed));
+        setError(InvalidArguments);
+        setErrorString(tr("Could not remove %0").arg(failed.first()));
+        return false;
+    }
 
-    setValue(QLatin1String("files"), QStringList());
+    setValue(QLatin1String("files"), QString());
     return true;
 }
 
@@ -26,8 +26,10 @@
 **
 **************************************************************************/
 #include "copyfiletask.h"
+#include "fileutils.h"
 #include "observer.h"
 
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QTemporaryFile>
 
@@ -59,7 +61,7 @@ void CopyFileTask::doTask(QFutureInterface<FileTaskResult> &fi)
     }
 
     const FileTaskItem item = taskItems().first();
-    FileTaskObserver observer(QCryptographicHash::Sha1);
+    FileTaskObserver observer(QCryptographicHash::Sha1, FileTaskObserver::ManualSampling);
 
     QFile source(item.source());
     if (!source.open(QIODevice::ReadOnly)) {
@@ -84,7 +86,16 @@ void CopyFileTask::doTask(QFutureInterface<FileTaskResult> &fi)
         fi.reportFinished(); return;    // error
     }
 
-    QByteArray buffer(32768, Qt::Uninitialized);
+    // the copy loop only updates the counters of the observer, the transfer rate is sampled and
+    // the progress text is published once per sampling interval
+    static const qint64 sampleInterval = 100;
+    qint64 nextSample = sampleInterval;
+    QElapsedTimer sampleTimer;
+    sampleTimer.start();
+
+    // the data has to pass through the checksum anyway, so a kernel copy does not help here, but a
+    // buffer growing with the file size keeps the number of system calls low
+    QByteArray buffer(int(copyBufferSize(source.size())), Qt::Uninitialized);
     while (!source.atEnd() && source.error() == QFile::NoError) {
         if (fi.isCanceled())
             break;
@@ -103,12 +114,20 @@ void CopyFileTask::doTask(QFutureInterface<FileTaskResult> &fi)
         }
 
         observer.addSample(read);
-        observer.timerEvent(NULL);
         observer.addBytesTransfered(read);
         observer.addCheckSumData(buffer.data(), read);
 
-        fi.setProgressValueAndText(observer.progressValue(), observer.progressText());
+        const qint64 elapsed = sampleTimer.elapsed();
+        if (elapsed >= nextSample) {
+            // one sample per interval passed, so a slow chunk does not count as a fast interval
+            while (elapsed >= nextSample) {
+                observer.timerEvent(NULL);
+                nextSample += sampleInterval;
+            }
+            fi.setProgressValueAndText(observer.progressValue(), observer.progressText());
+        }
     }
+    fi.setProgressValueAndText(observer.progressValue(), observer.progressText());
 
     fi.reportResult(FileTaskResult(file->fileName(), observer.checkSum(), item), 0);
     fi.reportFinished();
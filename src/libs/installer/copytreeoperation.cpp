@@ -0,0 +1,330 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+#include "copytreeoperation.h"
+
+#include "errors.h"
+#include "fileutils.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSet>
+
+using namespace QInstaller;
+
+namespace {
+
+struct TreeEntry
+{
+    QString relativePath;
+    qint64 size;
+    bool isDir;
+};
+
+void collectTree(const QString &sourcePath, const QString &relativePath, bool skipChecksumFiles,
+    QList<TreeEntry> *entries, qint64 *totalSize)
+{
+    const QDir dir(relativePath.isEmpty() ? sourcePath : sourcePath + QLatin1Char('/') + relativePath);
+    const QFileInfoList infos = dir.entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot);
+    foreach (const QFileInfo &fi, infos) {
+        const QString path = relativePath.isEmpty() ? fi.fileName()
+            : relativePath + QLatin1Char('/') + fi.fileName();
+        if (fi.isDir()) {
+            const TreeEntry entry = { path, 0, true };
+            entries->append(entry);
+            collectTree(sourcePath, path, skipChecksumFiles, entries, totalSize);
+            continue;
+        }
+        if (skipChecksumFiles && fi.suffix() == QLatin1String("sha1")
+            && QFileInfo(fi.dir(), fi.completeBaseName()).exists()) {
+            continue;
+        }
+        const TreeEntry entry = { path, fi.size(), false };
+        entries->append(entry);
+        *totalSize += entry.size;
+    }
+}
+
+// The manifests store paths relative to the target directory. This keeps the uninstaller's
+// operation list small even for components with many thousand files.
+class Manifest
+{
+public:
+    Manifest(CopyTreeOperation *op, const QStringList &createdDirectories,
+            const QStringList &copiedFiles)
+        : directories(createdDirectories)
+        , files(copiedFiles)
+        , backups(op->value(QLatin1String("backups")).toStringList())
+        , m_op(op)
+    {}
+    ~Manifest()
+    {
+        m_op->setValue(QLatin1String("directories"), fileManifest(directories));
+        m_op->setValue(QLatin1String("files"), fileManifest(files));
+        if (!backups.isEmpty())
+            m_op->setValue(QLatin1String("backups"), backups);
+    }
+
+    QStringList directories;
+    QStringList files;
+    QStringList backups;    // pairs of relative path and backup of the overwritten file
+
+private:
+    CopyTreeOperation *m_op;
+};
+
+} // namespace
+
+
+CopyTreeOperation::CopyTreeOperation()
+{
+    setName(QLatin1String("CopyTree"));
+}
+
+CopyTreeOperation::~CopyTreeOperation()
+{
+    const QStringList backups = value(QLatin1String("backups")).toStringList();
+    for (int i = 1; i < backups.count(); i += 2)
+        deleteFileNowOrLater(backups.at(i));
+}
+
+void CopyTreeOperation::backup()
+{
+    // existing files are moved away while the tree is copied, see performOperation()
+}
+
+bool CopyTreeOperation::performOperation()
+{
+    const QStringList args = arguments();
+    if (args.count() < 2 || args.count() > 3) {
+        setError(InvalidArguments);
+        setErrorString(tr("Invalid arguments in %0: %1 arguments given, %2 expected%3.")
+            .arg(name()).arg(args.count()).arg(tr("2 or 3"),
+            tr(" (<source> <target> [skipChecksumFiles])")));
+        return false;
+    }
+
+    bool skipChecksumFiles = false;
+    if (args.count() > 2) {
+        if (args.at(2) != QLatin1String("skipChecksumFiles")) {
+            setError(InvalidArguments);
+            setErrorString(tr("Invalid argument in %0: Third argument needs to be "
+                "skipChecksumFiles, if specified").arg(name()));
+            return false;
+        }
+        skipChecksumFiles = true;
+    }
+
+    const QString sourcePath = args.at(0);
+    if (!QFileInfo(sourcePath).isDir()) {
+        setError(InvalidArguments);
+        setErrorString(tr("Invalid arguments in %0: %1 is not a directory.").arg(name(),
+            sourcePath));
+        return false;
+    }
+
+    const QString targetPath = QDir(args.at(1)).absolutePath();
+    if (!QFileInfo(targetPath).exists()) {
+        QString createdDir = targetPath;
+        forever {
+            const QString parent = QFileInfo(createdDir).absolutePath();
+            if (parent == createdDir || QFileInfo(parent).exists())
+                break;
+            createdDir = parent;
+        }
+        if (!QDir().mkpath(targetPath)) {
+            setError(UserDefinedError);
+            setErrorString(tr("Could not create directory %1.").arg(targetPath));
+            return false;
+        }
+        if (!hasValue(QLatin1String("createddir")))
+            setValue(QLatin1String("createddir"), createdDir);
+        emit outputTextChanged(targetPath);
+    }
+
+    qint64 totalSize = 0;
+    QList<TreeEntry> entries;
+    collectTree(sourcePath, QString(), skipChecksumFiles, &entries, &totalSize);
+
+    QStringList directories;
+    QStringList files;
+    try {
+        directories = fileManifestPaths(value(QLatin1String("directories")));
+        files = fileManifestPaths(value(QLatin1String("files")));
+    } catch (const QInstaller::Error &e) {
+        setError(UserDefinedError);
+        setErrorString(e.message());
+        return false;
+    }
+
+    Manifest manifest(this, directories, files);
+    // files copied by a previous attempt of this operation get overwritten without a backup
+    const QSet<QString> copiedBefore = manifest.files.toSet();
+
+    const QDir targetDir(targetPath);
+    qint64 copiedSize = 0;
+    int lastPercent = -1;
+    foreach (const TreeEntry &entry, entries) {
+        const QString source = sourcePath + QLatin1Char('/') + entry.relativePath;
+        const QString target = targetDir.filePath(entry.relativePath);
+
+        if (entry.isDir) {
+            if (QFileInfo(target).isDir())
+                continue;
+            if (!QDir().mkdir(target)) {
+                setError(UserDefinedError);
+                setErrorString(tr("Could not create directory %1.").arg(target));
+                return false;
+            }
+            manifest.directories.append(entry.relativePath);
+            emit outputTextChanged(target);
+            continue;
+        }
+
+        try {
+            const QFileInfo targetInfo(target);
+            if (targetInfo.exists() || targetInfo.isSymLink()) {
+                if (copiedBefore.contains(entry.relativePath)) {
+                    QFile::remove(target);
+                } else {
+                    const QString backup = generateTemporaryFileName(target);
+                    if (!QFile::rename(target, backup))
+                        throw QInstaller::Error(tr("Could not backup file %1.").arg(target));
+                    manifest.backups << entry.relativePath << backup;
+                }
+            }
+            // record the file first, a partially written file needs to be removed on undo too
+            if (!copiedBefore.contains(entry.relativePath))
+                manifest.files.append(entry.relativePath);
+            copyFile(source, target);
+        } catch (const QInstaller::Error &e) {
+            setError(UserDefinedError);
+            setErrorString(tr("Could not copy %1 to %2: %3").arg(source, target, e.message()));
+            return false;
+        }
+
+        copiedSize += entry.size;
+        const int percent = totalSize > 0 ? int(copiedSize * 100 / totalSize) : 100;
+        if (percent != lastPercent) {
+            lastPercent = percent;
+            emit progressChanged(double(percent) / 100);
+        }
+    }
+    return true;
+}
+
+bool CopyTreeOperation::undoOperation()
+{
+    const QDir targetDir(QDir(arguments().value(1)).absolutePath());
+
+    QStringList files;
+    QStringList directories;
+    try {
+        files = fileManifestPaths(value(QLatin1String("files")));
+        directories = fileManifestPaths(value(QLatin1String("directories")));
+    } catch (const QInstaller::Error &e) {
+        setError(UserDefinedError);
+        setErrorString(e.message());
+        return false;
+    }
+
+    for (int i = 0; i < files.count(); ++i)
+        files[i] = targetDir.filePath(files.at(i));
+
+    QString errorString;
+    QStringList remaining;
+    foreach (const QString &path, removeConcurrently(files, this)) {
+        QFile file(path);
+        if (file.remove())
+            continue;
+        if (errorString.isEmpty())
+            errorString = tr("Could not delete file %1: %2").arg(path, file.errorString());
+        remaining.append(targetDir.relativeFilePath(path));
+    }
+    setValue(QLatin1String("files"), fileManifest(remaining));
+
+    const QStringList backups = value(QLatin1String("backups")).toStringList();
+    for (int i = 0; i + 1 < backups.count(); i += 2) {
+        const QString target = targetDir.filePath(backups.at(i));
+        if (!QFile::rename(backups.at(i + 1), target) && errorString.isEmpty())
+            errorString = tr("Could not restore backup file into %1.").arg(target);
+    }
+    clearValue(QLatin1String("backups"));
+
+    // directories still containing files that were not created by us are kept
+    for (int i = directories.count() - 1; i >= 0; --i)
+        QDir().rmdir(targetDir.filePath(directories.at(i)));
+    setValue(QLatin1String("directories"), QString());
+
+    if (hasValue(QLatin1String("createddir"))) {
+        const QString createdDir = value(QLatin1String("createddir")).toString();
+        QString path = targetDir.absolutePath();
+        while (path.length() >= createdDir.length() && QDir().rmdir(path))
+            path = QFileInfo(path).absolutePath();
+    }
+
+    if (!errorString.isEmpty()) {
+        setError(UserDefinedError, errorString);
+        return false;
+    }
+    return true;
+}
+
+void CopyTreeOperation::removeProgress(int removed, int total)
+{
+    if (total > 0)
+        emit progressChanged(double(removed) / total);
+}
+
+bool CopyTreeOperation::testOperation()
+{
+    return true;
+}
+
+Operation *CopyTreeOperation::clone() const
+{
+    return new CopyTreeOperation();
+}
+
+/*!
+    \reimp
+*/
+QDomDocument CopyTreeOperation::toXml() const
+{
+    // we don't want to save the backups of overwritten files
+    if (!hasValue(QLatin1String("backups")))
+        return UpdateOperation::toXml();
+
+    CopyTreeOperation *const me = const_cast<CopyTreeOperation *>(this);
+
+    const QVariant v = value(QLatin1String("backups"));
+    me->clearValue(QLatin1String("backups"));
+    const QDomDocument xml = UpdateOperation::toXml();
+    me->setValue(QLatin1String("backups"), v);
+    return xml;
+}
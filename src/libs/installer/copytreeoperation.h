@@ -0,0 +1,65 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+#ifndef COPYTREEOPERATION_H
+#define COPYTREEOPERATION_H
+
+#include "fileutils.h"
+#include "qinstallerglobal.h"
+
+#include <QtCore/QObject>
+
+namespace QInstaller {
+
+class INSTALLER_EXPORT CopyTreeOperation : public QObject, public Operation, private RemoveObserver
+{
+    Q_OBJECT
+
+public:
+    CopyTreeOperation();
+    ~CopyTreeOperation();
+
+    void backup();
+    bool performOperation();
+    bool undoOperation();
+    bool testOperation();
+    Operation *clone() const;
+
+    QDomDocument toXml() const;
+
+Q_SIGNALS:
+    void outputTextChanged(const QString &progress);
+    void progressChanged(double);
+
+private:
+    void removeProgress(int removed, int total);
+};
+
+}
+
+#endif
@@ -30,7 +30,6 @@
 #include "binaryformat.h"
 #include "errors.h"
 #include "fileutils.h"
-#include "copydirectoryoperation.h"
 #include "lib7z_facade.h"
 #include "packagemanagercore.h"
 
@@ -57,7 +56,7 @@ public:
     ~AutoHelper()
     {
         m_op->emitFullProgress();
-        m_op->setValue(QLatin1String("files"), m_files);
+        m_op->setValue(QLatin1String("files"), fileManifest(m_files));
     }
 
     QStringList m_files;
@@ -69,6 +68,9 @@ public:
 
 namespace Static {
 
+static const QFile::Permissions scFilePermissions = QFile::ReadOwner | QFile::WriteOwner
+    | QFile::ReadUser | QFile::WriteUser | QFile::ReadGroup | QFile::ReadOther;
+
 static void fixPermissions(const QString &repoPath)
 {
     QDirIterator it(repoPath, QDirIterator::Subdirectories);
@@ -76,51 +78,66 @@ static void fixPermissions(const QString &repoPath)
         if (!it.fileInfo().isFile())
             continue;
 
-        if (!QFile::setPermissions(it.filePath(), QFile::ReadOwner | QFile::WriteOwner
-            | QFile::ReadUser | QFile::WriteUser | QFile::ReadGroup | QFile::ReadOther)) {
+        if (!QFile::setPermissions(it.filePath(), scFilePermissions)) {
                 throw Error(CreateLocalRepositoryOperation::tr("Could not set file permissions %1!")
                     .arg(it.filePath()));
         }
     }
 }
 
-static void removeDirectory(const QString &path, AutoHelper *const helper)
+static void setFilePermissions(const QString &path)
 {
-    QInstaller::removeDirectory(path);
-    QStringList files = helper->m_files.filter(path);
-    foreach (const QString &file, files)
-        helper->m_files.removeAll(file);
+    if (!QFile::setPermissions(path, scFilePermissions)) {
+        throw Error(CreateLocalRepositoryOperation::tr("Could not set file permissions %1!")
+            .arg(path));
+    }
 }
 
-static void removeFiles(const QString &path, AutoHelper *const helper)
+static void copyFile(const QString &source, const QString &target, AutoHelper *const helper)
 {
-    const QFileInfoList entries = QDir(path).entryInfoList(QDir::AllEntries | QDir::Hidden);
-    foreach (const QFileInfo &fi, entries) {
-        if (fi.isSymLink() || fi.isFile()) {
-            QFile f(fi.filePath());
-            if (!f.remove()) {
-                throw Error(CreateLocalRepositoryOperation::tr("Could not remove file %1: %2")
-                    .arg(f.fileName(), f.errorString()));
-            }
-            helper->m_files.removeAll(f.fileName());
-        }
-    }
+    QFile in(source);
+    QInstaller::openForRead(&in, source);
+    QFile out(target);
+    QInstaller::openForWrite(&out, target);
+    helper->m_files.append(target);
+    QInstaller::blockingCopy(&in, &out, in.size());
+    out.close();
+    setFilePermissions(target);
 }
 
-static QString createArchive(const QString repoPath, const QString &sourceDir, const QString &version
-    , AutoHelper *const helper)
+static void copyArchive(QInstallerCreator::Archive *archive, const QString &target,
+    AutoHelper *const helper)
 {
-    const QString fileName = QString::fromLatin1("/%1meta.7z").arg(version);
+    QFile out(target);
+    QInstaller::openForWrite(&out, target);
+    helper->m_files.append(target);
+    archive->copyTo(&out);
+    out.close();
+    setFilePermissions(target);
+}
 
-    QFile archive(repoPath + fileName);
-    QInstaller::openForWrite(&archive, archive.fileName());
+/*!
+    Compresses the meta data of \a name from the resources. Only needed for installers that were
+    created without the compressed meta data.
+*/
+static void createArchive(const QString &name, const QString &target, AutoHelper *const helper)
+{
+    const QString tmpDir = QInstaller::createTemporaryDirectory(QLatin1String("localrepo"));
+    TempDirDeleter tmpDirDeleter(tmpDir);
+
+    const QString sourceDir = tmpDir + QLatin1Char('/') + name;
+    const QString resourceDir = QLatin1String(":/metadata/") + name;
+    if (QFileInfo(resourceDir).isDir())
+        QInstaller::copyDirectoryContents(resourceDir, sourceDir);
+    else
+        QInstaller::mkdir(sourceDir);
+    // copying from the read only resource file system sets bogus permissions
+    fixPermissions(sourceDir);
+
+    QFile archive(target);
+    QInstaller::openForWrite(&archive, target);
+    helper->m_files.append(target);
     Lib7z::createArchive(&archive, QStringList() << sourceDir);
-    removeFiles(sourceDir, helper); // cleanup the files we compressed
-    if (!archive.rename(sourceDir + fileName)) {
-        throw Error(CreateLocalRepositoryOperation::tr("Could not move file %1 to %2. Error: %3").arg(archive
-            .fileName(), sourceDir + fileName, archive.errorString()));
-    }
-    return archive.fileName();
 }
 
 }   // namespace Statics
@@ -180,28 +197,14 @@ bool CreateLocalRepositoryOperation::performOperation()
         }
         setValue(QLatin1String("createddir"), mkDirOp.value(QLatin1String("createddir")));
 
-        // copy the whole meta data into local repository
-        CopyDirectoryOperation copyDirOp;
-        copyDirOp.setArguments(QStringList() << QLatin1String(":/metadata/") << repoPath);
-        connect(&copyDirOp, SIGNAL(outputTextChanged(QString)), this, SIGNAL(outputTextChanged(QString)));
-
-        const bool success = copyDirOp.performOperation();
-        helper.m_files = copyDirOp.value(QLatin1String("files")).toStringList();
-        if (!success) {
-            setError(copyDirOp.error());
-            setErrorString(copyDirOp.errorString());
-            return false;
-        }
-
-        emit progressChanged(0.25);
-
-        // we need to fix the folder and file permissions here, as copying from read only resource file
-        // systems sets all permissions to a completely bogus value...
-        Static::fixPermissions(repoPath);
+        // the repository only needs the updates xml, the meta data archives and the data archives
+        const QString updatesXmlPath = repoPath + QLatin1String("Updates.xml");
+        Static::copyFile(QLatin1String(":/metadata/Updates.xml"), updatesXmlPath, &helper);
+        emit outputTextChanged(updatesXmlPath);
 
         // open the updates xml file we previously copied
-        QFile updatesXml(repoPath + QLatin1String("Updates.xml"));
-        if (!updatesXml.exists() || !updatesXml.open(QIODevice::ReadOnly))
+        QFile updatesXml(updatesXmlPath);
+        if (!updatesXml.open(QIODevice::ReadOnly))
             throw QInstaller::Error(tr("Could not open file: %1").arg(updatesXml.fileName()));
 
         // read the content of the updates xml
@@ -211,7 +214,7 @@ bool CreateLocalRepositoryOperation::performOperation()
             throw QInstaller::Error(tr("Could not read: %1. Error: %2").arg(updatesXml.fileName(), error));
 
         // build for each available package a name - version mapping
-        QHash<QString, QString> versionMap;
+        QList<QPair<QString, QString> > packages;
         const QDomElement root = doc.documentElement();
         const QDomNodeList rootChildNodes = root.childNodes();
         for (int i = 0; i < rootChildNodes.count(); ++i) {
@@ -229,11 +232,11 @@ bool CreateLocalRepositoryOperation::performOperation()
                     else if (e.tagName() == QLatin1String("Version"))
                         version = e.text();
                 }
-                versionMap.insert(name, version);
+                packages.append(qMakePair(name, version));
             }
         }
 
-        emit progressChanged(0.50);
+        emit progressChanged(0.25);
 
         QSharedPointer<QFile> file(new QFile(binaryPath));
         if (!file->open(QIODevice::ReadOnly)) {
@@ -255,64 +258,31 @@ bool CreateLocalRepositoryOperation::performOperation()
         QInstallerCreator::ComponentIndex componentIndex = QInstallerCreator::ComponentIndex::read(file,
             dataBlockStart);
 
-        QDirIterator it(repoPath, QDirIterator::Subdirectories);
-        while (it.hasNext() && !it.next().isEmpty()) {
-            if (it.fileInfo().isDir()) {
-                const QString fileName = it.fileName();
-                const QString absoluteTargetPath = QDir(repoPath).absoluteFilePath(fileName);
-
-                // zip the meta files that come with the offline installer
-                if (versionMap.contains(fileName)) {
-                    helper.m_files.prepend(Static::createArchive(repoPath, absoluteTargetPath,
-                        versionMap.value(fileName), &helper));
-                    versionMap.remove(fileName);
-                    emit outputTextChanged(helper.m_files.first());
-                }
-
-                // copy the 7z files that are inside the component index into the target
-                QInstallerCreator::Component c = componentIndex.componentByName(fileName.toUtf8());
-                if (c.archives().count()) {
-                    QVector<QSharedPointer<QInstallerCreator::Archive> > archives = c.archives();
-                    foreach (const QSharedPointer<QInstallerCreator::Archive> &a, archives) {
-                        if (!a->open(QIODevice::ReadOnly))
-                            continue;
-
-                        QFile target(absoluteTargetPath + QDir::separator() + QString::fromUtf8(a->name()));
-                        QInstaller::openForWrite(&target, target.fileName());
-                        QInstaller::blockingCopy(a.data(), &target, a->size());
-                        helper.m_files.prepend(target.fileName());
-                        emit outputTextChanged(helper.m_files.first());
-                    }
-                }
-            }
-        }
-
-        emit progressChanged(0.75);
-
-        QDir repo(repoPath);
-        if (!versionMap.isEmpty()) {
-            // offline installers might miss possible old components
-            foreach (const QString &dir, versionMap.keys()) {
-                const QString missingDir = repoPath + dir;
-                if (!repo.mkpath(missingDir))
-                    throw QInstaller::Error(tr("Could not create target dir: %1.").arg(missingDir));
-                helper.m_files.prepend(Static::createArchive(repoPath, missingDir, versionMap.value(dir)
-                    , &helper));
-                emit outputTextChanged(helper.m_files.first());
+        for (int i = 0; i < packages.count(); ++i) {
+            const QString name = packages.at(i).first;
+            const QString packageDir = repoPath + name;
+            QInstaller::mkdir(packageDir);
+
+            // the meta data archive is precompressed by binarycreator, older installers lack it
+            const QString metaName = packages.at(i).second + QLatin1String("meta.7z");
+            const QString metaTarget = packageDir + QLatin1Char('/') + metaName;
+            const QString metaSource = QString::fromLatin1(":/metadata/%1/%2").arg(name, metaName);
+            if (QFileInfo(metaSource).isFile())
+                Static::copyFile(metaSource, metaTarget, &helper);
+            else
+                Static::createArchive(name, metaTarget, &helper);
+            emit outputTextChanged(metaTarget);
+
+            // write the 7z files that are inside the component index straight into the target
+            const QInstallerCreator::Component c = componentIndex.componentByName(name.toUtf8());
+            foreach (const QSharedPointer<QInstallerCreator::Archive> &a, c.archives()) {
+                const QString target = packageDir + QLatin1Char('/') + QString::fromUtf8(a->name());
+                Static::copyArchive(a.data(), target, &helper);
+                emit outputTextChanged(target);
             }
+            emit progressChanged(0.25 + 0.75 * (i + 1) / packages.count());
         }
 
-        try {
-            // remove these, if we fail it doesn't hurt
-            Static::removeDirectory(QDir::cleanPath(repoPath + QLatin1String("/installer-config")),
-                &helper);
-            Static::removeDirectory(QDir::cleanPath(repoPath + QLatin1String("/config")), &helper);
-            const QStringList files = repo.entryList(QStringList() << QLatin1String("*.qrc"), QDir::Files);
-            foreach (const QString &file, files) {
-                if (repo.remove(file))
-                    helper.m_files.removeAll(QDir::cleanPath(repoPath + file));
-            }
-        } catch (...) {}
         setValue(QLatin1String("local-repo"), repoPath);
     } catch (const Lib7z::SevenZipException &e) {
         setError(UserDefinedError);
@@ -338,8 +308,9 @@ bool CreateLocalRepositoryOperation::undoOperation()
     emit progressChanged(0.0);
 
     QDir dir;
-    const QStringList files = value(QLatin1String("files")).toStringList();
-    foreach (const QString &file, files) {
+    FileManifestReader files(value(QLatin1String("files")));
+    QString file;
+    while (files.next(&file)) {
         emit outputTextChanged(tr("Removing file: %0").arg(file));
         if (!QFile::remove(file)) {
             setError(InvalidArguments);
@@ -348,7 +319,12 @@ bool CreateLocalRepositoryOperation::undoOperation()
         }
         dir.rmpath(QFileInfo(file).absolutePath());
     }
-    setValue(QLatin1String("files"), QStringList());
+    if (files.hasError()) {
+        setError(UserDefinedError);
+        setErrorString(files.errorString());
+        return false;
+    }
+    setValue(QLatin1String("files"), QString());
 
     QDir createdDir = QDir(value(QLatin1String("createddir")).toString());
     if (createdDir == QDir::root() || !createdDir.exists())
@@ -370,7 +346,7 @@ bool CreateLocalRepositoryOperation::undoOperation()
              QString::fromLocal8Bit(strerror(errno))));
 #endif
     }
-    setValue(QLatin1String("files"), QStringList());
+    setValue(QLatin1String("files"), QString());
 
     return result;
 }
@@ -31,6 +31,7 @@
 #include "component.h"
 #include "messageboxhandler.h"
 #include "packagemanagercore.h"
+#include "trace.h"
 #include "utils.h"
 
 #include "kdupdaterfiledownloader.h"
@@ -170,6 +171,10 @@ void DownloadArchivesJob::fetchNextArchive()
     connect(m_downloader, SIGNAL(downloadProgress(double)), this, SLOT(emitDownloadProgress(double)));
     connect(m_downloader, SIGNAL(downloadCompleted()), this, SLOT(registerFile()), Qt::QueuedConnection);
 
+    if (Trace::isEnabled()) {
+        m_downloadSpan.reset(new TraceSpan("download", "downloadArchive",
+            m_archivesToDownload.first().second));
+    }
     m_downloader->download();
 }
 
@@ -202,6 +207,7 @@ void DownloadArchivesJob::timerEvent(QTimerEvent *event)
 void DownloadArchivesJob::registerFile()
 {
     Q_ASSERT(m_downloader != 0);
+    m_downloadSpan.reset();
 
     if (m_canceled)
         return;
@@ -291,7 +297,9 @@ KDUpdater::FileDownloader *DownloadArchivesJob::setupDownloader(const QString &s
                 Qt::QueuedConnection);
             connect(downloader, SIGNAL(downloadStatus(QString)), this, SIGNAL(downloadStatusChanged(QString)));
 
-            if (FileDownloaderFactory::isSupportedScheme(scheme)) {
+            // archives from local repositories are used in place, see LocalFileDownloader
+            if (FileDownloaderFactory::isSupportedScheme(scheme)
+                && scheme != QLatin1String("file")) {
                 downloader->setDownloadedFileName(component->localTempPath() + QLatin1Char('/')
                     + component->name() + QLatin1Char('/') + fi.fileName() + suffix);
             }
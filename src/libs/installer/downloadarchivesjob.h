@@ -32,6 +32,7 @@
 #include <kdjob.h>
 
 #include <QtCore/QPair>
+#include <QtCore/QScopedPointer>
 
 QT_BEGIN_NAMESPACE
 class QTimerEvent;
@@ -45,6 +46,7 @@ namespace QInstaller {
 
 class MessageBoxHandler;
 class PackageManagerCore;
+class TraceSpan;
 
 class DownloadArchivesJob : public KDJob
 {
@@ -92,6 +94,7 @@ private:
     QByteArray m_currentHash;
     double m_lastFileProgress;
     int m_progressChangedTimerId;
+    QScopedPointer<TraceSpan> m_downloadSpan;
 };
 
 } // namespace QInstaller
@@ -40,16 +40,65 @@
 
 namespace QInstaller {
 
+static QString partFileName(const QString &target)
+{
+    return target + QLatin1String(".part");
+}
+
+// Holds the validator of the file a partial download belongs to.
+static QString validatorFileName(const QString &target)
+{
+    return partFileName(target) + QLatin1String(".validator");
+}
+
+static int httpStatusCode(QNetworkReply *reply)
+{
+    return reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+}
+
+// Returns whether reply carries the content of the file, other schemes than HTTP have no status.
+static bool receivesContent(QNetworkReply *reply)
+{
+    const int status = httpStatusCode(reply);
+    return status == 0 || status == 200 || status == 206;
+}
+
+// Returns the validator to send as If-Range, weak entity tags cannot be used for ranges.
+static QByteArray rangeValidator(QNetworkReply *reply)
+{
+    const QByteArray eTag = reply->rawHeader("ETag");
+    if (!eTag.isEmpty() && !eTag.startsWith("W/"))
+        return eTag;
+    return reply->rawHeader("Last-Modified");
+}
+
+// Returns whether the content received by reply can be continued with a range request.
+static bool canResume(QNetworkReply *reply)
+{
+    const int status = httpStatusCode(reply);
+    return status == 206
+        || (status == 200 && reply->rawHeader("Accept-Ranges").trimmed().toLower() == "bytes");
+}
+
 AuthenticationRequiredException::AuthenticationRequiredException(Type type, const QString &message)
     : TaskException(message)
     , m_type(type)
 {
 }
 
-Downloader::Downloader()
+Downloader::Downloader(int maxDownloadsPerHost)
     : m_finished(0)
+    , m_progress(0)
+    , m_pendingCount(0)
+    , m_maxDownloadsPerHost(qMax(1, maxDownloadsPerHost))
+    , m_observer(QCryptographicHash::Sha1, FileTaskObserver::ManualSampling)
 {
     connect(&m_nam, SIGNAL(finished(QNetworkReply*)), SLOT(onFinished(QNetworkReply*)));
+
+    // one timer samples the transfer rate of all downloads and publishes the progress, instead
+    // of having every single transfer report on each chunk received
+    m_sampleTimer.setInterval(100);
+    connect(&m_sampleTimer, SIGNAL(timeout()), this, SLOT(onSampleTimeout()));
 }
 
 Downloader::~Downloader()
@@ -68,9 +117,20 @@ void Downloader::download(QFutureInterface<FileTaskResult> &fi, const QList<File
     m_items = items;
     m_futureInterface = &fi;
 
+    // queue per host, so a slow host does not block the downloads from any other one
+    foreach (const FileTaskItem &item, items)
+        m_pending[QUrl(item.source()).host()].enqueue(item);
+    m_pendingCount = items.count();
+
     fi.reportStarted();
     fi.setExpectedResultCount(items.count());
 
+    // pause, resume and cancel requests arrive as events in the thread running the downloader
+    connect(&m_watcher, SIGNAL(paused()), this, SLOT(onPaused()));
+    connect(&m_watcher, SIGNAL(resumed()), this, SLOT(onResumed()));
+    connect(&m_watcher, SIGNAL(canceled()), this, SLOT(onCanceled()));
+    m_watcher.setFuture(fi.future());
+
     m_nam.setProxyFactory(networkProxyFactory);
     connect(&m_nam, SIGNAL(authenticationRequired(QNetworkReply*,QAuthenticator*)), this,
         SLOT(onAuthenticationRequired(QNetworkReply*,QAuthenticator*)));
@@ -81,15 +141,14 @@ void Downloader::download(QFutureInterface<FileTaskResult> &fi, const QList<File
 
 void Downloader::doDownload()
 {
-    foreach (const FileTaskItem &item, m_items) {
-        if (!startDownload(item))
-            break;
-    }
+    startPendingDownloads();
 
     if (m_items.isEmpty() || m_futureInterface->isCanceled()) {
         m_futureInterface->reportFinished();
         emit finished();    // emit finished, so the event loop can shutdown
+        return;
     }
+    m_sampleTimer.start();
 }
 
 
@@ -107,31 +166,19 @@ void Downloader::onReadyRead()
         return;
 
     Data &data = *m_downloads[reply];
-    if (!data.file) {
-        std::unique_ptr<QFile> file = nullptr;
-        const QString target = data.taskItem.target();
-        if (target.isEmpty()) {
-            std::unique_ptr<QTemporaryFile> tmp(new QTemporaryFile);
-            tmp->setAutoRemove(false);
-            file = std::move(tmp);
-        } else {
-            std::unique_ptr<QFile> tmp(new QFile(target));
-            file = std::move(tmp);
-        }
-
-        if (file->exists() && (!QFileInfo(file->fileName()).isFile())) {
-            m_futureInterface->reportException(TaskException(tr("Target file '%1' already exists "
-                "but is not a file.").arg(file->fileName())));
-            return;
-        }
+    if (reply->attribute(QNetworkRequest::RedirectionTargetAttribute).isValid()) {
+        reply->readAll();   // the body of a redirect is not part of the file
+        return;
+    }
+    if (!receivesContent(reply)) {
+        reply->readAll();   // neither is an error page, the partial file is kept as it is
+        return;
+    }
 
-        if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-            //: %2 is a sentence describing the error
-            m_futureInterface->reportException(TaskException(tr("Could not open target '%1' for "
-                "write. Error: %2.").arg(file->fileName(), file->errorString())));
+    if (!data.validated) {
+        data.validated = true;
+        if (!prepareFile(reply, data))
             return;
-        }
-        data.file = std::move(file);
     }
 
     if (!data.file->isOpen()) {
@@ -163,31 +210,29 @@ void Downloader::onReadyRead()
             written += toWrite;
         }
 
-        data.observer->addSample(read);
         data.observer->addBytesTransfered(read);
         data.observer->addCheckSumData(buffer.data(), read);
-
-        int progress = m_finished * 100;
-        for (const auto &pair : m_downloads)
-            progress += pair.second->observer->progressValue();
-        if (!reply->attribute(QNetworkRequest::RedirectionTargetAttribute).isValid()) {
-            m_futureInterface->setProgressValueAndText(progress / m_items.count(),
-                data.observer->progressText());
-        }
+        m_observer.addSample(read);
+        m_observer.addBytesTransfered(read);
+        updateProgress(data);
     }
 }
 
 void Downloader::onFinished(QNetworkReply *reply)
 {
-    Data &data = *m_downloads[reply];
-    const QString filename = data.file ? data.file->fileName() : QString();
+    const auto it = m_downloads.find(reply);
+    if (it == m_downloads.end())
+        return; // aborted while pausing
+
+    Data &data = *it->second;
     if (!m_futureInterface->isCanceled()) {
         if (reply->attribute(QNetworkRequest::RedirectionTargetAttribute).isValid()) {
             const QUrl url = reply->url()
                 .resolved(reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl());
             const QList<QUrl> redirects = m_redirects.values(reply);
             if (!redirects.contains(url)) {
-                if (data.file)
+                // a partial target file is continued by the redirected request
+                if (data.file && data.taskItem.target().isEmpty())
                     data.file->remove();
 
                 FileTaskItem taskItem = data.taskItem;
@@ -198,9 +243,7 @@ void Downloader::onFinished(QNetworkReply *reply)
                     m_redirects.insertMulti(redirectReply, redirect);
                 m_redirects.insertMulti(redirectReply, url);
 
-                m_downloads.erase(reply);
-                m_redirects.remove(reply);
-                reply->deleteLater();
+                releaseDownload(reply);
                 return;
             } else {
                 m_futureInterface->reportException(TaskException(tr("Redirect loop detected '%1'.")
@@ -208,30 +251,73 @@ void Downloader::onFinished(QNetworkReply *reply)
                 return;
             }
         }
+
+        if (data.offset > 0 && httpStatusCode(reply) == 416) {
+            // the partial file is complete already or does not match anymore, start over
+            if (data.file)
+                data.file->remove();
+            else
+                QFile::remove(partFileName(data.taskItem.target()));
+            if (!data.taskItem.target().isEmpty())
+                QFile::remove(validatorFileName(data.taskItem.target()));
+            startDownload(data.taskItem);
+            releaseDownload(reply);
+            return;
+        }
     }
 
     const QByteArray ba = reply->readAll();
-    if (!ba.isEmpty()) {
-        data.observer->addSample(ba.size());
+    if (!ba.isEmpty() && receivesContent(reply)) {
         data.observer->addBytesTransfered(ba.size());
         data.observer->addCheckSumData(ba.data(), ba.size());
+        m_observer.addSample(ba.size());
+        m_observer.addBytesTransfered(ba.size());
     }
 
+    bool checkSumMatches = true;
     const QByteArray expectedCheckSum = data.taskItem.value(TaskRole::Checksum).toByteArray();
     if (!expectedCheckSum.isEmpty()) {
         if (expectedCheckSum != data.observer->checkSum().toHex()) {
+            checkSumMatches = false;
             m_futureInterface->reportException(TaskException(tr("Checksum mismatch detected '%1'.")
                 .arg(reply->url().toString())));
         }
     }
-    m_futureInterface->reportResult(FileTaskResult(filename, data.observer->checkSum(), data.taskItem));
 
-    m_downloads.erase(reply);
-    m_redirects.remove(reply);
-    reply->deleteLater();
+    QString filename = data.file ? data.file->fileName() : QString();
+    const QString target = data.taskItem.target();
+    if (data.file && !target.isEmpty()) {
+        data.file->close();
+        if (reply->error() == QNetworkReply::NoError && checkSumMatches) {
+            QFile::remove(target);
+            if (QFile::rename(filename, target)) {
+                filename = target;
+                QFile::remove(validatorFileName(target));
+            } else {
+                m_futureInterface->reportException(TaskException(tr("Could not rename '%1' to "
+                    "'%2'.").arg(filename, target)));
+            }
+        } else if (!checkSumMatches || (receivesContent(reply)
+            && (!canResume(reply) || data.validator.isEmpty()))) {
+            // cannot be continued, keep only what can be resumed
+            data.file->remove();
+            QFile::remove(validatorFileName(target));
+        }
+    }
+
+    FileTaskResult result(filename, data.observer->checkSum(), data.taskItem);
+    result.insert(TaskRole::HttpStatusCode, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute));
+    result.insert(TaskRole::ETag, reply->rawHeader("ETag"));
+    result.insert(TaskRole::LastModified, reply->rawHeader("Last-Modified"));
+    m_futureInterface->reportResult(result);
+
+    releaseDownload(reply);
 
     m_finished++;
-    if (m_downloads.empty() || m_futureInterface->isCanceled()) {
+    if (!m_futureInterface->isCanceled())
+        startPendingDownloads();    // reuse the slot, QNAM keeps the connection alive
+
+    if ((m_downloads.empty() && m_pendingCount == 0) || m_futureInterface->isCanceled()) {
         m_futureInterface->reportFinished();
         emit finished();    // emit finished, so the event loop can shutdown
     }
@@ -248,6 +334,9 @@ void Downloader::onError(QNetworkReply::NetworkError error)
 
     if (reply) {
         const Data &data = *m_downloads[reply];
+        if (data.offset > 0 && httpStatusCode(reply) == 416)
+            return; // handled in onFinished by starting over
+
         //Do not throw error if Updates.xml not found. The repository might be removed
         //with RepositoryUpdate in Updates.xml later.
         if (data.taskItem.source().contains(QLatin1String("Updates.xml"), Qt::CaseInsensitive)) {
@@ -282,8 +371,14 @@ void Downloader::onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
     Q_UNUSED(bytesReceived)
     QNetworkReply *const reply = qobject_cast<QNetworkReply *>(sender());
     if (reply) {
-        const Data &data = *m_downloads[reply];
+        Data &data = *m_downloads[reply];
+        if (bytesTotal > 0 && data.offset > 0 && httpStatusCode(reply) == 206)
+            bytesTotal += data.offset;  // only the remaining part is transferred
+        // unknown sizes (-1) do not count towards the overall amount
+        m_observer.setBytesToTransfer(m_observer.bytesToTransfer() + qMax(bytesTotal, qint64(0))
+            - qMax(data.observer->bytesToTransfer(), qint64(0)));
         data.observer->setBytesToTransfer(bytesTotal);
+        updateProgress(data);
     }
 }
 
@@ -319,22 +414,113 @@ void Downloader::onProxyAuthenticationRequired(const QNetworkProxy &proxy, QAuth
     m_futureInterface->reportException(e);
 }
 
+void Downloader::onSampleTimeout()
+{
+    m_observer.timerEvent(0);
+    m_futureInterface->setProgressValueAndText((m_finished * 100 + m_progress) / m_items.count(),
+        m_observer.progressText());
+}
+
+void Downloader::onPaused()
+{
+    m_sampleTimer.stop();
+
+    // Abort the running transfers, but keep their files and checksum state. On resume the
+    // remaining part is requested by range.
+    auto it = m_downloads.begin();
+    while (it != m_downloads.end()) {
+        QNetworkReply *const reply = it->first;
+        std::unique_ptr<Data> data = std::move(it->second);
+        if (data->file && data->file->isOpen()) {
+            data->file->flush();
+            data->offset = data->file->pos();
+        }
+        m_progress -= data->progress;
+        data->progress = 0;
+        --m_runningPerHost[data->host];
+        m_paused.push_back(std::move(data));
+
+        it = m_downloads.erase(it);
+        m_redirects.remove(reply);
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+void Downloader::onResumed()
+{
+    std::vector<std::unique_ptr<Data>> paused;
+    paused.swap(m_paused);
+    for (auto &data : paused) {
+        if (!sendRequest(std::move(data)))
+            return;
+    }
+
+    if (!startPendingDownloads())
+        return;
+    m_sampleTimer.start();
+}
+
+void Downloader::onCanceled()
+{
+    m_futureInterface->reportFinished();
+    emit finished();    // emit finished, so the event loop can shutdown
+}
+
 
 // -- private
 
 bool Downloader::testCanceled()
 {
-    // TODO: figure out how to implement pause and resume
-    if (m_futureInterface->isPaused()) {
-        m_futureInterface->togglePaused();  // Note: this will trigger cancel
-        m_futureInterface->reportException(
-                    TaskException(tr("Pause and resume not supported by network transfers.")));
-    }
+    // pausing is handled by onPaused(), once the event reached the downloader's thread
     return m_futureInterface->isCanceled();
 }
 
+/*!
+    Starts queued downloads until every host has reached the maximum number of concurrent
+    downloads. Returns \c false if a download could not be started.
+*/
+bool Downloader::startPendingDownloads()
+{
+    QHash<QString, QQueue<FileTaskItem> >::iterator it = m_pending.begin();
+    while (it != m_pending.end()) {
+        QQueue<FileTaskItem> &queue = it.value();
+        while (!queue.isEmpty() && m_runningPerHost.value(it.key()) < m_maxDownloadsPerHost) {
+            --m_pendingCount;
+            if (!startDownload(queue.dequeue()))
+                return false;
+        }
+        if (queue.isEmpty())
+            it = m_pending.erase(it);
+        else
+            ++it;
+    }
+    return true;
+}
+
 QNetworkReply *Downloader::startDownload(const FileTaskItem &item)
 {
+    std::unique_ptr<Data> data(new Data(item));
+
+    // continue a download interrupted before, its prefix is hashed once the server agreed; the
+    // partial file is only continued if it is known which version of the file it belongs to
+    const QString target = item.target();
+    if (!target.isEmpty()) {
+        const QFileInfo part(partFileName(target));
+        QFile validator(validatorFileName(target));
+        if (part.isFile() && validator.open(QIODevice::ReadOnly)) {
+            data->validator = validator.readAll().trimmed();
+            if (!data->validator.isEmpty())
+                data->offset = part.size();
+        }
+    }
+    return sendRequest(std::move(data));
+}
+
+QNetworkReply *Downloader::sendRequest(std::unique_ptr<Data> data)
+{
+    const FileTaskItem &item = data->taskItem;
     QUrl const source = item.source();
     if (!source.isValid()) {
         //: %2 is a sentence describing the error
@@ -343,8 +529,25 @@ QNetworkReply *Downloader::startDownload(const FileTaskItem &item)
         return 0;
     }
 
-    QNetworkReply *reply = m_nam.get(QNetworkRequest(source));
-    std::unique_ptr<Data> data(new Data(item));
+    // send the validators of a previous download, so the server can answer with 304 Not Modified
+    QNetworkRequest request(source);
+    const QByteArray eTag = item.value(TaskRole::ETag).toByteArray();
+    if (!eTag.isEmpty())
+        request.setRawHeader("If-None-Match", eTag);
+    const QByteArray lastModified = item.value(TaskRole::LastModified).toByteArray();
+    if (!lastModified.isEmpty())
+        request.setRawHeader("If-Modified-Since", lastModified);
+    if (data->offset > 0) {
+        // a changed file is sent as a whole instead of being continued
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(data->offset) + '-');
+        if (!data->validator.isEmpty())
+            request.setRawHeader("If-Range", data->validator);
+    }
+
+    QNetworkReply *reply = m_nam.get(request);
+    data->validated = false;
+    data->host = source.host();
+    ++m_runningPerHost[data->host];
     m_downloads[reply] = std::move(data);
 
     connect(reply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
@@ -358,11 +561,130 @@ QNetworkReply *Downloader::startDownload(const FileTaskItem &item)
     return reply;
 }
 
+/*!
+    Opens the target file on the first data received for \a reply. Continues the file if the
+    server answered a range request with partial content, otherwise the file is started over.
+*/
+bool Downloader::prepareFile(QNetworkReply *reply, Data &data)
+{
+    const bool partial = data.offset > 0 && httpStatusCode(reply) == 206;
+    if (!partial)
+        storeValidator(reply, data);
+
+    if (data.file) {
+        // resumed after a pause
+        if (!partial && data.offset > 0) {
+            data.file->resize(0);
+            data.file->seek(0);
+            resetObserver(data);
+        }
+        data.offset = partial ? data.offset : 0;
+        return true;
+    }
+
+    std::unique_ptr<QFile> file = nullptr;
+    const QString target = data.taskItem.target();
+    if (target.isEmpty()) {
+        std::unique_ptr<QTemporaryFile> tmp(new QTemporaryFile);
+        tmp->setAutoRemove(false);
+        file = std::move(tmp);
+    } else {
+        std::unique_ptr<QFile> tmp(new QFile(partFileName(target)));
+        file = std::move(tmp);
+    }
+
+    if (!target.isEmpty() && QFileInfo(target).exists() && !QFileInfo(target).isFile()) {
+        m_futureInterface->reportException(TaskException(tr("Target file '%1' already exists "
+            "but is not a file.").arg(target)));
+        return false;
+    }
+
+    const QIODevice::OpenMode mode = partial ? QIODevice::ReadWrite
+        : QIODevice::WriteOnly | QIODevice::Truncate;
+    if (!file->open(mode)) {
+        //: %2 is a sentence describing the error
+        m_futureInterface->reportException(TaskException(tr("Could not open target '%1' for "
+            "write. Error: %2.").arg(file->fileName(), file->errorString())));
+        return false;
+    }
+
+    if (partial) {
+        // continue the checksum with the data downloaded before
+        QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+        qint64 remaining = data.offset;
+        while (remaining > 0) {
+            const qint64 read = file->read(buffer.data(), qMin<qint64>(remaining, buffer.size()));
+            if (read <= 0) {
+                //: %2 is a sentence describing the error
+                m_futureInterface->reportException(TaskException(tr("Could not read partial "
+                    "download '%1'. Error: %2.").arg(file->fileName(), file->errorString())));
+                return false;
+            }
+            data.observer->addCheckSumData(buffer.constData(), read);
+            remaining -= read;
+        }
+        data.observer->setBytesTransfered(data.offset);
+        m_observer.addBytesTransfered(data.offset);
+    } else {
+        data.offset = 0;
+    }
+    data.file = std::move(file);
+    return true;
+}
+
+/*!
+    Remembers which version of the file \a reply sends, so a later range request continues the
+    partial file only if the file did not change in between.
+*/
+void Downloader::storeValidator(QNetworkReply *reply, Data &data)
+{
+    data.validator = rangeValidator(reply);
+    const QString target = data.taskItem.target();
+    if (target.isEmpty())
+        return;
+
+    QFile file(validatorFileName(target));
+    if (data.validator.isEmpty() || !file.open(QIODevice::WriteOnly)
+        || file.write(data.validator) != data.validator.size()) {
+        file.remove();
+    }
+}
+
+void Downloader::resetObserver(Data &data)
+{
+    m_observer.setBytesTransfered(m_observer.bytesTransfered()
+        - data.observer->bytesTransfered());
+    m_observer.setBytesToTransfer(m_observer.bytesToTransfer()
+        - qMax(data.observer->bytesToTransfer(), qint64(0)));
+    data.observer.reset(new FileTaskObserver(QCryptographicHash::Sha1,
+        FileTaskObserver::ManualSampling));
+    updateProgress(data);
+}
+
+void Downloader::updateProgress(Data &data)
+{
+    const int progress = data.observer->progressValue();
+    m_progress += progress - data.progress;
+    data.progress = progress;
+}
+
+void Downloader::releaseDownload(QNetworkReply *reply)
+{
+    const Data &data = *m_downloads[reply];
+    m_progress -= data.progress;
+    --m_runningPerHost[data.host];
+
+    m_downloads.erase(reply);
+    m_redirects.remove(reply);
+    reply->deleteLater();
+}
+
 
 // -- DownloadFileTask
 
 DownloadFileTask::DownloadFileTask(const QList<FileTaskItem> &items)
     : AbstractFileTask()
+    , m_maxDownloadsPerHost(DefaultMaxDownloadsPerHost)
 {
     setTaskItems(items);
 }
@@ -397,10 +719,20 @@ void DownloadFileTask::setProxyFactory(KDUpdater::FileDownloaderProxyFactory *fa
     m_proxyFactory.reset(factory);
 }
 
+/*!
+    Limits the number of downloads running at the same time against a single host to \a count.
+    Further downloads are queued and started as soon as a running one finished, so that QNAM
+    can reuse the already established connections.
+*/
+void DownloadFileTask::setMaxDownloadsPerHost(int count)
+{
+    m_maxDownloadsPerHost = count;
+}
+
 void DownloadFileTask::doTask(QFutureInterface<FileTaskResult> &fi)
 {
     QEventLoop el;
-    Downloader downloader;
+    Downloader downloader(m_maxDownloadsPerHost);
     connect(&downloader, SIGNAL(finished()), &el, SLOT(quit()));
 
     QList<FileTaskItem> items = taskItems();
@@ -40,7 +40,10 @@ namespace QInstaller {
 namespace TaskRole {
 enum
 {
-    Authenticator = TaskRole::TargetFile + 10
+    Authenticator = TaskRole::TargetFile + 10,
+    ETag,
+    LastModified,
+    HttpStatusCode
 };
 }
 
@@ -79,15 +82,23 @@ class INSTALLER_EXPORT DownloadFileTask : public AbstractFileTask
     Q_DISABLE_COPY(DownloadFileTask)
 
 public:
-    DownloadFileTask() {}
+    enum {
+        DefaultMaxDownloadsPerHost = 6
+    };
+
+    DownloadFileTask()
+        : m_maxDownloadsPerHost(DefaultMaxDownloadsPerHost) {}
     explicit DownloadFileTask(const FileTaskItem &item)
-        : AbstractFileTask(item) {}
+        : AbstractFileTask(item)
+        , m_maxDownloadsPerHost(DefaultMaxDownloadsPerHost) {}
     explicit DownloadFileTask(const QList<FileTaskItem> &items);
 
     explicit DownloadFileTask(const QString &source)
-        : AbstractFileTask(source) {}
+        : AbstractFileTask(source)
+        , m_maxDownloadsPerHost(DefaultMaxDownloadsPerHost) {}
     DownloadFileTask(const QString &source, const QString &target)
-        : AbstractFileTask(source, target) {}
+        : AbstractFileTask(source, target)
+        , m_maxDownloadsPerHost(DefaultMaxDownloadsPerHost) {}
 
     void addTaskItem(const FileTaskItem &items);
     void addTaskItems(const QList<FileTaskItem> &items);
@@ -98,10 +109,14 @@ public:
     void setAuthenticator(const QAuthenticator &authenticator);
     void setProxyFactory(KDUpdater::FileDownloaderProxyFactory *factory);
 
+    int maxDownloadsPerHost() const { return m_maxDownloadsPerHost; }
+    void setMaxDownloadsPerHost(int count);
+
     void doTask(QFutureInterface<FileTaskResult> &fi);
 
 private:
     friend class Downloader;
+    int m_maxDownloadsPerHost;
     QAuthenticator m_authenticator;
     QScopedPointer<KDUpdater::FileDownloaderProxyFactory> m_proxyFactory;
 };
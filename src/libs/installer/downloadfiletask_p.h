@@ -33,12 +33,17 @@
 #include <observer.h>
 
 #include <QFile>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QQueue>
+#include <QTimer>
 
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 QT_BEGIN_NAMESPACE
 class QSslError;
@@ -53,15 +58,26 @@ struct Data
     Data()
         : file(nullptr)
         , observer(nullptr)
+        , progress(0)
+        , offset(0)
+        , validated(false)
     {}
 
     Data(const FileTaskItem &fti)
         : taskItem(fti)
         , file(nullptr)
-        , observer(new FileTaskObserver(QCryptographicHash::Sha1))
+        , observer(new FileTaskObserver(QCryptographicHash::Sha1, FileTaskObserver::ManualSampling))
+        , progress(0)
+        , offset(0)
+        , validated(false)
     {}
 
     FileTaskItem taskItem;
+    QString host;
+    int progress;   // last value added to Downloader::m_progress
+    qint64 offset;  // bytes already on disk when the request was sent, requested by range
+    bool validated; // the response of the current request has been checked for partial content
+    QByteArray validator;   // ETag or Last-Modified of the file the partial file belongs to
     std::unique_ptr<QFile> file;
     std::unique_ptr<FileTaskObserver> observer;
 };
@@ -72,7 +88,7 @@ class Downloader : public QObject
     Q_DISABLE_COPY(Downloader)
 
 public:
-    Downloader();
+    explicit Downloader(int maxDownloadsPerHost);
     ~Downloader();
 
     void download(QFutureInterface<FileTaskResult> &fi, const QList<FileTaskItem> &items,
@@ -90,20 +106,40 @@ private slots:
     void onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
     void onAuthenticationRequired(QNetworkReply *reply, QAuthenticator *authenticator);
     void onProxyAuthenticationRequired(const QNetworkProxy &proxy, QAuthenticator *authenticator);
+    void onSampleTimeout();
+    void onPaused();
+    void onResumed();
+    void onCanceled();
 
 
 private:
     bool testCanceled();
+    bool startPendingDownloads();
     QNetworkReply *startDownload(const FileTaskItem &item);
+    QNetworkReply *sendRequest(std::unique_ptr<Data> data);
+    bool prepareFile(QNetworkReply *reply, Data &data);
+    void storeValidator(QNetworkReply *reply, Data &data);
+    void resetObserver(Data &data);
+    void updateProgress(Data &data);
+    void releaseDownload(QNetworkReply *reply);
 
 private:
     QFutureInterface<FileTaskResult> *m_futureInterface;
 
     int m_finished;
+    int m_progress;
+    int m_pendingCount;
+    int m_maxDownloadsPerHost;
+    QTimer m_sampleTimer;
+    FileTaskObserver m_observer;
+    QFutureWatcher<FileTaskResult> m_watcher;
+    QHash<QString, int> m_runningPerHost;
+    QHash<QString, QQueue<FileTaskItem> > m_pending;
     QNetworkAccessManager m_nam;
     QList<FileTaskItem> m_items;
     QMultiHash<QNetworkReply*, QUrl> m_redirects;
     std::unordered_map<QNetworkReply*, std::unique_ptr<Data>> m_downloads;
+    std::vector<std::unique_ptr<Data>> m_paused;
 };
 
 }   // namespace QInstaller
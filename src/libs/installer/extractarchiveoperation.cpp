@@ -29,6 +29,8 @@
 #include "extractarchiveoperation.h"
 #include "extractarchiveoperation_p.h"
 
+#include "errors.h"
+
 #include <QtCore/QEventLoop>
 #include <QtCore/QThread>
 #include <QtCore/QThreadPool>
@@ -59,6 +61,16 @@ bool ExtractArchiveOperation::performOperation()
     const QString archivePath = args.first();
     const QString targetDir = args.at(1);
 
+    // keep what a previous attempt of this operation extracted
+    m_files = FileManifestWriter();
+    try {
+        m_files.append(fileManifestPaths(value(QLatin1String("files"))));
+    } catch (const QInstaller::Error &e) {
+        setError(UserDefinedError);
+        setErrorString(e.message());
+        return false;
+    }
+
     Receiver receiver;
     Callback callback;
 
@@ -68,6 +80,12 @@ bool ExtractArchiveOperation::performOperation()
     if (PackageManagerCore *core = this->value(QLatin1String("installer")).value<PackageManagerCore*>()) {
         connect(core, SIGNAL(statusChanged(QInstaller::PackageManagerCore::Status)), &callback,
             SLOT(statusChanged(QInstaller::PackageManagerCore::Status)));
+
+        // archives embedded into an offline installer carry their checksum file next to them,
+        // downloaded archives have already been verified while downloading
+        QFile sha1File(archivePath + QLatin1String(".sha1"));
+        if (core->testChecksum() && sha1File.open(QIODevice::ReadOnly))
+            callback.setExpectedSha1(sha1File.readAll());
     }
 
     //Runnable is derived from QRunable which will be deleted by the ThreadPool -> no parent is needed
@@ -84,6 +102,7 @@ bool ExtractArchiveOperation::performOperation()
         runnable->run();
         receiver.runnableFinished(true, QString());
     }
+    setValue(QLatin1String("files"), m_files.manifest());
 
     typedef QPair<QString, QString> StringPair;
     QVector<StringPair> backupFiles = callback.backupFiles;
@@ -108,10 +127,16 @@ bool ExtractArchiveOperation::undoOperation()
     //const QString archivePath = arguments().first();
     //const QString targetDir = arguments().last();
 
-    const QStringList files = value(QLatin1String("files")).toStringList();
+    QStringList files;
+    try {
+        files = fileManifestPaths(value(QLatin1String("files")));
+    } catch (const QInstaller::Error &e) {
+        setError(UserDefinedError);
+        setErrorString(e.message());
+        return false;
+    }
 
     WorkerThread *const thread = new WorkerThread(this, files);
-    connect(thread, SIGNAL(currentFileChanged(QString)), this, SIGNAL(outputTextChanged(QString)));
     connect(thread, SIGNAL(progressChanged(double)), this, SIGNAL(progressChanged(double)));
 
     QEventLoop loop;
@@ -137,8 +162,6 @@ Operation *ExtractArchiveOperation::clone() const
 */
 void ExtractArchiveOperation::fileFinished(const QString &filename)
 {
-    QStringList files = value(QLatin1String("files")).toStringList();
-    files.prepend(filename);
-    setValue(QLatin1String("files"), files);
+    m_files.append(filename);
     emit outputTextChanged(filename);
 }
@@ -29,6 +29,7 @@
 #ifndef EXTRACTARCHIVEOPERATION_H
 #define EXTRACTARCHIVEOPERATION_H
 
+#include "fileutils.h"
 #include "qinstallerglobal.h"
 
 #include <QtCore/QObject>
@@ -60,6 +61,8 @@ private:
     class Callback;
     class Runnable;
     class Receiver;
+
+    FileManifestWriter m_files;
 };
 
 }
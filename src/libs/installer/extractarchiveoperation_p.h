@@ -42,7 +42,7 @@
 
 namespace QInstaller {
 
-class WorkerThread : public QThread
+class WorkerThread : public QThread, private RemoveObserver
 {
     Q_OBJECT
 public:
@@ -59,26 +59,21 @@ public:
         ExtractArchiveOperation *const op = m_op;//dynamic_cast< ExtractArchiveOperation* >(parent());
         Q_ASSERT(op != 0);
 
-        int removedCounter = 0;
-        foreach (const QString &file, m_files) {
-            removedCounter++;
-            const QFileInfo fi(file);
-            emit currentFileChanged(file);
-            emit progressChanged(double(removedCounter) / m_files.count());
-            if (fi.isFile() || fi.isSymLink()) {
-                op->deleteFileNowOrLater(fi.absoluteFilePath());
-            } else if (fi.isDir()) {
-                const QDir d = fi.dir();
-                removeSystemGeneratedFiles(file);
-                d.rmdir(file); // directory may not exist
-            }
-        }
+        // files still in use get renamed and are removed later on
+        foreach (const QString &file, removeConcurrently(m_files, this))
+            op->deleteFileNowOrLater(QFileInfo(file).absoluteFilePath());
     }
 
 Q_SIGNALS:
-    void currentFileChanged(const QString &filename);
     void progressChanged(double);
 
+private:
+    void removeProgress(int removed, int total)
+    {
+        if (total > 0)
+            emit progressChanged(double(removed) / total);
+    }
+
 private:
     QStringList m_files;
     ExtractArchiveOperation *m_op;
@@ -29,24 +29,38 @@
 
 #include <errors.h>
 
+#include <QtCore/QByteArrayMatcher>
 #include <QtCore/QDateTime>
 #include <QtCore/QDir>
 #include <QtCore/QDirIterator>
 #include <QtCore/QEventLoop>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
 #include <QtCore/QTemporaryFile>
 #include <QtCore/QThread>
+#include <QtCore/QThreadPool>
 #include <QtCore/QUrl>
+#include <QtCore/QVector>
 #include <QtCore/QCoreApplication>
 #include <QImageReader>
 
+#include <algorithm>
 #include <errno.h>
 
 #ifdef Q_OS_UNIX
+#include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #endif
 
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
 using namespace QInstaller;
 
 
@@ -124,6 +138,230 @@ void TempDirDeleter::releaseAndDelete(const QString &path)
     }
 }
 
+
+// -- FileRewriter
+
+/*!
+    \class QInstaller::FileRewriter
+    Writes a new version of the file \a fileName into a temporary file next to it, which replaces
+    the original only once commit() is called. An uncommitted temporary file is removed again. If
+    \a fileName is a symbolic link, the file it points to is rewritten and the link is kept.
+*/
+FileRewriter::FileRewriter(const QString &fileName)
+{
+    const QString canonicalFilePath = QFileInfo(fileName).canonicalFilePath();
+    m_source.setFileName(canonicalFilePath.isEmpty() ? fileName : canonicalFilePath);
+}
+
+FileRewriter::~FileRewriter()
+{
+    if (m_target.fileName().isEmpty())
+        return;
+    m_target.close();
+    if (!m_target.remove())
+        qDebug() << "Could not remove temporary file" << m_target.fileName()
+                 << m_target.errorString();
+}
+
+/*!
+    Opens the source for reading and the temporary target for writing, both with the additional
+    flags \a mode, e.g. QIODevice::Text. The target gets the permissions and, where the process is
+    allowed to set it, the owner of the source.
+
+    \throws QInstaller::Error if one of the files cannot be opened.
+*/
+void FileRewriter::open(QIODevice::OpenMode mode)
+{
+    if (!m_source.open(QIODevice::ReadOnly | mode)) {
+        throw Error(QObject::tr("Cannot open file %1 for reading: %2").arg(m_source.fileName(),
+            m_source.errorString()));
+    }
+    m_target.setFileName(generateTemporaryFileName(m_source.fileName()));
+    if (!m_target.open(QIODevice::WriteOnly | mode)) {
+        const QString errorString = m_target.errorString();
+        m_target.setFileName(QString());
+        throw Error(QObject::tr("Cannot open file %1 for writing: %2").arg(m_source.fileName(),
+            errorString));
+    }
+    m_target.setPermissions(m_source.permissions());
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (::fstat(m_source.handle(), &st) == 0 && (st.st_uid != ::geteuid() || st.st_gid != ::getegid())
+        && ::fchown(m_target.handle(), st.st_uid, st.st_gid) != 0) {
+        qDebug() << "Could not change owner of" << m_target.fileName() << ":" << strerror(errno);
+    }
+#endif
+}
+
+/*!
+    Replaces the source with everything written to the target so far. If \a keepBackup is \c true,
+    the original file is renamed instead of removed and its new name is returned.
+
+    \throws QInstaller::Error if the target cannot be written or renamed.
+*/
+QString FileRewriter::commit(bool keepBackup)
+{
+    const QString fileName = m_source.fileName();
+    m_source.close();
+    if (!m_target.flush() || m_target.error() != QFile::NoError) {
+        throw Error(QObject::tr("Cannot write file %1: %2").arg(fileName,
+            m_target.errorString()));
+    }
+    m_target.close();
+
+    const QString backup = keepBackup ? generateTemporaryFileName(fileName) : QString();
+#ifdef Q_OS_UNIX
+    // replace the original in one step, so that it never goes missing in between
+    const QByteArray nativeName = QFile::encodeName(fileName);
+    if (!keepBackup || ::link(nativeName.constData(), QFile::encodeName(backup).constData()) == 0) {
+        if (::rename(QFile::encodeName(m_target.fileName()).constData(), nativeName.constData()) == 0) {
+            m_target.setFileName(QString());
+            return backup;
+        }
+        if (keepBackup)
+            QFile::remove(backup);
+    }
+#endif
+    const QString renamed = keepBackup ? backup : generateTemporaryFileName(fileName);
+    if (!m_source.rename(renamed)) {
+        throw Error(QObject::tr("Cannot rename file %1 to %2: %3").arg(fileName, renamed,
+            m_source.errorString()));
+    }
+    if (!m_target.rename(fileName)) {
+        const QString errorString = m_target.errorString();
+        m_source.rename(fileName);
+        throw Error(QObject::tr("Cannot rename file %1 to %2: %3").arg(m_target.fileName(),
+            fileName, errorString));
+    }
+    m_target.setFileName(QString());
+    if (!keepBackup && !m_source.remove())
+        qDebug() << "Could not remove file" << renamed << m_source.errorString();
+    return backup;
+}
+
+/*!
+    \class QInstaller::FileManifestWriter
+    Builds the compact list of installed paths that operations keep for their undo. Every path is
+    stored as the length of the prefix it shares with the previous one, a space and the remaining
+    characters, one path per line. Paths below a common directory therefore cost little more than
+    their file names. Line breaks and backslashes inside the stored characters are escaped.
+*/
+
+void FileManifestWriter::append(const QString &path)
+{
+    const int max = qMin(path.size(), m_previous.size());
+    int shared = 0;
+    while (shared < max && path.at(shared) == m_previous.at(shared))
+        ++shared;
+
+    m_manifest.append(QString::number(shared)).append(QLatin1Char(' '));
+    for (int i = shared; i < path.size(); ++i) {
+        const QChar c = path.at(i);
+        if (c == QLatin1Char('\\'))
+            m_manifest.append(QLatin1String("\\\\"));
+        else if (c == QLatin1Char('\n'))
+            m_manifest.append(QLatin1String("\\n"));
+        else
+            m_manifest.append(c);
+    }
+    m_manifest.append(QLatin1Char('\n'));
+    m_previous = path;
+}
+
+void FileManifestWriter::append(const QStringList &paths)
+{
+    foreach (const QString &path, paths)
+        append(path);
+}
+
+/*!
+    \class QInstaller::FileManifestReader
+    Reads the paths of a manifest written by FileManifestWriter one at a time. A plain string list,
+    as stored by older installers, is read as is. next() returns \c false at the end of the
+    manifest and on malformed input, hasError() tells the two apart.
+*/
+
+FileManifestReader::FileManifestReader(const QVariant &value)
+    : m_position(0)
+{
+    if (value.type() == QVariant::StringList)
+        m_paths = value.toStringList();
+    else
+        m_manifest = value.toString();
+}
+
+bool FileManifestReader::next(QString *path)
+{
+    if (!m_paths.isEmpty()) {
+        if (m_position >= m_paths.count())
+            return false;
+        *path = m_paths.at(m_position++);
+        return true;
+    }
+
+    const int size = m_manifest.size();
+    if (m_position >= size)
+        return false;
+
+    int pos = m_position;
+    int shared = 0;
+    while (pos < size && m_manifest.at(pos).isDigit())
+        shared = shared * 10 + m_manifest.at(pos++).digitValue();
+    if (pos >= size || pos == m_position || m_manifest.at(pos) != QLatin1Char(' ')
+        || shared > m_current.size()) {
+        m_errorString = QCoreApplication::translate("QInstaller",
+            "Malformed file manifest at position %1.").arg(m_position);
+        m_position = size;
+        return false;
+    }
+
+    m_current.truncate(shared);
+    for (++pos; pos < size && m_manifest.at(pos) != QLatin1Char('\n'); ++pos) {
+        const QChar c = m_manifest.at(pos);
+        if (c != QLatin1Char('\\')) {
+            m_current.append(c);
+            continue;
+        }
+        const QChar escaped = ++pos < size ? m_manifest.at(pos) : QChar();
+        if (escaped == QLatin1Char('\\')) {
+            m_current.append(escaped);
+        } else if (escaped == QLatin1Char('n')) {
+            m_current.append(QLatin1Char('\n'));
+        } else {
+            m_errorString = QCoreApplication::translate("QInstaller",
+                "Malformed file manifest at position %1.").arg(pos);
+            m_position = size;
+            return false;
+        }
+    }
+    m_position = pos + 1;
+    *path = m_current;
+    return true;
+}
+
+QString QInstaller::fileManifest(const QStringList &paths)
+{
+    FileManifestWriter writer;
+    writer.append(paths);
+    return writer.manifest();
+}
+
+/*!
+    Returns all paths stored in the manifest \a value.
+    \throws QInstaller::Error if the manifest is malformed
+*/
+QStringList QInstaller::fileManifestPaths(const QVariant &value)
+{
+    QStringList paths;
+    FileManifestReader reader(value);
+    QString path;
+    while (reader.next(&path))
+        paths.append(path);
+    if (reader.hasError())
+        throw Error(reader.errorString());
+    return paths;
+}
+
 QString QInstaller::humanReadableSize(const qint64 &size, int precision)
 {
     double sizeAsDouble = size;
@@ -227,8 +465,8 @@ qint64 QInstaller::blockingRead(QIODevice *in, char *buffer, qint64 size)
 
 void QInstaller::blockingCopy(QIODevice *in, QIODevice *out, qint64 size)
 {
-    static const qint64 blockSize = 4096;
-    QByteArray ba(blockSize, '\0');
+    const qint64 blockSize = copyBufferSize(size);
+    QByteArray ba(int(qMin(blockSize, size)), '\0');
     qint64 actual = qMin(blockSize, size);
     while (actual > 0) {
         blockingRead(in, ba.data(), actual);
@@ -238,6 +476,216 @@ void QInstaller::blockingCopy(QIODevice *in, QIODevice *out, qint64 size)
     }
 }
 
+/*!
+    Copies the remaining content of the open file \a in to the open file \a out inside the kernel,
+    by cloning the file on file systems supporting reflinks, or with copy_file_range() or
+    sendfile(). If \a size is not negative, at most \a size bytes are copied. Returns \c true if
+    everything was copied. Otherwise, the positions of both files are advanced by the amount copied
+    and the caller has to copy the rest itself. Always returns \c false on platforms other than
+    Linux.
+*/
+bool QInstaller::kernelCopy(QFile *in, QFile *out, qint64 size)
+{
+#ifdef Q_OS_LINUX
+    if (!out->flush())
+        return false;
+
+    const int inFd = in->handle();
+    const int outFd = out->handle();
+    if (inFd < 0 || outFd < 0)
+        return false;
+
+    const qint64 inPos = in->pos();
+    const qint64 outPos = out->pos();
+    loff_t inOffset = inPos;
+    loff_t outOffset = outPos;
+    const qint64 inSize = in->size();
+    qint64 remaining = size < 0 ? inSize - inPos : qMin(size, inSize - inPos);
+    static const qint64 chunkSize = 1024 * 1024 * 1024;
+
+#ifdef FICLONE
+    if (inPos == 0 && remaining == inSize && outPos == 0 && out->size() == 0
+        && ::ioctl(outFd, FICLONE, inFd) == 0) {
+        inOffset += remaining;
+        outOffset += remaining;
+        remaining = 0;
+    }
+#endif
+#ifdef SYS_copy_file_range
+    while (remaining > 0) {
+        const ssize_t copied = ::syscall(SYS_copy_file_range, inFd, &inOffset, outFd, &outOffset,
+            size_t(qMin(remaining, chunkSize)), 0u);
+        if (copied <= 0)
+            break;  // e.g. not supported across file systems, try sendfile()
+        remaining -= copied;
+    }
+#endif
+    if (remaining > 0 && ::lseek(outFd, outOffset, SEEK_SET) == outOffset) {
+        while (remaining > 0) {
+            const ssize_t copied = ::sendfile(outFd, inFd, &inOffset, size_t(qMin(remaining,
+                chunkSize)));
+            if (copied <= 0)
+                break;
+            outOffset += copied;
+            remaining -= copied;
+        }
+    }
+
+    // bring the positions of QFile in sync with what was written behind its back
+    in->seek(inOffset);
+    out->seek(outOffset);
+    return remaining == 0;
+#else
+    Q_UNUSED(in)
+    Q_UNUSED(out)
+    Q_UNUSED(size)
+    return false;
+#endif
+}
+
+/*!
+    Replaces all occurrences of the search strings of \a pairs in the file \a fileName with their
+    replacements in a single pass. The file is read in chunks of one megabyte and rewritten through
+    a FileRewriter, which is only written to and committed once anything was replaced. At each
+    position the first matching pair wins, replaced text is not searched again. If \a backupFileName
+    is not null, the original file is kept and its new name is stored in \a backupFileName. Returns
+    the number of replacements.
+
+    \throws QInstaller::Error if the file cannot be read or written.
+*/
+int QInstaller::replaceInFile(const QString &fileName, const SearchReplacePairs &pairs,
+    QString *backupFileName)
+{
+    SearchReplacePairs searchReplacePairs;
+    QList<QByteArrayMatcher> matchers;
+    int maxLength = 0;
+    for (int i = 0; i < pairs.count(); ++i) {
+        if (pairs.at(i).first.isEmpty())
+            continue;
+        searchReplacePairs.append(pairs.at(i));
+        matchers.append(QByteArrayMatcher(pairs.at(i).first));
+        maxLength = qMax(maxLength, pairs.at(i).first.size());
+    }
+    if (searchReplacePairs.isEmpty())
+        return 0;
+
+    FileRewriter rewriter(fileName);
+    rewriter.open();
+    QFile *const source = rewriter.source();
+    QFile *const target = rewriter.target();
+
+    static const qint64 scChunkSize = 1024 * 1024;
+    int count = 0;
+    qint64 bufferOffset = 0;    // position of the buffer in the source
+    QByteArray buffer;
+    QVector<int> next(matchers.count());
+    forever {
+        const QByteArray chunk = source->read(scChunkSize);
+        if (chunk.isEmpty() && source->error() != QFile::NoError) {
+            throw Error(QObject::tr("Cannot read file %1: %2").arg(fileName,
+                source->errorString()));
+        }
+        buffer.append(chunk);
+        const bool atEnd = source->atEnd();
+
+        // a match has to start in front of the tail, which might be the beginning of a match
+        // continuing in the next chunk
+        const int scanEnd = atEnd ? buffer.size() : buffer.size() - maxLength + 1;
+        next.fill(-2);  // -2: not searched yet, -1: no further match in this buffer
+        int pos = 0;
+        int written = 0;
+        forever {
+            int best = -1;
+            int bestIndex = scanEnd;
+            for (int i = 0; i < matchers.count(); ++i) {
+                if (next.at(i) != -1 && next.at(i) < pos)
+                    next[i] = matchers.at(i).indexIn(buffer, pos);
+                if (next.at(i) != -1 && next.at(i) < bestIndex) {
+                    best = i;
+                    bestIndex = next.at(i);
+                }
+            }
+            if (best == -1)
+                break;
+
+            if (count == 0) {
+                // nothing was written so far, copy the part of the source in front of the buffer
+                const qint64 readPos = source->pos();
+                if (!source->seek(0)) {
+                    throw Error(QObject::tr("Cannot read file %1: %2").arg(fileName,
+                        source->errorString()));
+                }
+                for (qint64 copied = 0; copied < bufferOffset;) {
+                    const QByteArray data = source->read(qMin(scChunkSize, bufferOffset - copied));
+                    if (data.isEmpty()) {
+                        throw Error(QObject::tr("Cannot read file %1: %2").arg(fileName,
+                            source->errorString()));
+                    }
+                    blockingWrite(target, data);
+                    copied += data.size();
+                }
+                source->seek(readPos);
+            }
+            blockingWrite(target, buffer.constData() + written, bestIndex - written);
+            blockingWrite(target, searchReplacePairs.at(best).second);
+            pos = bestIndex + searchReplacePairs.at(best).first.size();
+            written = pos;
+            ++count;
+        }
+        const int consumed = qMax(pos, scanEnd);
+        if (count > 0)
+            blockingWrite(target, buffer.constData() + written, consumed - written);
+        buffer.remove(0, consumed);
+        bufferOffset += consumed;
+        if (atEnd)
+            break;
+    }
+
+    if (count == 0)
+        return 0;   // leave the file untouched
+
+    const QString backup = rewriter.commit(backupFileName != 0);
+    if (backupFileName)
+        *backupFileName = backup;
+    return count;
+}
+
+/*!
+    Returns the size of the buffer to copy \a size bytes with. It grows with the amount of data,
+    from 64 KiB for small files up to 4 MiB for files of 64 MiB and more.
+*/
+qint64 QInstaller::copyBufferSize(qint64 size)
+{
+    static const qint64 minimumSize = 64 * 1024;
+    static const qint64 maximumSize = 4 * 1024 * 1024;
+    return qBound(minimumSize, size / 16, maximumSize);
+}
+
+/*!
+    Copies the file \a source to \a target, replacing the content of an existing target. The data
+    is copied inside the kernel if possible, see kernelCopy(), otherwise through a buffer sized
+    by copyBufferSize(). The target gets the permissions of the source.
+
+    \throws QInstaller::Error if the file cannot be copied.
+*/
+void QInstaller::copyFile(const QString &source, const QString &target)
+{
+    QFile in(source);
+    openForRead(&in, source);
+    QFile out(target);
+    openForWrite(&out, target);
+
+    if (!kernelCopy(&in, &out))
+        blockingCopy(&in, &out, in.size() - in.pos());
+    if (!out.flush()) {
+        throw Error(QObject::tr("Cannot write file %1: %2").arg(target, out.errorString()));
+    }
+    if (!out.setPermissions(in.permissions())) {
+        throw Error(QObject::tr("Cannot set permissions of file %1: %2").arg(target,
+            out.errorString()));
+    }
+}
+
 void QInstaller::removeFiles(const QString &path, bool ignoreErrors)
 {
     const QFileInfoList entries = QDir(path).entryInfoList(QDir::AllEntries | QDir::Hidden);
@@ -267,23 +715,136 @@ static QString errnoToQString(int error)
 #endif
 }
 
+namespace {
+
+struct RemoveState
+{
+    RemoveState() : removed(0) {}
+
+    QMutex mutex;
+    QStringList failed;
+    QStringList directories;
+    QAtomicInt removed;
+};
+
+class RemoveJob : public QRunnable
+{
+public:
+    RemoveJob(const QStringList &paths, int begin, int end, RemoveState *state)
+        : m_paths(paths)
+        , m_begin(begin)
+        , m_end(end)
+        , m_state(state)
+    {}
+
+    void run()
+    {
+        QStringList failed;
+        QStringList directories;
+        for (int i = m_begin; i < m_end; ++i) {
+            const QString &path = m_paths.at(i);
+            const QFileInfo fi(path);
+            if (fi.isDir() && !fi.isSymLink()) {
+                directories.append(path);
+                continue;
+            }
+            if ((fi.exists() || fi.isSymLink()) && !QFile::remove(path))
+                failed.append(path);
+            m_state->removed.fetchAndAddRelaxed(1);
+        }
+
+        if (failed.isEmpty() && directories.isEmpty())
+            return;
+        QMutexLocker _(&m_state->mutex);
+        m_state->failed += failed;
+        m_state->directories += directories;
+    }
+
+private:
+    const QStringList &m_paths;
+    const int m_begin;
+    const int m_end;
+    RemoveState *const m_state;
+};
+
+bool longerPathFirst(const QString &left, const QString &right)
+{
+    return left.length() > right.length();
+}
+
+} // namespace
+
+/*!
+    Removes the files, symbolic links and directories listed in \a paths. Files are removed by a
+    bounded number of threads in parallel, directories afterwards, children before their parents.
+    Directories that do not exist or are not empty are silently kept. The \a observer is informed
+    about the progress from the calling thread, at most every 100 milliseconds. Returns the files
+    that could not be removed.
+*/
+QStringList QInstaller::removeConcurrently(const QStringList &paths, RemoveObserver *observer)
+{
+    static const int chunkSize = 256;
+
+    RemoveState state;
+    if (paths.count() <= chunkSize) {
+        RemoveJob(paths, 0, paths.count(), &state).run();
+    } else {
+        QThreadPool pool;
+        pool.setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 8));
+        for (int i = 0; i < paths.count(); i += chunkSize)
+            pool.start(new RemoveJob(paths, i, qMin(i + chunkSize, paths.count()), &state));
+        while (!pool.waitForDone(100)) {
+            if (observer)
+                observer->removeProgress(state.removed.fetchAndAddRelaxed(0), paths.count());
+        }
+    }
+
+    QDir dir;
+    std::sort(state.directories.begin(), state.directories.end(), longerPathFirst);
+    foreach (const QString &directory, state.directories) {
+        removeSystemGeneratedFiles(directory);
+        dir.rmdir(directory);
+    }
+
+    if (observer)
+        observer->removeProgress(paths.count(), paths.count());
+    return state.failed;
+}
+
 void QInstaller::removeDirectory(const QString &path, bool ignoreErrors)
 {
     if (path.isEmpty()) // QDir("") points to the working directory! We never want to remove that one.
         return;
 
     QStringList dirs;
-    QDirIterator it(path, QDir::NoDotAndDotDot | QDir::Dirs | QDir::NoSymLinks | QDir::Hidden,
+    QStringList files;
+    QDirIterator it(path, QDir::NoDotAndDotDot | QDir::AllEntries | QDir::Hidden | QDir::System,
         QDirIterator::Subdirectories);
     while (it.hasNext()) {
-        dirs.prepend(it.next());
-        removeFiles(dirs.at(0), ignoreErrors);
+        it.next();
+        const QFileInfo &fi = it.fileInfo();
+        if (fi.isDir() && !fi.isSymLink())
+            dirs.append(fi.filePath());
+        else
+            files.append(fi.filePath());
+    }
+
+    foreach (const QString &file, removeConcurrently(files)) {
+        QFile f(file);
+        if (!f.remove()) {
+            const QString errorMessage = QCoreApplication::translate("QInstaller",
+                "Could not remove file %1: %2").arg(f.fileName(), f.errorString());
+            if (!ignoreErrors)
+                throw Error(errorMessage);
+            qWarning() << errorMessage;
+        }
     }
 
+    // the iterator lists a directory before its content, so remove them in reverse order
     QDir d;
-    dirs.append(path);
-    removeFiles(path, ignoreErrors);
-    foreach (const QString &dir, dirs) {
+    dirs.prepend(path);
+    for (int i = dirs.count() - 1; i >= 0; --i) {
+        const QString &dir = dirs.at(i);
         errno = 0;
         if (d.exists(path) && !d.rmdir(dir)) {
             const QString errorMessage = QCoreApplication::translate("QInstaller",
@@ -30,9 +30,13 @@
 
 #include "installer_global.h"
 
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QPair>
 #include <QtCore/QSet>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
+#include <QtCore/QVariant>
 
 QT_BEGIN_NAMESPACE
 class QByteArray;
@@ -67,6 +71,63 @@ private:
     QSet<QString> m_paths;
 };
 
+class INSTALLER_EXPORT RemoveObserver
+{
+public:
+    virtual ~RemoveObserver() {}
+    virtual void removeProgress(int removed, int total) = 0;
+};
+
+class INSTALLER_EXPORT FileRewriter
+{
+public:
+    explicit FileRewriter(const QString &fileName);
+    ~FileRewriter();
+
+    QFile *source() { return &m_source; }
+    QFile *target() { return &m_target; }
+
+    void open(QIODevice::OpenMode mode = QIODevice::NotOpen);
+    QString commit(bool keepBackup = false);
+
+private:
+    Q_DISABLE_COPY(FileRewriter)
+    QFile m_source;
+    QFile m_target;
+};
+
+class INSTALLER_EXPORT FileManifestWriter
+{
+public:
+    void append(const QString &path);
+    void append(const QStringList &paths);
+
+    QString manifest() const { return m_manifest; }
+
+private:
+    QString m_previous;
+    QString m_manifest;
+};
+
+class INSTALLER_EXPORT FileManifestReader
+{
+public:
+    explicit FileManifestReader(const QVariant &value);
+
+    bool next(QString *path);
+    bool hasError() const { return !m_errorString.isEmpty(); }
+    QString errorString() const { return m_errorString; }
+
+private:
+    QStringList m_paths;
+    QString m_manifest;
+    int m_position;
+    QString m_current;
+    QString m_errorString;
+};
+
+typedef QList<QPair<QByteArray, QByteArray> > SearchReplacePairs;
+
     QString INSTALLER_EXPORT humanReadableSize(const qint64 &size, int precision = 2);
 
     void INSTALLER_EXPORT openForRead(QIODevice *dev, const QString &name);
@@ -77,6 +138,12 @@ private:
     void INSTALLER_EXPORT blockingCopy(QIODevice *in, QIODevice *out, qint64 size);
     qint64 INSTALLER_EXPORT blockingWrite(QIODevice *out, const char *buffer, qint64 size);
     qint64 INSTALLER_EXPORT blockingWrite(QIODevice *out, const QByteArray& ba);
+    bool INSTALLER_EXPORT kernelCopy(QFile *in, QFile *out, qint64 size = -1);
+    qint64 INSTALLER_EXPORT copyBufferSize(qint64 size);
+    void INSTALLER_EXPORT copyFile(const QString &source, const QString &target);
+
+    int INSTALLER_EXPORT replaceInFile(const QString &fileName, const SearchReplacePairs &pairs,
+        QString *backupFileName = 0);
 
     /*!
         Removes the directory at \a path recursively.
@@ -89,6 +156,11 @@ private:
     void INSTALLER_EXPORT removeFiles(const QString &path, bool ignoreErrors = false);
     void INSTALLER_EXPORT removeDirectory(const QString &path, bool ignoreErrors = false);
     void INSTALLER_EXPORT removeDirectoryThreaded(const QString &path, bool ignoreErrors = false);
+    QString INSTALLER_EXPORT fileManifest(const QStringList &paths);
+    QStringList INSTALLER_EXPORT fileManifestPaths(const QVariant &value);
+
+    QStringList INSTALLER_EXPORT removeConcurrently(const QStringList &paths,
+        RemoveObserver *observer = 0);
     void INSTALLER_EXPORT removeSystemGeneratedFiles(const QString &path);
 
     /*!
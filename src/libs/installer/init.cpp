@@ -54,6 +54,7 @@
 #include "createlinkoperation.h"
 #include "simplemovefileoperation.h"
 #include "copydirectoryoperation.h"
+#include "copytreeoperation.h"
 #include "replaceoperation.h"
 #include "linereplaceoperation.h"
 #include "minimumprogressoperation.h"
@@ -238,6 +239,7 @@ void QInstaller::init()
     factory.registerUpdateOperation<CreateLinkOperation>(QLatin1String("CreateLink"));
     factory.registerUpdateOperation<SimpleMoveFileOperation>(QLatin1String("SimpleMoveFile"));
     factory.registerUpdateOperation<CopyDirectoryOperation>(QLatin1String("CopyDirectory"));
+    factory.registerUpdateOperation<CopyTreeOperation>(QLatin1String("CopyTree"));
     factory.registerUpdateOperation<ReplaceOperation>(QLatin1String("Replace"));
     factory.registerUpdateOperation<LineReplaceOperation>(QLatin1String("LineReplace"));
     factory.registerUpdateOperation<MinimumProgressOperation>(QLatin1String("MinimumProgress"));
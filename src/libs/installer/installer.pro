@@ -55,6 +55,7 @@ HEADERS += packagemanagercore.h \
     replaceoperation.h \
     linereplaceoperation.h \
     copydirectoryoperation.h \
+    copytreeoperation.h \
     simplemovefileoperation.h \
     extractarchiveoperation.h \
     extractarchiveoperation_p.h \
@@ -110,7 +111,8 @@ HEADERS += packagemanagercore.h \
     metadatajob.h \
     metadatajob_p.h \
     proxycredentialsdialog.h \
-    serverauthenticationdialog.h
+    serverauthenticationdialog.h \
+    trace.h
 
 SOURCES += packagemanagercore.cpp \
     packagemanagercore_p.cpp \
@@ -129,6 +131,7 @@ SOURCES += packagemanagercore.cpp \
     replaceoperation.cpp \
     linereplaceoperation.cpp \
     copydirectoryoperation.cpp \
+    copytreeoperation.cpp \
     simplemovefileoperation.cpp \
     extractarchiveoperation.cpp \
     globalsettingsoperation.cpp \
@@ -176,7 +179,8 @@ SOURCES += packagemanagercore.cpp \
     observer.cpp \
     metadatajob.cpp \
     proxycredentialsdialog.cpp \
-    serverauthenticationdialog.cpp
+    serverauthenticationdialog.cpp \
+    trace.cpp
 
 FORMS += proxycredentialsdialog.ui \
     serverauthenticationdialog.ui 
@@ -29,6 +29,7 @@
 
 #include "errors.h"
 #include "fileutils.h"
+#include "trace.h"
 
 #ifndef Q_OS_WIN
 #   include "StdAfx.h"
@@ -37,20 +38,27 @@
 #include "Common/MyInitGuid.h"
 
 #include "7zip/Archive/IArchive.h"
+#include "7zip/UI/Common/EnumDirItems.h"
 #include "7zip/UI/Common/OpenArchive.h"
+#include "7zip/UI/Common/SetProperties.h"
 #include "7zip/UI/Common/Update.h"
+#include "7zip/UI/Common/UpdatePair.h"
+#include "7zip/UI/Common/UpdateProduce.h"
 
 #include "Windows/FileIO.h"
 #include "Windows/PropVariant.h"
 #include "Windows/PropVariantConversions.h"
 
+#include <QBuffer>
+#include <QCryptographicHash>
 #include <QDir>
+#include <QtEndian>
 #include <QFileInfo>
 #include <QIODevice>
 #include <QtCore/QMutexLocker>
 #include <QPointer>
 #include <QTemporaryFile>
-#include <QReadWriteLock>
+#include <QThreadStorage>
 
 #ifdef _MSC_VER
 #pragma warning(disable:4297)
@@ -91,6 +99,7 @@ bool CreateHardLinkWrapper(const QString &dest, const QString &file)
 
 #else
 #include <sys/stat.h>
+#include <sys/time.h>
 #endif
 
 #include <memory>
@@ -102,21 +111,17 @@ using namespace NWindows;
 
 
 namespace Lib7z {
-    Q_GLOBAL_STATIC(QReadWriteLock, lastErrorReadWriteLock)
-    Q_GLOBAL_STATIC(QString, getLastErrorString)
+    // archives are handled on several threads at once, keep the error of each one apart
+    Q_GLOBAL_STATIC(QThreadStorage<QString>, getLastErrorString)
 
     QString lastError()
     {
-        QReadLocker locker(lastErrorReadWriteLock());
-        Q_UNUSED(locker)
-        return *getLastErrorString();
+        return getLastErrorString()->localData();
     }
 
     void setLastError(const QString &errorString)
     {
-        QWriteLocker locker(lastErrorReadWriteLock());
-        Q_UNUSED(locker)
-        *getLastErrorString() = errorString;
+        getLastErrorString()->setLocalData(errorString);
     }
 }
 
@@ -261,6 +266,20 @@ static bool getFileTimeFromProperty(IInArchive* archive, int index, int propId,
     return true;
 }
 
+#ifndef Q_OS_WIN
+static struct timeval fileTimeToTimeval(const FILETIME &fileTime)
+{
+    // FILETIME counts 100 ns intervals since 1601-01-01
+    const quint64 intervals = (quint64(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+    const quint64 epoch = Q_UINT64_C(116444736000000000);
+    const quint64 sinceEpoch = intervals > epoch ? intervals - epoch : 0;
+    struct timeval result;
+    result.tv_sec = time_t(sinceEpoch / 10000000);
+    result.tv_usec = suseconds_t((sinceEpoch % 10000000) / 10);
+    return result;
+}
+#endif
+
 static
 QDateTime getDateTimeProperty(IInArchive* archive, int index, int propId, const QDateTime& defaultValue)
 {
@@ -324,6 +343,63 @@ static QFile::Permissions getPermissions(IInArchive* archive, int index, bool* h
     return permissions;
 }
 
+// Process-wide codec registry, loaded on first use and shared by all archive operations. It is not
+// modified after loading, so it can be used from several threads, and it is never destroyed.
+static QMutex s_codecsMutex;
+static CCodecs *s_codecs = 0;
+static QList<QByteArray> s_signatures;
+
+static CCodecs *sharedCodecs()
+{
+    QMutexLocker _(&s_codecsMutex);
+    if (!s_codecs) {
+        QScopedPointer<CCodecs> codecs(new CCodecs);
+        if (codecs->Load() != S_OK)
+            throw SevenZipException(QCoreApplication::translate("Lib7z", "Could not load codecs"));
+
+        for (int i = 0; i < codecs->Formats.Size(); ++i) {
+            const CByteBuffer &signature = codecs->Formats[i].StartSignature;
+            if (signature.GetCapacity() > 0) {
+                s_signatures.append(QByteArray(reinterpret_cast<const char *>(static_cast<const Byte *>
+                    (signature)), int(signature.GetCapacity())));
+            }
+        }
+        s_codecs = codecs.take();
+    }
+    return s_codecs;
+}
+
+// Start signatures of all registered archive formats that have one.
+static QList<QByteArray> archiveSignatures()
+{
+    sharedCodecs();
+    return s_signatures;
+}
+
+static const int LzmaHeaderSize = 13;
+
+// Checks the header of a .lzma stream, which has no start signature: the properties byte, a
+// dictionary size of 2^n or 3 * 2^n bytes and an unpacked size that is unknown or below 2^56.
+static bool isLzmaHeader(const QByteArray &header)
+{
+    if (header.size() < LzmaHeaderSize)
+        return false;
+
+    const uchar *const data = reinterpret_cast<const uchar *>(header.constData());
+    if (data[0] >= 9 * 5 * 5)
+        return false;
+
+    const quint32 dictionarySize = qFromLittleEndian<quint32>(data + 1);
+    bool dictionaryOk = dictionarySize == 1 || dictionarySize == 0xFFFFFFFF;
+    for (int i = 0; i <= 30 && !dictionaryOk; ++i)
+        dictionaryOk = dictionarySize == (quint32(2) << i) || dictionarySize == (quint32(3) << i);
+    if (!dictionaryOk)
+        return false;
+
+    const quint64 unpackedSize = qFromLittleEndian<quint64>(data + 5);
+    return unpackedSize == Q_UINT64_C(0xFFFFFFFFFFFFFFFF) || unpackedSize < (Q_UINT64_C(1) << 56);
+}
+
 namespace Lib7z {
 class QIODeviceSequentialOutStream : public ISequentialOutStream, public CMyUnknownImp
 {
@@ -456,9 +532,155 @@ public:
         return ok ? S_OK : E_FAIL;
     }
 
+protected:
+    QIODevice *device() const { return m_device; }
+
 private:
     QPointer<QIODevice> m_device;
 };
+
+// Input stream hashing the archive while 7z reads it. Only reads continuing the already hashed
+// prefix are added, which covers the sequentially read packed streams. The rest, usually just the
+// headers at the end of the archive, is read once more in result().
+class QIODeviceHashingInStream : public QIODeviceInStream
+{
+public:
+    explicit QIODeviceHashingInStream(QIODevice* device)
+        : QIODeviceInStream(device)
+        , m_hash(QCryptographicHash::Sha1)
+        , m_hashed(0)
+    {}
+
+    /* reimp */ STDMETHOD(Read)(void* data, UInt32 size, UInt32* processedSize)
+    {
+        const qint64 pos = device()->pos();
+        UInt32 processed = 0;
+        const HRESULT result = QIODeviceInStream::Read(data, size, &processed);
+        if (result == S_OK && pos <= m_hashed && pos + processed > m_hashed) {
+            const qint64 known = m_hashed - pos;
+            m_hash.addData(static_cast<const char*>(data) + known, int(processed - known));
+            m_hashed = pos + processed;
+        }
+        if (processedSize)
+            *processedSize = processed;
+        return result;
+    }
+
+    QByteArray result()
+    {
+        QIODevice *const dev = device();
+        if (!dev->seek(m_hashed))
+            return QByteArray();
+
+        QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+        qint64 read = 0;
+        while ((read = dev->read(buffer.data(), buffer.size())) > 0) {
+            m_hash.addData(buffer.constData(), int(read));
+            m_hashed += read;
+        }
+        return read < 0 ? QByteArray() : m_hash.result();
+    }
+
+private:
+    QCryptographicHash m_hash;
+    qint64 m_hashed;
+};
+
+// Seekable output stream writing the archive straight into a QIODevice, starting at the device's
+// current position. Writes are collected in a large buffer to keep the number of device writes low.
+class QIODeviceOutStream : public IOutStream, public CMyUnknownImp
+{
+public:
+    MY_UNKNOWN_IMP1(IOutStream)
+
+    explicit QIODeviceOutStream(QIODevice* device)
+        : IOutStream()
+        , CMyUnknownImp()
+        , m_device(device)
+        , m_offset(device->pos())
+    {
+        assert(m_device);
+        assert(!m_device->isSequential());
+        m_buffer.reserve(BufferSize);
+    }
+
+    /* reimp */ STDMETHOD(Write)(const void* data, UInt32 size, UInt32* processedSize)
+    {
+        if (processedSize)
+            *processedSize = 0;
+        if (!m_device)
+            return E_FAIL;
+
+        m_buffer.append(reinterpret_cast<const char*>(data), size);
+        if (m_buffer.size() >= BufferSize)
+            RINOK(flush());
+
+        if (processedSize)
+            *processedSize = size;
+        return S_OK;
+    }
+
+    /* reimp */ STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64* newPosition)
+    {
+        RINOK(flush());
+
+        qint64 np = 0;
+        switch (seekOrigin) {
+        case STREAM_SEEK_SET:
+            np = offset;
+            break;
+        case STREAM_SEEK_CUR:
+            np = m_device->pos() - m_offset + offset;
+            break;
+        case STREAM_SEEK_END:
+            np = m_device->size() - m_offset + offset;
+            break;
+        default:
+            return STG_E_INVALIDFUNCTION;
+        }
+
+        if (np < 0)
+            return STG_E_INVALIDFUNCTION;
+        if (!m_device->seek(m_offset + np))
+            return E_FAIL;
+        if (newPosition)
+            *newPosition = np;
+        return S_OK;
+    }
+
+    /* reimp */ STDMETHOD(SetSize)(UInt64 newSize)
+    {
+        RINOK(flush());
+        if (QFile *file = qobject_cast<QFile*>(m_device))
+            return file->resize(m_offset + newSize) ? S_OK : E_FAIL;
+        return m_device->size() == qint64(m_offset + newSize) ? S_OK : E_NOTIMPL;
+    }
+
+    HRESULT flush()
+    {
+        if (m_buffer.isEmpty())
+            return S_OK;
+        if (!m_device)
+            return E_FAIL;
+
+        try {
+            QInstaller::blockingWrite(m_device, m_buffer);
+        } catch (const QInstaller::Error &error) {
+            Lib7z::setLastError(error.message());
+            return E_FAIL;
+        }
+        m_buffer.resize(0);
+        return S_OK;
+    }
+
+private:
+    enum { BufferSize = 1024 * 1024 };
+
+    QPointer<QIODevice> m_device;
+    const qint64 m_offset;
+    QByteArray m_buffer;
+};
+
 }
 
 File::File()
@@ -627,18 +849,14 @@ class OpenArchiveInfo
 {
 private:
     OpenArchiveInfo(QIODevice* device)
-        : codecs(new CCodecs)
     {
-        if (codecs->Load() != S_OK) {
-            throw SevenZipException(QCoreApplication::translate("OpenArchiveInfo",
-                "Could not load codecs"));
-        }
+        CCodecs *const codecs = sharedCodecs();
         if (!codecs->FindFormatForArchiveType(L"", formatIndices)) {
             throw SevenZipException(QCoreApplication::translate("OpenArchiveInfo",
                 "Could not retrieve default format"));
         }
         stream = new QIODeviceInStream(device);
-        if (archiveLink.Open2(codecs.data(), formatIndices, false, stream, UString(), 0) != S_OK) {
+        if (archiveLink.Open2(codecs, formatIndices, false, stream, UString(), 0) != S_OK) {
             throw SevenZipException(QCoreApplication::translate("OpenArchiveInfo",
                 "Could not open archive"));
         }
@@ -677,7 +895,6 @@ public:
 private:
     CIntVector formatIndices;
     CMyComPtr<IInStream> stream;
-    QScopedPointer<CCodecs> codecs;
     OpenArchiveInfoCleaner *m_cleaner;
 
     static QMutex m_mutex;
@@ -770,6 +987,9 @@ public:
         , total(0)
         , completed(0)
         , device(0)
+        , currentFile(0)
+        , currentSymlink(0)
+        , currentAttributes(0)
     {
     }
 
@@ -803,6 +1023,7 @@ public:
             assert(arc);
 
             currentIndex = index;
+            releaseCurrentItem();
 
             UString s;
             if (arc->GetItemPath(index, s) != S_OK) {
@@ -830,6 +1051,8 @@ public:
                 return E_FAIL;
 
             q->setCurrentFile(fi.absoluteFilePath());
+            currentFilePath = fi.absoluteFilePath();
+            currentAttributes = getUInt32Property(arc->Archive, index, kpidAttrib, 0);
 
             if (!isDir) {
 #ifndef Q_OS_WIN
@@ -840,17 +1063,29 @@ public:
                     return E_FAIL;
                 }
 #endif
-                QIODeviceSequentialOutStream *qOutStream = new QIODeviceSequentialOutStream(
-                    new QFile(fi.absoluteFilePath()), QIODeviceSequentialOutStream::CloseAndDeleteDevice);
+                // The content of a symlink item is the link target, collect it in memory and create
+                // the link once the item is complete. Everything else is written to the target file,
+                // which is kept open until SetOperationResult() so it can be finalized in place.
+                QIODevice *target = 0;
+                if (S_ISLNK(currentAttributes >> 16))
+                    target = currentSymlink = new QBuffer;
+                else
+                    target = currentFile = new QFile(fi.absoluteFilePath());
+
+                QIODeviceSequentialOutStream *qOutStream = new QIODeviceSequentialOutStream(target,
+                    QIODeviceSequentialOutStream::CloseAndDeleteDevice);
                 if (!qOutStream->errorString().isEmpty()) {
                     Lib7z::setLastError(QCoreApplication::translate("ExtractCallbackImpl",
                         "Could not open file: %1 (%2)").arg(fi.absoluteFilePath(),
                         qOutStream->errorString()));
+                    currentFile = 0;
+                    currentSymlink = 0;
+                    delete qOutStream;
                     return E_FAIL;
                 }
                 CMyComPtr<ISequentialOutStream> stream = qOutStream;
-                *outStream = stream;
-                stream.Detach();
+                currentStream = stream;
+                *outStream = stream.Detach();
             }
 
             guard.release();
@@ -867,92 +1102,38 @@ public:
 
     /* reimp */ STDMETHOD(SetOperationResult)(Int32 resultEOperationResult)
     {
-        Q_UNUSED(resultEOperationResult)
-
-        if (!targetDir.isEmpty()) {
-            bool hasPerm = false;
-            const QFile::Permissions permissions = getPermissions(arc->Archive, currentIndex, &hasPerm);
-
-            UString s;
-            if (arc->GetItemPath(currentIndex, s) != S_OK) {
-                Lib7z::setLastError(QCoreApplication::translate("ExtractCallbackImpl",
-                    "Could not retrieve path of archive item %1").arg(currentIndex));
-                return E_FAIL;
-            }
-            const QString path = UString2QString(s).replace(QLatin1Char('\\'), QLatin1Char('/'));
-            const QString absFilePath = QFileInfo(QString::fromLatin1("%1/%2").arg(targetDir, path))
-                .absoluteFilePath();
-
-            // do we have a symlink?
-            const quint32 attributes = getUInt32Property(arc->Archive, currentIndex, kpidAttrib, 0);
-            struct stat stat_info;
-            stat_info.st_mode = attributes >> 16;
-            if (S_ISLNK(stat_info.st_mode)) {
-#ifdef Q_OS_WIN
-                qFatal(QString::fromLatin1("Creating a link from archive is not implemented for windows. "
-                    "Link filename: %1").arg(absFilePath).toLatin1());
-                // TODO
-//                if (!CreateHardLinkWrapper(absFilePath, QLatin1String(symlinkTarget))) {
-//                    return S_FALSE;
-//                }
-#else
-                QFileInfo symlinkPlaceHolderFileInfo(absFilePath);
-                if (symlinkPlaceHolderFileInfo.isSymLink()) {
+        // the decoder verifies the CRC of every item while it is written, just report failures
+        if (resultEOperationResult != NArchive::NExtract::NOperationResult::kOK) {
+            const QString item = currentFilePath;
+            releaseCurrentItem();
+            switch (resultEOperationResult) {
+                case NArchive::NExtract::NOperationResult::kCRCError:
                     Lib7z::setLastError(QCoreApplication::translate("ExtractCallbackImpl",
-                        "Could not create symlink at '%1'. Another one is already existing.")
-                        .arg(absFilePath));
-                    return E_FAIL;
-                }
-                QFile symlinkPlaceHolderFile(absFilePath);
-                if (!symlinkPlaceHolderFile.open(QIODevice::ReadOnly)) {
+                        "CRC error in %1").arg(item));
+                    break;
+                case NArchive::NExtract::NOperationResult::kUnSupportedMethod:
                     Lib7z::setLastError(QCoreApplication::translate("ExtractCallbackImpl",
-                        "Could not read symlink target from file '%1'.").arg(absFilePath));
-                    return E_FAIL;
-                }
-
-                const QByteArray symlinkTarget = symlinkPlaceHolderFile.readAll();
-                symlinkPlaceHolderFile.close();
-                symlinkPlaceHolderFile.remove();
-                QFile targetFile(QString::fromLatin1(symlinkTarget));
-                if (!targetFile.link(absFilePath)) {
+                        "Unsupported compression method in %1").arg(item));
+                    break;
+                default:
                     Lib7z::setLastError(QCoreApplication::translate("ExtractCallbackImpl",
-                        "Could not create symlink at %1. %2").arg(absFilePath,
-                        targetFile.errorString()));
-                    return E_FAIL;
-                }
-                return S_OK;
-#endif
+                        "Data error in %1").arg(item));
+                    break;
             }
+            return E_FAIL;
+        }
 
-            try {
-                if (!absFilePath.isEmpty()) {
-                    // This might fail for archives without all properties, we can only be sure about
-                    // modification time, as it's always stored by default in 7z archives. Also note that
-                    // we restore modification time on Unix only, as access time and change time are
-                    // supposed to be set to the time of installation.
-                    FILETIME mTime;
-                    if (getFileTimeFromProperty(arc->Archive, currentIndex, kpidMTime, &mTime)) {
-                        NWindows::NFile::NIO::COutFile file;
-                        if (file.Open(QString2UString(absFilePath), 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL))
-                            file.SetTime(&mTime, &mTime, &mTime);
-                    }
-#ifdef Q_OS_WIN
-                    FILETIME cTime, aTime;
-                    bool success = getFileTimeFromProperty(arc->Archive, currentIndex, kpidCTime, &cTime);
-                    if (success && getFileTimeFromProperty(arc->Archive, currentIndex, kpidATime, &aTime)) {
-                        NWindows::NFile::NIO::COutFile file;
-                        if (file.Open(QString2UString(absFilePath), 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL))
-                            file.SetTime(&cTime, &aTime, &mTime);
-                    }
-#endif
-                }
-            } catch (...) {}
+        if (targetDir.isEmpty() || currentFilePath.isEmpty())
+            return S_OK;
 
-            if (hasPerm)
-                QFile::setPermissions(absFilePath, permissions);
-        }
+        HRESULT result = S_OK;
+        if (currentSymlink)
+            result = createSymlink();
+        else if (!finalizeOpenFile())
+            finalizeByPath();
 
-        return S_OK;
+        releaseCurrentItem();
+        return result;
     }
 
     /* reimp */ STDMETHOD(SetTotal)(UInt64 t)
@@ -975,6 +1156,103 @@ public:
     }
 
 private:
+    void releaseCurrentItem()
+    {
+        // closes and deletes the current file or buffer
+        currentStream.Release();
+        currentFile = 0;
+        currentSymlink = 0;
+        currentFilePath.clear();
+    }
+
+    HRESULT createSymlink()
+    {
+#ifdef Q_OS_WIN
+        qFatal(QString::fromLatin1("Creating a link from archive is not implemented for windows. "
+            "Link filename: %1").arg(currentFilePath).toLatin1());
+        // TODO
+//        if (!CreateHardLinkWrapper(currentFilePath, QLatin1String(symlinkTarget))) {
+//            return S_FALSE;
+//        }
+        return S_OK;
+#else
+        // an already existing file at that place is replaced, just like regular files are
+        if (QFile::exists(currentFilePath))
+            QFile::remove(currentFilePath);
+
+        QFile targetFile(QString::fromLatin1(currentSymlink->data()));
+        if (!targetFile.link(currentFilePath)) {
+            Lib7z::setLastError(QCoreApplication::translate("ExtractCallbackImpl",
+                "Could not create symlink at %1. %2").arg(currentFilePath,
+                targetFile.errorString()));
+            return E_FAIL;
+        }
+        return S_OK;
+#endif
+    }
+
+    // Applies modification time and permissions to the still open file descriptor, returns
+    // false if the item has to be finalized by path instead.
+    bool finalizeOpenFile()
+    {
+#ifdef Q_OS_WIN
+        return false;
+#else
+        if (!currentFile || !currentFile->isOpen() || !currentFile->flush())
+            return false;
+
+        const int fd = currentFile->handle();
+        try {
+            // same times as set by finalizeByPath(), see there
+            FILETIME mTime;
+            if (getFileTimeFromProperty(arc->Archive, currentIndex, kpidMTime, &mTime)) {
+                struct timeval times[2];
+                times[0] = times[1] = fileTimeToTimeval(mTime);
+                futimes(fd, times);
+            }
+        } catch (...) {}
+
+        if (currentAttributes & FILE_ATTRIBUTE_UNIX_EXTENSION)
+            fchmod(fd, (currentAttributes >> 16) & 0777);
+        return true;
+#endif
+    }
+
+    void finalizeByPath()
+    {
+        const QString absFilePath = currentFilePath;
+        bool hasPerm = false;
+        const QFile::Permissions permissions = getPermissions(arc->Archive, currentIndex, &hasPerm);
+
+        // the file needs to be closed before it can be opened again
+        releaseCurrentItem();
+
+        try {
+            // This might fail for archives without all properties, we can only be sure about
+            // modification time, as it's always stored by default in 7z archives. Also note that
+            // we restore modification time on Unix only, as access time and change time are
+            // supposed to be set to the time of installation.
+            FILETIME mTime;
+            if (getFileTimeFromProperty(arc->Archive, currentIndex, kpidMTime, &mTime)) {
+                NWindows::NFile::NIO::COutFile file;
+                if (file.Open(QString2UString(absFilePath), 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL))
+                    file.SetTime(&mTime, &mTime, &mTime);
+            }
+#ifdef Q_OS_WIN
+            FILETIME cTime, aTime;
+            bool success = getFileTimeFromProperty(arc->Archive, currentIndex, kpidCTime, &cTime);
+            if (success && getFileTimeFromProperty(arc->Archive, currentIndex, kpidATime, &aTime)) {
+                NWindows::NFile::NIO::COutFile file;
+                if (file.Open(QString2UString(absFilePath), 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL))
+                    file.SetTime(&cTime, &aTime, &mTime);
+            }
+#endif
+        } catch (...) {}
+
+        if (hasPerm)
+            QFile::setPermissions(absFilePath, permissions);
+    }
+
     ExtractCallback* const q;
     UInt32 currentIndex;
     const CArc* arc;
@@ -982,6 +1260,13 @@ private:
     UInt64 completed;
     QPointer<QIODevice> device;
     QString targetDir;
+
+    // the item currently extracted to targetDir, see GetStream()
+    CMyComPtr<ISequentialOutStream> currentStream;
+    QFile *currentFile;
+    QBuffer *currentSymlink;
+    QString currentFilePath;
+    quint32 currentAttributes;
 };
 
 
@@ -994,6 +1279,7 @@ public:
     }
 
     CMyComPtr<ExtractCallbackImpl> impl;
+    QByteArray expectedSha1;
 };
 
 ExtractCallback::ExtractCallback()
@@ -1026,6 +1312,20 @@ void ExtractCallback::setTarget(const QString &dir)
     d->impl->setTarget(dir);
 }
 
+/*!
+    Sets the hex encoded SHA1 checksum \a sha1 the whole archive is expected to have. If set,
+    extractArchive() hashes the archive while reading it and throws if the checksum does not match.
+*/
+void ExtractCallback::setExpectedSha1(const QByteArray &sha1)
+{
+    d->expectedSha1 = sha1.trimmed().toLower();
+}
+
+QByteArray ExtractCallback::expectedSha1() const
+{
+    return d->expectedSha1;
+}
+
 HRESULT ExtractCallback::setCompleted(quint64, quint64)
 {
     return S_OK;
@@ -1312,6 +1612,82 @@ namespace{
         }
         return errorMessage;
     }
+
+    struct EnumDirItemCallback : public IEnumDirItemCallback
+    {
+        HRESULT ScanProgress(UInt64, UInt64, const wchar_t*)
+        {
+            return S_OK;
+        }
+    };
+
+    // Does what UpdateArchive() does for a new archive, but writes to the seekable device directly
+    // instead of creating a file at the archive path.
+    HRESULT writeArchive(CCodecs *codecs, int formatIndex, const NWildcard::CCensor &censor,
+        const CObjectVector<CProperty> &properties, QIODevice *archive, IUpdateCallbackUI2 *callback)
+    {
+        CDirItems dirItems;
+        {
+            EnumDirItemCallback enumCallback;
+            RINOK(callback->StartScanning());
+            UStringVector errorPaths;
+            CRecordVector<DWORD> errorCodes;
+            const HRESULT res = EnumerateItems(censor, dirItems, &enumCallback, errorPaths,
+                errorCodes);
+            for (int i = 0; i < errorPaths.Size(); ++i)
+                RINOK(callback->CanNotFindError(errorPaths[i], errorCodes[i]));
+            RINOK(res);
+            RINOK(callback->FinishScanning());
+        }
+
+        CMyComPtr<IOutArchive> outArchive;
+        RINOK(codecs->CreateOutArchive(formatIndex, outArchive));
+        if (!outArchive)
+            return E_NOTIMPL;
+#ifdef EXTERNAL_CODECS
+        {
+            CMyComPtr<ISetCompressCodecsInfo> setCompressCodecsInfo;
+            outArchive.QueryInterface(IID_ISetCompressCodecsInfo, (void **)&setCompressCodecsInfo);
+            if (setCompressCodecsInfo)
+                RINOK(setCompressCodecsInfo->SetCompressCodecsInfo(codecs));
+        }
+#endif
+
+        UInt32 fileTimeType;
+        RINOK(outArchive->GetFileTimeType(&fileTimeType));
+
+        const CObjectVector<CArcItem> arcItems;
+        CRecordVector<CUpdatePair2> updatePairs2;
+        {
+            CRecordVector<CUpdatePair> updatePairs;
+            GetUpdatePairInfoList(dirItems, arcItems, NFileTimeType::EEnum(fileTimeType),
+                updatePairs);
+            UpdateProduce(updatePairs, NUpdateArchive::kAddActionSet, updatePairs2, 0);
+        }
+
+        UInt32 numFiles = 0;
+        for (int i = 0; i < updatePairs2.Size(); ++i) {
+            if (updatePairs2[i].NewData)
+                ++numFiles;
+        }
+        RINOK(callback->SetNumFiles(numFiles));
+
+        CArchiveUpdateCallback *updateCallbackSpec = new CArchiveUpdateCallback;
+        CMyComPtr<IArchiveUpdateCallback> updateCallback(updateCallbackSpec);
+        updateCallbackSpec->Callback = callback;
+        updateCallbackSpec->DirItems = &dirItems;
+        updateCallbackSpec->ArcItems = &arcItems;
+        updateCallbackSpec->UpdatePairs = &updatePairs2;
+
+        RINOK(SetProperties(outArchive, properties));
+
+        QIODeviceOutStream *outStreamSpec = new QIODeviceOutStream(archive);
+        CMyComPtr<IOutStream> outStream(outStreamSpec);
+        const HRESULT res = outArchive->UpdateItems(outStream, updatePairs2.Size(), updateCallback);
+        callback->Finilize();
+        RINOK(res);
+        return outStreamSpec->flush();
+    }
 }
 
 void Lib7z::createArchive(QIODevice* archive, const QStringList &sourcePaths, UpdateCallback* callback)
@@ -1325,21 +1701,14 @@ void Lib7z::createArchive(QIODevice* archive, const QStringList &sourcePaths, Up
     try {
         callback->setTarget(archive);
 
-        QScopedPointer<CCodecs> codecs(new CCodecs);
-        if (codecs->Load() != S_OK)
-            throw SevenZipException(QCoreApplication::translate("Lib7z", "Could not load codecs"));
-
+        CCodecs *const codecs = sharedCodecs();
         CIntVector formatIndices;
 
-        if (!codecs.data()->FindFormatForArchiveType(L"", formatIndices)) {
+        if (!codecs->FindFormatForArchiveType(L"", formatIndices)) {
             throw SevenZipException(QCoreApplication::translate("Lib7z",
                 "Could not retrieve default format"));
         }
 
-        // yes this is crap, but there seems to be no streaming solution to this...
-
-        const QString tempFile = generateTempFileName();
-
         NWildcard::CCensor censor;
         foreach (const QString &path, sourcePaths) {
             const QString cleanPath = QDir::toNativeSeparators(QDir::cleanPath(path));
@@ -1352,32 +1721,49 @@ void Lib7z::createArchive(QIODevice* archive, const QStringList &sourcePaths, Up
         }
         callback->setSourcePaths(sourcePaths);
 
-        CArchivePath archivePath;
-        archivePath.ParseFromPath(QString2UString(tempFile));
-
-        CUpdateArchiveCommand command;
-        command.ArchivePath = archivePath;
-        command.ActionSet = NUpdateArchive::kAddActionSet;
-
-        CUpdateOptions options;
-        options.Commands.Add(command);
-        options.ArchivePath = archivePath;
-        options.MethodMode.FormatIndex = codecs->FindFormatForArchiveType(L"7z");
+        const int formatIndex = codecs->FindFormatForArchiveType(L"7z");
+        CObjectVector<CProperty> properties;
 
         // preserve creation time
         CProperty tc;
         tc.Name = UString(L"TC");
         tc.Value = UString(L"ON");
-        options.MethodMode.Properties.Add(tc);
+        properties.Add(tc);
 
         // preserve access time
         CProperty ta;
         ta.Name = UString(L"TA");
         ta.Value = UString(L"ON");
-        options.MethodMode.Properties.Add(ta);
+        properties.Add(ta);
+
+        if (!archive->isSequential()) {
+            const HRESULT res = writeArchive(codecs, formatIndex, censor, properties, archive,
+                callback->impl());
+            if (res != S_OK) {
+                throw SevenZipException(QCoreApplication::translate("Lib7z",
+                    "Could not create archive. %1").arg(errorMessageFrom7zResult(res)));
+            }
+            return;
+        }
+
+        // 7z archives are written with seeks, sequential devices need a temporary file
+        const QString tempFile = generateTempFileName();
+
+        CArchivePath archivePath;
+        archivePath.ParseFromPath(QString2UString(tempFile));
+
+        CUpdateArchiveCommand command;
+        command.ArchivePath = archivePath;
+        command.ActionSet = NUpdateArchive::kAddActionSet;
+
+        CUpdateOptions options;
+        options.Commands.Add(command);
+        options.ArchivePath = archivePath;
+        options.MethodMode.FormatIndex = formatIndex;
+        options.MethodMode.Properties = properties;
 
         CUpdateErrorInfo errorInfo;
-        const HRESULT res = UpdateArchive(codecs.data(), censor, options, errorInfo, 0, callback->impl());
+        const HRESULT res = UpdateArchive(codecs, censor, options, errorInfo, 0, callback->impl());
         if (res != S_OK || !QFile::exists(tempFile)) {
             throw SevenZipException(QCoreApplication::translate("Lib7z",
                 "Could not create archive %1. %2").arg(tempFile, errorMessageFrom7zResult(res)));
@@ -1486,9 +1872,24 @@ void Lib7z::extractFileFromArchive(QIODevice* archive, const File& item, const Q
     outDir.release();
 }
 
+static void extractArcs(const CArchiveLink &archiveLink, ExtractCallback* callback)
+{
+    for (int a = 0; a < archiveLink.Arcs.Size(); ++a)
+    {
+        const CArc& arc = archiveLink.Arcs[a];
+        IInArchive* const arch = arc.Archive;
+        callback->impl()->setArchive(&arc);
+        const LONG extractResult = arch->Extract(0, static_cast< UInt32 >(-1), false, callback->impl());
+
+        if (extractResult != S_OK)
+            throw SevenZipException(errorMessageFrom7zResult(extractResult));
+    }
+}
+
 void Lib7z::extractArchive(QIODevice* archive, const QString &targetDirectory, ExtractCallback* callback)
 {
     assert(archive);
+    TraceSpan span("lib7z", "extractArchive", targetDirectory);
 
     QScopedPointer<ExtractCallback> dummyCallback(callback ? 0 : new ExtractCallback);
     if (!callback)
@@ -1500,19 +1901,35 @@ void Lib7z::extractArchive(QIODevice* archive, const QString &targetDirectory, E
     DirectoryGuard outDir(fi.absolutePath());
     outDir.tryCreate();
 
-    const OpenArchiveInfo* const openArchive = OpenArchiveInfo::value(archive);
-
-    for (int a = 0; a < openArchive->archiveLink.Arcs.Size(); ++a)
-    {
-        const CArc& arc = openArchive->archiveLink.Arcs[a];
-        IInArchive* const arch = arc.Archive;
-        callback->impl()->setArchive(&arc);
-        const LONG extractResult = arch->Extract(0, static_cast< UInt32 >(-1), false, callback->impl());
+    const QByteArray expectedSha1 = callback->expectedSha1();
+    if (expectedSha1.isEmpty()) {
+        const OpenArchiveInfo* const openArchive = OpenArchiveInfo::value(archive);
+        extractArcs(openArchive->archiveLink, callback);
+        outDir.release();
+        return;
+    }
 
-        if (extractResult != S_OK)
-            throw SevenZipException(errorMessageFrom7zResult(extractResult));
+    // open the archive on a hashing stream, so verifying it does not need another pass over it
+    CIntVector formatIndices;
+    CCodecs *const codecs = sharedCodecs();
+    if (!codecs->FindFormatForArchiveType(L"", formatIndices)) {
+        throw SevenZipException(QCoreApplication::translate("Lib7z",
+            "Could not retrieve default format"));
     }
+    QIODeviceHashingInStream *const hashingStream = new QIODeviceHashingInStream(archive);
+    CMyComPtr<IInStream> stream = hashingStream;
+    CArchiveLink archiveLink;
+    if (archiveLink.Open2(codecs, formatIndices, false, stream, UString(), 0) != S_OK)
+        throw SevenZipException(QCoreApplication::translate("Lib7z", "Could not open archive"));
 
+    extractArcs(archiveLink, callback);
+
+    const QByteArray sha1 = hashingStream->result().toHex();
+    if (sha1 != expectedSha1) {
+        throw SevenZipException(QCoreApplication::translate("Lib7z", "Checksum mismatch: "
+            "expected %1, calculated %2.").arg(QString::fromLatin1(expectedSha1),
+            QString::fromLatin1(sha1)));
+    }
     outDir.release();
 }
 
@@ -1531,25 +1948,24 @@ bool Lib7z::isSupportedArchive(QIODevice* archive)
     assert(!archive->isSequential());
     const qint64 initialPos = archive->pos();
     try {
-        QScopedPointer<CCodecs> codecs(new CCodecs);
-        if (codecs->Load() != S_OK)
-            throw SevenZipException(QCoreApplication::translate("Lib7z", "Could not load codecs"));
-
-        CIntVector formatIndices;
+        // Compare the start of the device with the signatures of the known formats, opening the
+        // archive is left to the operations that actually need its content.
+        const QList<QByteArray> signatures = archiveSignatures();
+        int length = LzmaHeaderSize;
+        foreach (const QByteArray &signature, signatures)
+            length = qMax(length, signature.size());
+
+        QByteArray start;
+        if (archive->seek(0))
+            start = archive->read(length);
+        archive->seek(initialPos);
 
-        if (!codecs->FindFormatForArchiveType(L"", formatIndices)) {
-            throw SevenZipException(QCoreApplication::translate("Lib7z",
-                "Could not retrieve default format"));
+        foreach (const QByteArray &signature, signatures) {
+            if (start.startsWith(signature))
+                return true;
         }
-        CArchiveLink archiveLink;
-        //CMyComPtr is needed, otherwise it crashes in OpenStream()
-        const CMyComPtr<IInStream> stream = new QIODeviceInStream(archive);
-
-        const HRESULT result = archiveLink.Open2(codecs.data(), formatIndices, /*stdInMode*/false, stream,
-            UString(), 0);
-
-        archive->seek(initialPos);
-        return result == S_OK;
+        // split archives have no signature either, but their parts are never installed as such
+        return isLzmaHeader(start);
     } catch (const SevenZipException& e) {
         archive->seek(initialPos);
         throw e;
@@ -92,6 +92,9 @@ namespace Lib7z {
         void setTarget( QIODevice* archive );
         void setTarget( const QString& dir );
 
+        void setExpectedSha1(const QByteArray &sha1);
+        QByteArray expectedSha1() const;
+
     protected:
         /**
          * Reimplement to prepare for file @p filename to be extracted, e.g. by renaming existing files.
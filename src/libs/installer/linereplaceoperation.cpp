@@ -28,6 +28,9 @@
 
 #include "linereplaceoperation.h"
 
+#include "errors.h"
+#include "fileutils.h"
+
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QTextStream>
@@ -39,6 +42,11 @@ LineReplaceOperation::LineReplaceOperation()
     setName(QLatin1String("LineReplace"));
 }
 
+LineReplaceOperation::~LineReplaceOperation()
+{
+    deleteFileNowOrLater(value(QLatin1String("backupOfFile")).toString());
+}
+
 void LineReplaceOperation::backup()
 {
 }
@@ -51,49 +59,70 @@ bool LineReplaceOperation::performOperation()
     // 1. filename
     // 2. startsWith Search-String
     // 3. Replace-Line-String
-    if (args.count() != 3) {
+    // 4. more pairs of startsWith Search-String and Replace-Line-String possible ...
+    if (args.count() < 3 || args.count() % 2 == 0) {
         setError(InvalidArguments);
         setErrorString(tr("Invalid arguments in %0: %1 arguments given, %2 expected%3.")
-            .arg(name()).arg(arguments().count()).arg(tr("exactly 3"), QLatin1String("")));
+            .arg(name()).arg(arguments().count()).arg(tr("at least 3"), QLatin1String(" (<file>, "
+            "<search>, <replace>, [<search>, <replace>], ...)")));
         return false;
     }
     const QString fileName = args.at(0);
-    const QString searchString = args.at(1);
-    const QString replaceString = args.at(2);
 
-    QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        setError(UserDefinedError);
-        setErrorString(tr("Failed to open '%1' for reading.").arg(fileName));
-        return false;
-    }
+    try {
+        FileRewriter rewriter(fileName);
+        rewriter.open(QIODevice::Text);
 
-    QString replacement;
-    QTextStream stream(&file);
-    while (!stream.atEnd()) {
-        const QString line = stream.readLine();
-        if (line.trimmed().startsWith(searchString))
-            replacement.append(replaceString + QLatin1String("\n"));
-        else
-            replacement.append(line + QLatin1String("\n"));
-    }
-    file.close();
+        int replaced = 0;
+        QTextStream in(rewriter.source());
+        QTextStream out(rewriter.target());
+        while (!in.atEnd()) {
+            const QString line = in.readLine();
+            const QString trimmed = line.trimmed();
+            int i = 1;
+            while (i + 1 < args.count() && !trimmed.startsWith(args.at(i)))
+                i += 2;
+            if (i + 1 < args.count()) {
+                out << args.at(i + 1) << QLatin1Char('\n');
+                ++replaced;
+            } else {
+                out << line << QLatin1Char('\n');
+            }
+        }
+        out.flush();
 
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        if (replaced > 0)
+            setValue(QLatin1String("backupOfFile"), rewriter.commit(true));
+    } catch (const QInstaller::Error &e) {
         setError(UserDefinedError);
-        setErrorString(tr("Failed to open '%1' for writing.").arg(fileName));
+        setErrorString(e.message());
         return false;
     }
-
-    stream.setDevice(&file);
-    stream << replacement;
-    file.close();
-
     return true;
 }
 
 bool LineReplaceOperation::undoOperation()
 {
+    // nothing was replaced, or the backup is gone because the installation already finished
+    if (!hasValue(QLatin1String("backupOfFile")))
+        return true;
+
+    const QString fileName = arguments().first();
+    QFile file(fileName);
+    if (file.exists() && !file.remove()) {
+        setError(UserDefinedError);
+        setErrorString(tr("Could not delete file %1: %2").arg(fileName, file.errorString()));
+        return false;
+    }
+
+    QFile backupFile(value(QLatin1String("backupOfFile")).toString());
+    if (!backupFile.rename(fileName)) {
+        setError(UserDefinedError);
+        setErrorString(tr("Could not restore backup file into %1: %2").arg(fileName,
+            backupFile.errorString()));
+        return false;
+    }
+    clearValue(QLatin1String("backupOfFile"));
     return true;
 }
 
@@ -106,3 +135,21 @@ Operation *LineReplaceOperation::clone() const
 {
     return new LineReplaceOperation();
 }
+
+/*!
+    \reimp
+*/
+QDomDocument LineReplaceOperation::toXml() const
+{
+    // we don't want to save the backupOfFile
+    if (!hasValue(QLatin1String("backupOfFile")))
+        return UpdateOperation::toXml();
+
+    LineReplaceOperation *const me = const_cast<LineReplaceOperation *>(this);
+
+    const QVariant v = value(QLatin1String("backupOfFile"));
+    me->clearValue(QLatin1String("backupOfFile"));
+    const QDomDocument xml = UpdateOperation::toXml();
+    me->setValue(QLatin1String("backupOfFile"), v);
+    return xml;
+}
@@ -37,12 +37,15 @@ class INSTALLER_EXPORT LineReplaceOperation : public Operation
 {
 public:
     LineReplaceOperation();
+    ~LineReplaceOperation();
 
     void backup();
     bool performOperation();
     bool undoOperation();
     bool testOperation();
     Operation *clone() const;
+
+    QDomDocument toXml() const;
 };
 
 } // namespace
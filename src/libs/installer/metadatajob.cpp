@@ -36,8 +36,18 @@
 #include "serverauthenticationdialog.h"
 #include "settings.h"
 
+#include <QCryptographicHash>
+#include <QSettings>
+#if QT_VERSION < 0x050000
+#include <QDesktopServices>
+#else
+#include <QStandardPaths>
+#endif
+
 namespace QInstaller {
 
+static const QLatin1String scValidatorsFile("validators.ini");
+
 static QUrl resolveUrl(const FileTaskResult &result, const QString &url)
 {
     QUrl u(url);
@@ -46,14 +56,46 @@ static QUrl resolveUrl(const FileTaskResult &result, const QString &url)
     return u;
 }
 
+/*!
+    Returns the persistent directory the Updates.xml and the extracted meta data of \a repository
+    are kept in, so they can be reused when the repository did not change. Returns an empty string
+    if there is no cache location on this system.
+*/
+static QString cacheDirectory(const Repository &repository)
+{
+#if QT_VERSION < 0x050000
+    const QString root = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#else
+    const QString root = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+#endif
+    if (root.isEmpty())
+        return QString();
+
+    const QByteArray hash = QCryptographicHash::hash(repository.url().toString().toUtf8(),
+        QCryptographicHash::Sha1).toHex();
+    return QString::fromLatin1("%1/repositories/%2").arg(root, QString::fromLatin1(hash));
+}
+
+static void addCacheValidators(const QString &directory, FileTaskItem *item)
+{
+    if (directory.isEmpty() || !QFile::exists(directory + QLatin1String("/Updates.xml")))
+        return;
+
+    const QSettings validators(directory + QLatin1Char('/') + scValidatorsFile, QSettings::IniFormat);
+    item->insert(TaskRole::ETag, validators.value(QLatin1String("ETag")).toByteArray());
+    item->insert(TaskRole::LastModified, validators.value(QLatin1String("LastModified")).toByteArray());
+}
+
 MetadataJob::MetadataJob(QObject *parent)
     : KDJob(parent)
     , m_core(0)
+    , m_unzipArchiveTask(0)
 {
     setCapabilities(Cancelable);
     connect(&m_xmlTask, SIGNAL(finished()), this, SLOT(xmlTaskFinished()));
     connect(&m_metadataTask, SIGNAL(finished()), this, SLOT(metadataTaskFinished()));
     connect(&m_metadataTask, SIGNAL(progressValueChanged(int)), this, SLOT(progressChanged(int)));
+    connect(&m_unzipTask, SIGNAL(finished()), this, SLOT(unzipTaskFinished()));
 }
 
 MetadataJob::~MetadataJob()
@@ -81,6 +123,7 @@ void MetadataJob::doStart()
     const bool onlineInstaller = m_core->isInstaller() && !m_core->isOfflineOnly();
     if (onlineInstaller || (m_core->isUpdater() || m_core->isPackageManager())) {
         QList<FileTaskItem> items;
+        const bool cacheBusting = m_core->settings().repositoryCacheBusting();
         const ProductKeyCheck *const productKeyCheck = ProductKeyCheck::instance();
         foreach (const Repository &repo, m_core->settings().repositories()) {
             if (repo.isEnabled() && productKeyCheck->isValidRepository(repo)) {
@@ -88,12 +131,21 @@ void MetadataJob::doStart()
                 authenticator.setUser(repo.username());
                 authenticator.setPassword(repo.password());
 
-                QString url = repo.url().toString() + QLatin1String("/Updates.xml?");
+                QStringList query;
                 if (!m_core->value(QLatin1String("UrlQueryString")).isEmpty())
-                    url += m_core->value(QLatin1String("UrlQueryString")) + QLatin1Char('&');
+                    query.append(m_core->value(QLatin1String("UrlQueryString")));
 
-                // also append a random string to avoid proxy caches
-                FileTaskItem item(url.append(QString::number(qrand() * qrand())));
+                // a random string avoids proxy caches, but defeats any revalidation as well
+                if (cacheBusting)
+                    query.append(QString::number(qrand() * qrand()));
+
+                QString url = repo.url().toString() + QLatin1String("/Updates.xml");
+                if (!query.isEmpty())
+                    url += QLatin1Char('?') + query.join(QLatin1String("&"));
+
+                FileTaskItem item(url);
+                if (!cacheBusting)
+                    addCacheValidators(cacheDirectory(repo), &item);
                 item.insert(TaskRole::UserRole, QVariant::fromValue(repo));
                 item.insert(TaskRole::Authenticator, QVariant::fromValue(authenticator));
                 items.append(item);
@@ -199,9 +251,11 @@ void MetadataJob::xmlTaskFinished()
 
 void MetadataJob::unzipTaskFinished()
 {
-    QFutureWatcher<void> *watcher = static_cast<QFutureWatcher<void> *>(sender());
+    if (!m_unzipArchiveTask)
+        return; // canceled by reset()
+
     try {
-        watcher->waitForFinished();    // trigger possible exceptions
+        m_unzipTask.waitForFinished();    // trigger possible exceptions
     } catch (const UnzipArchiveException &e) {
         reset();
         emitFinishedWithError(QInstaller::ExtractionError, e.message());
@@ -216,14 +270,12 @@ void MetadataJob::unzipTaskFinished()
     if (error() != KDJob::NoError)
         return;
 
-    delete m_unzipTasks.value(watcher);
-    m_unzipTasks.remove(watcher);
-    delete watcher;
+    delete m_unzipArchiveTask;
+    m_unzipArchiveTask = 0;
 
-    if (m_unzipTasks.isEmpty()) {
-        setProcessedAmount(100);
-        emitFinished();
-    }
+    storeCacheValidators();
+    setProcessedAmount(100);
+    emitFinished();
 }
 
 void MetadataJob::progressChanged(int progress)
@@ -238,17 +290,16 @@ void MetadataJob::metadataTaskFinished()
         QFuture<FileTaskResult> future = m_metadataTask.future();
         if (future.resultCount() > 0) {
             emit infoMessage(this, tr("Extracting meta information..."));
+            QList<UnzipArchiveTask::Archive> archives;
             foreach (const FileTaskResult &result, future.results()) {
                 const FileTaskItem item = result.value(TaskRole::TaskItem).value<FileTaskItem>();
-                UnzipArchiveTask *task = new UnzipArchiveTask(result.target(),
-                    item.value(TaskRole::UserRole).toString());
-
-                QFutureWatcher<void> *watcher = new QFutureWatcher<void>();
-                m_unzipTasks.insert(watcher, qobject_cast<QObject*> (task));
-                connect(watcher, SIGNAL(finished()), this, SLOT(unzipTaskFinished()));
-                watcher->setFuture(QtConcurrent::run(&UnzipArchiveTask::doTask, task));
+                archives.append(qMakePair(result.target(),
+                    item.value(TaskRole::UserRole).toString()));
             }
+            m_unzipArchiveTask = new UnzipArchiveTask(archives);
+            m_unzipTask.setFuture(QtConcurrent::run(&UnzipArchiveTask::doTask, m_unzipArchiveTask));
         } else {
+            storeCacheValidators();
             emitFinished();
         }
     } catch (const TaskException &e) {
@@ -270,6 +321,7 @@ void MetadataJob::reset()
 {
     m_packages.clear();
     m_metadata.clear();
+    m_cacheValidators.clear();
 
     setError(KDJob::NoError);
     setErrorString(QString());
@@ -278,38 +330,48 @@ void MetadataJob::reset()
     try {
         m_xmlTask.cancel();
         m_metadataTask.cancel();
-        foreach (QFutureWatcher<void> *const watcher, m_unzipTasks.keys()) {
-            watcher->cancel();
-            watcher->deleteLater();
-        }
-        foreach (QObject *const object, m_unzipTasks)
-            object->deleteLater();
-        m_unzipTasks.clear();
+        m_unzipTask.cancel();
     } catch (...) {}
+    if (m_unzipArchiveTask) {
+        // the workers stop after the archive they are extracting, wait for them before deleting
+        try {
+            m_unzipTask.waitForFinished();
+        } catch (...) {}
+        delete m_unzipArchiveTask;
+        m_unzipArchiveTask = 0;
+    }
     m_tempDirDeleter.releaseAndDeleteAll();
 }
 
 MetadataJob::Status MetadataJob::parseUpdatesXml(const QList<FileTaskResult> &results)
 {
+    TraceSpan span("metadata", "parseUpdatesXml");
     foreach (const FileTaskResult &result, results) {
         if (error() != KDJob::NoError)
             return XmlDownloadFailure;
 
         Metadata metadata;
-        try {
-            metadata.directory = createTemporaryDirectory(QLatin1String("remoterepo-"));
-            m_tempDirDeleter.add(metadata.directory);
-        } catch (const QInstaller::Error &error) {
-            qDebug() << error.message();
+        const FileTaskItem item = result.value(TaskRole::TaskItem).value<FileTaskItem>();
+        metadata.repository = item.value(TaskRole::UserRole).value<Repository>();
+        const bool online = !(metadata.repository.url().scheme()).isEmpty();
+
+        const QString cacheDir = m_core->settings().repositoryCacheBusting() ? QString()
+            : cacheDirectory(metadata.repository);
+        const bool notModified = result.value(TaskRole::HttpStatusCode).toInt() == 304;
+        if (notModified && item.value(TaskRole::ETag).toByteArray().isEmpty()
+            && item.value(TaskRole::LastModified).toByteArray().isEmpty()) {
+            qDebug() << "Unexpected answer 'Not Modified' to an unconditional request from repository:"
+                << metadata.repository.displayname();
             return XmlDownloadFailure;
         }
 
-        QFile file(result.target());
-        if (!file.rename(metadata.directory + QLatin1String("/Updates.xml"))) {
-            qDebug() << "Could not rename target to Updates.xml. Error:" << file.errorString();
-            return XmlDownloadFailure;
+        if (notModified && !QFile::exists(cacheDir + QLatin1String("/Updates.xml"))) {
+            // the cache got lost in between, start over without sending any validator
+            QFile::remove(cacheDir + QLatin1Char('/') + scValidatorsFile);
+            return XmlDownloadRetry;
         }
 
+        QFile file(notModified ? cacheDir + QLatin1String("/Updates.xml") : result.target());
         if (!file.open(QIODevice::ReadOnly)) {
             qDebug() << "Could not open Updates.xml for reading. Error:" << file.errorString();
             return XmlDownloadFailure;
@@ -324,9 +386,29 @@ MetadataJob::Status MetadataJob::parseUpdatesXml(const QList<FileTaskResult> &re
         }
         file.close();
 
-        const FileTaskItem item = result.value(TaskRole::TaskItem).value<FileTaskItem>();
-        metadata.repository = item.value(TaskRole::UserRole).value<Repository>();
-        const bool online = !(metadata.repository.url().scheme()).isEmpty();
+        try {
+            if (cacheDir.isEmpty()) {
+                metadata.directory = createTemporaryDirectory(QLatin1String("remoterepo-"));
+                m_tempDirDeleter.add(metadata.directory);
+            } else {
+                metadata.directory = cacheDir;
+                if (!notModified) {
+                    // replace the outdated cache content, validators are written once complete
+                    removeDirectory(cacheDir, true);
+                    mkpath(cacheDir);
+                    m_cacheValidators.insert(cacheDir, qMakePair(result.value(TaskRole::ETag)
+                        .toByteArray(), result.value(TaskRole::LastModified).toByteArray()));
+                }
+            }
+        } catch (const QInstaller::Error &error) {
+            qDebug() << error.message();
+            return XmlDownloadFailure;
+        }
+
+        if (!notModified && !file.rename(metadata.directory + QLatin1String("/Updates.xml"))) {
+            qDebug() << "Could not rename target to Updates.xml. Error:" << file.errorString();
+            return XmlDownloadFailure;
+        }
 
         bool testCheckSum = true;
         const QDomElement root = doc.documentElement();
@@ -334,8 +416,32 @@ MetadataJob::Status MetadataJob::parseUpdatesXml(const QList<FileTaskResult> &re
         if (!checksum.isNull())
             testCheckSum = (checksum.toElement().text().toLower() == scTrue);
 
+        QAuthenticator authenticator;
+        authenticator.setUser(metadata.repository.username());
+        authenticator.setPassword(metadata.repository.password());
+
+        // an unchanged repository keeps using the meta data extracted into the cache before
+        const QString repoUrl = metadata.repository.url().toString();
+        const QString metadataName = root.firstChildElement(QLatin1String("MetadataName")).text();
+        if (notModified) {
+            qDebug() << "Using cached meta information of repository:" << metadata.repository.displayname();
+        } else if (!metadataName.isEmpty()) {
+            // the repository provides the meta data of all components in one archive
+            FileTaskItem item(QString::fromLatin1("%1/%2").arg(repoUrl, metadataName),
+                metadata.directory + QLatin1Char('/') + metadataName);
+
+            QByteArray metadataHash;
+            if (testCheckSum)
+                metadataHash = root.firstChildElement(QLatin1String("SHA1")).text().toLatin1();
+
+            item.insert(TaskRole::UserRole, metadata.directory);
+            item.insert(TaskRole::Checksum, metadataHash);
+            item.insert(TaskRole::Authenticator, QVariant::fromValue(authenticator));
+            m_packages.append(item);
+        }
+
         QDomNodeList children = root.childNodes();
-        for (int i = 0; i < children.count(); ++i) {
+        for (int i = 0; i < children.count() && metadataName.isEmpty() && !notModified; ++i) {
             const QDomElement el = children.at(i).toElement();
             if (!el.isNull() && el.tagName() == QLatin1String("PackageUpdate")) {
                 const QDomNodeList c2 = el.childNodes();
@@ -349,15 +455,10 @@ MetadataJob::Status MetadataJob::parseUpdatesXml(const QList<FileTaskResult> &re
                         packageHash = c2.at(j).toElement().text();
                 }
 
-                const QString repoUrl = metadata.repository.url().toString();
                 FileTaskItem item(QString::fromLatin1("%1/%2/%3meta.7z").arg(repoUrl, packageName,
                     packageVersion), metadata.directory + QString::fromLatin1("/%1-%2-meta.7z")
                     .arg(packageName, packageVersion));
 
-                QAuthenticator authenticator;
-                authenticator.setUser(metadata.repository.username());
-                authenticator.setPassword(metadata.repository.password());
-
                 item.insert(TaskRole::UserRole, metadata.directory);
                 item.insert(TaskRole::Checksum, packageHash.toLatin1());
                 item.insert(TaskRole::Authenticator, QVariant::fromValue(authenticator));
@@ -448,4 +549,20 @@ MetadataJob::Status MetadataJob::parseUpdatesXml(const QList<FileTaskResult> &re
     return XmlDownloadSuccess;
 }
 
+void MetadataJob::storeCacheValidators()
+{
+    typedef QPair<QByteArray, QByteArray> Validators;
+    QHash<QString, Validators>::const_iterator it;
+    for (it = m_cacheValidators.constBegin(); it != m_cacheValidators.constEnd(); ++it) {
+        const Validators &validators = it.value();
+        if (validators.first.isEmpty() && validators.second.isEmpty())
+            continue;   // the server does not support revalidation, e.g. a local repository
+
+        QSettings settings(it.key() + QLatin1Char('/') + scValidatorsFile, QSettings::IniFormat);
+        settings.setValue(QLatin1String("ETag"), validators.first);
+        settings.setValue(QLatin1String("LastModified"), validators.second);
+    }
+    m_cacheValidators.clear();
+}
+
 }   // namespace QInstaller
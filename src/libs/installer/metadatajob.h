@@ -39,6 +39,7 @@
 namespace QInstaller {
 
 class PackageManagerCore;
+class UnzipArchiveTask;
 
 struct Metadata
 {
@@ -77,6 +78,7 @@ private slots:
 private:
     void reset();
     Status parseUpdatesXml(const QList<FileTaskResult> &results);
+    void storeCacheValidators();
 
 private:
     PackageManagerCore *m_core;
@@ -84,9 +86,11 @@ private:
     QList<FileTaskItem> m_packages;
     TempDirDeleter m_tempDirDeleter;
     QHash<QString, Metadata> m_metadata;
+    QHash<QString, QPair<QByteArray, QByteArray> > m_cacheValidators;
     QFutureWatcher<FileTaskResult> m_xmlTask;
     QFutureWatcher<FileTaskResult> m_metadataTask;
-    QHash<QFutureWatcher<void> *, QObject*> m_unzipTasks;
+    QFutureWatcher<void> m_unzipTask;
+    UnzipArchiveTask *m_unzipArchiveTask;
 };
 
 }   // namespace QInstaller
@@ -31,6 +31,12 @@
 
 #include "lib7z_facade.h"
 #include "metadatajob.h"
+#include "trace.h"
+
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
 
 namespace QInstaller{
 
@@ -57,8 +63,10 @@ class UnzipArchiveTask : public AbstractTask<void>
     Q_DISABLE_COPY(UnzipArchiveTask)
 
 public:
-    UnzipArchiveTask(const QString &arcive, const QString &target)
-        : m_archive(arcive), m_targetDir(target)
+    typedef QPair<QString, QString> Archive;    // archive, target directory
+
+    explicit UnzipArchiveTask(const QList<Archive> &archives)
+        : m_archives(archives)
     {}
 
     void doTask(QFutureInterface<void> &fi)
@@ -71,28 +79,94 @@ public:
             return; // ignore already canceled
         }
 
-        QFile archive(m_archive);
-        if (archive.open(QIODevice::ReadOnly)) {
+        // Meta data archives are small and numerous, so a few workers take them from one queue
+        // and each extracts many of them in a row. The pool is our own, so that hundreds of
+        // archives neither flood the global thread pool nor wait behind the work queued there.
+        TraceSpan span("metadata", "extractMetadata");
+        const int workers = qBound(1, QThread::idealThreadCount(), m_archives.count());
+        QThreadPool pool;
+        pool.setMaxThreadCount(workers);
+
+        fi.setProgressRange(0, m_archives.count());
+        ArchiveQueue queue(m_archives, &fi);
+        for (int i = 0; i < workers; ++i)
+            pool.start(new Worker(&queue));
+        pool.waitForDone();
+
+        if (!queue.error.isEmpty())
+            fi.reportException(UnzipArchiveException(queue.error));
+        fi.reportFinished();
+    }
+
+private:
+    struct ArchiveQueue
+    {
+        ArchiveQueue(const QList<Archive> &archives, QFutureInterface<void> *fi)
+            : archives(archives), next(0), done(0), fi(fi)
+        {}
+
+        bool take(Archive *archive)
+        {
+            QMutexLocker _(&mutex);
+            if (!error.isEmpty() || fi->isCanceled() || next >= archives.count())
+                return false;
+            *archive = archives.at(next++);
+            return true;
+        }
+
+        void finished(const QString &errorString)
+        {
+            QMutexLocker _(&mutex);
+            if (error.isEmpty())
+                error = errorString;
+            fi->setProgressValue(++done);
+        }
+
+        QMutex mutex;
+        const QList<Archive> &archives;
+        int next;
+        int done;
+        QString error;
+        QFutureInterface<void> *fi;
+    };
+
+    class Worker : public QRunnable
+    {
+    public:
+        explicit Worker(ArchiveQueue *queue)
+            : m_queue(queue)
+        {}
+
+        void run()
+        {
+            Archive archive;
+            while (m_queue->take(&archive))
+                m_queue->finished(extract(archive.first, archive.second));
+        }
+
+    private:
+        static QString extract(const QString &path, const QString &targetDir)
+        {
+            TraceSpan span("metadata", "extractMetadataArchive", path);
+            QFile archive(path);
+            if (!archive.open(QIODevice::ReadOnly)) {
+                return MetadataJob::tr("Could not open %1 for reading. Error: %2").arg(path,
+                    archive.errorString());
+            }
             try {
-                Lib7z::extractArchive(&archive, m_targetDir);
+                Lib7z::extractArchive(&archive, targetDir);
             } catch (const Lib7z::SevenZipException& e) {
-                fi.reportException(UnzipArchiveException(MetadataJob::tr("Error while extracting "
-                    "'%1': %2").arg(m_archive, e.message())));
+                return MetadataJob::tr("Error while extracting '%1': %2").arg(path, e.message());
             } catch (...) {
-                fi.reportException(UnzipArchiveException(MetadataJob::tr("Unknown exception "
-                    "caught while extracting %1.").arg(m_archive)));
+                return MetadataJob::tr("Unknown exception caught while extracting %1.").arg(path);
             }
-        } else {
-            fi.reportException(UnzipArchiveException(MetadataJob::tr("Could not open %1 for "
-                "reading. Error: %2").arg(m_archive, archive.errorString())));
+            return QString();
         }
 
-        fi.reportFinished();
-    }
+        ArchiveQueue *m_queue;
+    };
 
-private:
-    QString m_archive;
-    QString m_targetDir;
+    QList<Archive> m_archives;
 };
 
 }   // namespace QInstaller
@@ -31,10 +31,15 @@
 
 namespace QInstaller {
 
-FileTaskObserver::FileTaskObserver(QCryptographicHash::Algorithm algorithm)
+/*!
+    Creates an observer calculating a checksum using \a algorithm. With \a sampling set to
+    ManualSampling no timer is started, the owner is expected to call timerEvent() in the
+    default interval of 100 ms itself, e.g. to drive many observers from one timer.
+*/
+FileTaskObserver::FileTaskObserver(QCryptographicHash::Algorithm algorithm, Sampling sampling)
     : m_hash(algorithm)
 {
-    init();
+    init(sampling);
 }
 
 FileTaskObserver::~FileTaskObserver()
@@ -137,7 +142,7 @@ void FileTaskObserver::setBytesToTransfer(qint64 bytesToReceive)
 
 // -- private
 
-void FileTaskObserver::init()
+void FileTaskObserver::init(Sampling sampling)
 {
     m_hash.reset();
     m_sampleIndex = 0;
@@ -145,11 +150,13 @@ void FileTaskObserver::init()
     m_bytesToTransfer = 0;
     m_bytesPerSecond = 0;
     m_currentSpeedBin = 0;
+    m_samplesSum = 0;
 
     m_timerId = -1;
     m_timerInterval = 100;
     memset(m_samples, 0, sizeof(m_samples));
-    m_timerId = startTimer(m_timerInterval);
+    if (sampling == TimerSampling)
+        m_timerId = startTimer(m_timerInterval);
 }
 
 void FileTaskObserver::timerEvent(QTimerEvent *event)
@@ -157,22 +164,21 @@ void FileTaskObserver::timerEvent(QTimerEvent *event)
     Q_UNUSED(event)
     unsigned int windowSize = sizeof(m_samples) / sizeof(qint64);
 
-    // add speed of last time bin to the window
-    m_samples[m_sampleIndex % windowSize] = m_currentSpeedBin;
+    // replace the oldest sample of the window by the speed of the last time bin, the sum of the
+    // window is kept up to date instead of adding up all samples again
+    qint64 &oldestSample = m_samples[m_sampleIndex % windowSize];
+    m_samplesSum += m_currentSpeedBin - oldestSample;
+    oldestSample = m_currentSpeedBin;
     m_currentSpeedBin = 0;   // reset bin for next time interval
 
     // advance the sample index
     m_sampleIndex++;
-    m_bytesPerSecond = 0;
 
     // dynamic window size until the window is completely filled
     if (m_sampleIndex < windowSize)
         windowSize = m_sampleIndex;
 
-    for (unsigned int i = 0; i < windowSize; ++i)
-        m_bytesPerSecond += m_samples[i];
-
-    m_bytesPerSecond /= windowSize; // computer average
+    m_bytesPerSecond = m_samplesSum / windowSize; // computer average
     m_bytesPerSecond *= 1000.0 / m_timerInterval; // rescale to bytes/second
 }
 
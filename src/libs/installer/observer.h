@@ -53,7 +53,13 @@ class FileTaskObserver : public Observer
     Q_DISABLE_COPY(FileTaskObserver)
 
 public:
-    FileTaskObserver(QCryptographicHash::Algorithm algorithm);
+    enum Sampling {
+        TimerSampling,
+        ManualSampling
+    };
+
+    explicit FileTaskObserver(QCryptographicHash::Algorithm algorithm,
+        Sampling sampling = TimerSampling);
     ~FileTaskObserver();
 
     int progressValue() const;
@@ -65,12 +71,14 @@ public:
     void addSample(qint64 sample);
     void timerEvent(QTimerEvent *event);
 
+    qint64 bytesTransfered() const { return m_bytesTransfered; }
     void setBytesTransfered(qint64 bytesTransfered);
     void addBytesTransfered(qint64 bytesTransfered);
+    qint64 bytesToTransfer() const { return m_bytesToTransfer; }
     void setBytesToTransfer(qint64 bytesToTransfer);
 
 private:
-    void init();
+    void init(Sampling sampling);
 
 private:
     int m_timerId;
@@ -80,6 +88,7 @@ private:
     qint64 m_bytesToTransfer;
 
     qint64 m_samples[50];
+    qint64 m_samplesSum;
     quint32 m_sampleIndex;
     qint64 m_bytesPerSecond;
     qint64 m_currentSpeedBin;
@@ -42,6 +42,7 @@
 #include "qprocesswrapper.h"
 #include "qsettingswrapper.h"
 #include "settings.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <productkeycheck.h>
@@ -628,6 +629,7 @@ int PackageManagerCore::downloadNeededArchives(double partProgressSize)
 
     ProgressCoordinator::instance()->emitLabelAndDetailTextChanged(tr("\nDownloading packages..."));
 
+    TraceSpan span("phase", "downloadNeededArchives");
     DownloadArchivesJob archivesJob(this);
     archivesJob.setAutoDelete(false);
     archivesJob.setArchivesToDownload(archivesToDownload);
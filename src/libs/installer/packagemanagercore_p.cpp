@@ -42,6 +42,7 @@
 #include "progresscoordinator.h"
 #include "qprocesswrapper.h"
 #include "qsettingswrapper.h"
+#include "trace.h"
 
 #include "kdsavefile.h"
 #include "kdselfrestarter.h"
@@ -100,6 +101,8 @@ private:
 static bool runOperation(Operation *operation, PackageManagerCorePrivate::OperationType type)
 {
     OperationTracer tracer(operation);
+    TraceSpan span("operation", type == PackageManagerCorePrivate::Backup ? "backup"
+        : type == PackageManagerCorePrivate::Undo ? "undo" : "perform", operation->name());
     switch (type) {
         case PackageManagerCorePrivate::Backup:
             tracer.trace(QLatin1String("backup"));
@@ -649,6 +652,7 @@ void PackageManagerCorePrivate::initialize(const QHash<QString, QString> &params
     connect(&m_metadataJob, SIGNAL(progress(KDJob *, quint64, quint64)), this,
         SLOT(infoProgress(KDJob *, quint64, quint64)));
     KDUpdater::FileDownloaderFactory::instance().setProxyFactory(m_core->proxyFactory());
+    KDUpdater::FileDownloaderFactory::setDownloadSegments(m_data.settings().downloadSegments());
 }
 
 bool PackageManagerCorePrivate::isOfflineOnly() const
@@ -1167,6 +1171,7 @@ void PackageManagerCorePrivate::writeUninstallerBinaryData(QIODevice *output, QF
 
 void PackageManagerCorePrivate::writeUninstaller(OperationList performedOperations)
 {
+    TraceSpan span("phase", "writeUninstaller");
     bool gainedAdminRights = false;
     QTemporaryFile tempAdminFile(targetDir() + QLatin1String("/testjsfdjlkdsjflkdsjfldsjlfds")
         + QString::number(qrand() % 1000));
@@ -1442,6 +1447,7 @@ QString PackageManagerCorePrivate::registerPath() const
 
 bool PackageManagerCorePrivate::runInstaller()
 {
+    TraceSpan span("phase", "runInstaller");
     bool adminRightsGained = false;
     try {
         setStatus(PackageManagerCore::Running);
@@ -1615,6 +1621,7 @@ bool PackageManagerCorePrivate::runInstaller()
 
 bool PackageManagerCorePrivate::runPackageUpdater()
 {
+    TraceSpan span("phase", "runPackageUpdater");
     bool adminRightsGained = false;
     if (m_completeUninstall) {
         return runUninstaller();
@@ -1788,6 +1795,7 @@ bool PackageManagerCorePrivate::runPackageUpdater()
 
 bool PackageManagerCorePrivate::runUninstaller()
 {
+    TraceSpan span("phase", "runUninstaller");
     bool adminRightsGained = false;
     try {
         setStatus(PackageManagerCore::Running);
@@ -1863,6 +1871,7 @@ bool PackageManagerCorePrivate::runUninstaller()
 void PackageManagerCorePrivate::installComponent(Component *component, double progressOperationSize,
     bool adminRightsGained)
 {
+    TraceSpan span("component", "installComponent", component->name());
     const OperationList operations = component->operations();
     if (!component->operationsCreatedSuccessfully())
         m_core->setCanceled();
@@ -2049,6 +2058,7 @@ void PackageManagerCorePrivate::unregisterUninstaller()
 void PackageManagerCorePrivate::runUndoOperations(const OperationList &undoOperations, double progressSize,
     bool adminRightsGained, bool deleteOperation)
 {
+    TraceSpan span("phase", "runUndoOperations");
     KDUpdater::PackagesInfo &packages = *m_updaterApplication.packagesInfo();
     try {
         foreach (Operation *undoOperation, undoOperations) {
@@ -2168,6 +2178,7 @@ bool PackageManagerCorePrivate::fetchMetaInformationFromRepositories()
     m_repoFetched = false;
     m_updateSourcesAdded = false;
 
+    TraceSpan span("phase", "fetchMetaInformation");
     try {
         m_metadataJob.start();
         m_metadataJob.waitForFinished();
@@ -27,6 +27,8 @@
 **************************************************************************/
 
 #include "qtpatch.h"
+#include "errors.h"
+#include "fileutils.h"
 #include "utils.h"
 
 #include <QString>
@@ -38,7 +40,10 @@
 #include <QTime>
 #include <QtCore/QDebug>
 #include <QCoreApplication>
-#include <QByteArrayMatcher>
+
+#include <algorithm>
+
+#include <string.h>
 
 QHash<QString, QByteArray> QtPatch::readQmakeOutput(const QByteArray &data)
 {
@@ -107,9 +112,112 @@ QHash<QString, QByteArray> QtPatch::qmakeValues(const QString &qmakePath, QByteA
     return qmakeValueHash;
 }
 
+namespace {
+
+class PatternMatcher
+{
+public:
+    explicit PatternMatcher(const QInstaller::SearchReplacePairs &pairs)
+        : m_maxLength(0)
+        , m_commonFirst(-1)
+    {
+        for (int i = 0; i < pairs.count(); ++i) {
+            const QByteArray &search = pairs.at(i).first;
+            if (search.isEmpty())
+                continue;
+            QByteArray overwrite(pairs.at(i).second);
+            if (overwrite.size() < search.size())
+                overwrite.append(QByteArray(search.size() - overwrite.size(), '\0'));
+            m_patterns.append(qMakePair(search, overwrite));
+            m_maxLength = qMax(m_maxLength, search.size());
+        }
+
+        // try the longest pattern first, so that a path wins over any of its prefixes
+        std::stable_sort(m_patterns.begin(), m_patterns.end(), longerPatternFirst);
+        for (int i = 0; i < m_patterns.count(); ++i) {
+            const uchar first = uchar(m_patterns.at(i).first.at(0));
+            m_candidates[first].append(i);
+            m_commonFirst = (i == 0 || m_commonFirst == first) ? int(first) : -2;
+        }
+    }
+
+    bool isEmpty() const { return m_patterns.isEmpty(); }
+    int maxLength() const { return m_maxLength; }
+    const QByteArray &overwrite(int pattern) const { return m_patterns.at(pattern).second; }
+
+    // Returns the first position in [from, to) where one of the patterns matches completely
+    // inside the first size bytes of data, and stores the index of the pattern in pattern.
+    // Paths usually start with the same byte, candidates are then found with memchr().
+    qint64 indexIn(const char *data, qint64 size, qint64 from, qint64 to, int *pattern) const
+    {
+        for (qint64 pos = from; pos < to; ++pos) {
+            if (m_commonFirst >= 0) {
+                const char *const candidate = static_cast<const char *>(memchr(data + pos,
+                    m_commonFirst, size_t(to - pos)));
+                if (!candidate)
+                    break;
+                pos = candidate - data;
+            }
+            const QVector<int> &candidates = m_candidates[uchar(data[pos])];
+            for (int i = 0; i < candidates.count(); ++i) {
+                const QByteArray &search = m_patterns.at(candidates.at(i)).first;
+                if (search.size() <= size - pos
+                    && memcmp(data + pos, search.constData(), search.size()) == 0) {
+                    *pattern = candidates.at(i);
+                    return pos;
+                }
+            }
+        }
+        return -1;
+    }
+
+private:
+    static bool longerPatternFirst(const QPair<QByteArray, QByteArray> &lhs,
+        const QPair<QByteArray, QByteArray> &rhs)
+    {
+        return lhs.first.size() > rhs.first.size();
+    }
+
+private:
+    int m_maxLength;
+    int m_commonFirst;  // the first byte shared by all patterns, negative if there is none
+    QInstaller::SearchReplacePairs m_patterns;
+    QVector<int> m_candidates[256];
+};
+
+bool patchMappedFile(QFile *file, const PatternMatcher &matcher)
+{
+    const qint64 size = file->size();
+    uchar *const mapped = size > 0 ? file->map(0, size) : 0;
+    if (!mapped)
+        return false;
+
+    // patch the pages in place in a single pass, the kernel writes back only the ones we touched
+    char *const data = reinterpret_cast<char *>(mapped);
+    int pattern = -1;
+    qint64 pos = matcher.indexIn(data, size, 0, size, &pattern);
+    while (pos != -1) {
+        const QByteArray &overwrite = matcher.overwrite(pattern);
+        const qint64 length = qMin(qint64(overwrite.size()), size - pos);
+        memcpy(data + pos, overwrite.constData(), size_t(length));
+        pos = matcher.indexIn(data, size, pos + length, size, &pattern);
+    }
+    file->unmap(mapped);
+    return true;
+}
+
+} // namespace
+
 bool QtPatch::patchBinaryFile(const QString &fileName,
                               const QByteArray &oldQtPath,
                               const QByteArray &newQtPath)
+{
+    return patchBinaryFile(fileName, QInstaller::SearchReplacePairs()
+        << qMakePair(oldQtPath, newQtPath));
+}
+
+bool QtPatch::patchBinaryFile(const QString &fileName,
+                              const QInstaller::SearchReplacePairs &oldNewPathPairs)
 {
     QFile file(fileName);
     if (!file.exists()) {
@@ -124,39 +232,65 @@ bool QtPatch::patchBinaryFile(const QString &fileName,
         return false;
     }
 
-    bool isPatched = patchBinaryFile(&file, oldQtPath, newQtPath);
+    bool isPatched = patchBinaryFile(&file, oldNewPathPairs);
 
     file.close();
     return isPatched;
 }
 
-// device must be open
 bool QtPatch::patchBinaryFile(QIODevice *device,
                               const QByteArray &oldQtPath,
                               const QByteArray &newQtPath)
+{
+    return patchBinaryFile(device, QInstaller::SearchReplacePairs()
+        << qMakePair(oldQtPath, newQtPath));
+}
+
+// device must be open
+bool QtPatch::patchBinaryFile(QIODevice *device,
+                              const QInstaller::SearchReplacePairs &oldNewPathPairs)
 {
     if (!(device->openMode() == QIODevice::ReadWrite)) {
         qDebug() << "qpatch: warning: This function needs an open device for writing.";
         return false;
     }
-    const QByteArray source = device->readAll();
-    device->seek(0);
-
-    int offset = 0;
-    QByteArray overwritePath(newQtPath);
-    if (overwritePath.size() < oldQtPath.size()) {
-        QByteArray fillByteArray(oldQtPath.size() - overwritePath.size(), '\0');
-        overwritePath.append(fillByteArray);
+    const PatternMatcher matcher(oldNewPathPairs);
+    if (matcher.isEmpty())
+        return true;
+
+    QFile *const file = qobject_cast<QFile *>(device);
+    if (file && patchMappedFile(file, matcher)) {
+        device->seek(0);
+        return true;
     }
 
-    QByteArrayMatcher byteArrayMatcher(oldQtPath);
+    // the paths are patched in place, so read the device in chunks overlapping by the size of
+    // the longest path minus one byte to find matches crossing chunk boundaries
+    static const qint64 chunkSize = 1024 * 1024;
+    const qint64 overlap = matcher.maxLength() - 1;
+    qint64 chunkStart = 0;
+    qint64 nextMatchStart = 0;  // matches must not start inside an already written path
+
     forever {
-        offset = byteArrayMatcher.indexIn(source, offset);
-        if (offset == -1)
+        device->seek(chunkStart);
+        const QByteArray source = device->read(chunkSize + overlap);
+        const bool atEnd = source.size() < chunkSize + overlap;
+        const qint64 scanEnd = atEnd ? source.size() : chunkSize;
+
+        qint64 offset = qMax(Q_INT64_C(0), nextMatchStart - chunkStart);
+        int pattern = -1;
+        forever {
+            offset = matcher.indexIn(source.constData(), source.size(), offset, scanEnd, &pattern);
+            if (offset == -1)
+                break;
+            device->seek(chunkStart + offset);
+            device->write(matcher.overwrite(pattern));
+            offset += matcher.overwrite(pattern).size();
+            nextMatchStart = chunkStart + offset;
+        }
+        if (atEnd)
             break;
-        device->seek(offset);
-        device->write(overwritePath);
-        offset += overwritePath.size();
+        chunkStart += chunkSize;
     }
     device->seek(0); //for next reading we should be at the beginning
     return true;
@@ -165,29 +299,20 @@ bool QtPatch::patchBinaryFile(QIODevice *device,
 bool QtPatch::patchTextFile(const QString &fileName,
                             const QHash<QByteArray, QByteArray> &searchReplacePairs)
 {
-    QFile file(fileName);
-
-    if (!file.open(QFile::ReadOnly)) {
-        qDebug() << QString::fromLatin1("qpatch: warning: Open the file '%1' stopped: %2").arg(
-            fileName, file.errorString());
-        return false;
-    }
-
-    QByteArray source = file.readAll();
-    file.close();
-
+    QInstaller::SearchReplacePairs pairs;
     QHashIterator<QByteArray, QByteArray> it(searchReplacePairs);
     while (it.hasNext()) {
         it.next();
-        source.replace(it.key(), it.value());
+        pairs.append(qMakePair(it.key(), it.value()));
     }
 
-    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
-        qDebug() << QString::fromLatin1("qpatch: error: file '%1' not writable").arg(fileName);
+    try {
+        QInstaller::replaceInFile(fileName, pairs);
+    } catch (const QInstaller::Error &e) {
+        qDebug() << QString::fromLatin1("qpatch: warning: Patching the file '%1' stopped: %2").arg(
+            fileName, e.message());
         return false;
     }
-
-    file.write(source);
     return true;
 }
 
@@ -30,6 +30,7 @@
 #define QTPATCH_H
 
 #include "installer_global.h"
+#include "fileutils.h"
 #include <QString>
 #include <QByteArray>
 #include <QHash>
@@ -48,6 +49,12 @@ bool INSTALLER_EXPORT patchBinaryFile(QIODevice *device,
                                       const QByteArray &oldQtPath,
                                       const QByteArray &newQtPath );
 
+bool INSTALLER_EXPORT patchBinaryFile(const QString &fileName,
+                                      const QInstaller::SearchReplacePairs &oldNewPathPairs);
+
+bool INSTALLER_EXPORT patchBinaryFile(QIODevice *device,
+                                      const QInstaller::SearchReplacePairs &oldNewPathPairs);
+
 bool INSTALLER_EXPORT patchTextFile(const QString &fileName,
                                     const QHash<QByteArray, QByteArray> &searchReplacePairs);
 bool INSTALLER_EXPORT openFileForPatching(QFile *file);
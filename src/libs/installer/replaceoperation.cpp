@@ -28,17 +28,31 @@
 
 #include "replaceoperation.h"
 
+#include "errors.h"
+#include "fileutils.h"
+
 #include <QtCore/QDir>
 #include <QtCore/QFile>
-#include <QtCore/QTextStream>
+#include <QtCore/QTextCodec>
 
 using namespace QInstaller;
 
+static QByteArray encode(QTextCodec *codec, const QString &text)
+{
+    QTextCodec::ConverterState state(QTextCodec::IgnoreHeader);
+    return codec->fromUnicode(text.constData(), text.size(), &state);
+}
+
 ReplaceOperation::ReplaceOperation()
 {
     setName(QLatin1String("Replace"));
 }
 
+ReplaceOperation::~ReplaceOperation()
+{
+    deleteFileNowOrLater(value(QLatin1String("backupOfFile")).toString());
+}
+
 void ReplaceOperation::backup()
 {
 }
@@ -51,15 +65,15 @@ bool ReplaceOperation::performOperation()
     // 1. filename
     // 2. Source-String
     // 3. Replace-String
-    if (args.count() != 3) {
+    // 4. more pairs of Source-String and Replace-String possible ...
+    if (args.count() < 3 || args.count() % 2 == 0) {
         setError(InvalidArguments);
         setErrorString(tr("Invalid arguments in %0: %1 arguments given, %2 expected%3.")
-            .arg(name()).arg(arguments().count()).arg(tr("exactly 3"), QLatin1String("")));
+            .arg(name()).arg(arguments().count()).arg(tr("at least 3"), QLatin1String(" (<file>, "
+            "<search>, <replace>, [<search>, <replace>], ...)")));
         return false;
     }
     const QString fileName = args.at(0);
-    const QString before = args.at(1);
-    const QString after = args.at(2);
 
     QFile file(fileName);
     if (!file.open(QIODevice::ReadOnly)) {
@@ -67,27 +81,50 @@ bool ReplaceOperation::performOperation()
         setErrorString(tr("Failed to open %1 for reading").arg(fileName));
         return false;
     }
-
-    QTextStream stream(&file);
-    QString replacedFileContent = stream.readAll();
+    // same codec QTextStream would pick, the replacement happens on the encoded bytes
+    QTextCodec *const codec = QTextCodec::codecForUtfText(file.read(4),
+        QTextCodec::codecForLocale());
     file.close();
 
-    if (!file.open(QIODevice::WriteOnly)) {
+    SearchReplacePairs pairs;
+    for (int i = 1; i + 1 < args.count(); i += 2)
+        pairs.append(qMakePair(encode(codec, args.at(i)), encode(codec, args.at(i + 1))));
+
+    try {
+        QString backup;
+        replaceInFile(fileName, pairs, &backup);
+        if (!backup.isEmpty())
+            setValue(QLatin1String("backupOfFile"), backup);
+    } catch (const QInstaller::Error &e) {
         setError(UserDefinedError);
-        setErrorString(tr("Failed to open %1 for writing").arg(fileName));
+        setErrorString(e.message());
         return false;
     }
-
-    stream.setDevice(&file);
-    stream << replacedFileContent.replace(before, after);
-    file.close();
-
     return true;
 }
 
 bool ReplaceOperation::undoOperation()
 {
-    // Need to remove settings again
+    // nothing was replaced, or the backup is gone because the installation already finished
+    if (!hasValue(QLatin1String("backupOfFile")))
+        return true;
+
+    const QString fileName = arguments().first();
+    QFile file(fileName);
+    if (file.exists() && !file.remove()) {
+        setError(UserDefinedError);
+        setErrorString(tr("Could not delete file %1: %2").arg(fileName, file.errorString()));
+        return false;
+    }
+
+    QFile backupFile(value(QLatin1String("backupOfFile")).toString());
+    if (!backupFile.rename(fileName)) {
+        setError(UserDefinedError);
+        setErrorString(tr("Could not restore backup file into %1: %2").arg(fileName,
+            backupFile.errorString()));
+        return false;
+    }
+    clearValue(QLatin1String("backupOfFile"));
     return true;
 }
 
@@ -100,3 +137,21 @@ Operation *ReplaceOperation::clone() const
 {
     return new ReplaceOperation();
 }
+
+/*!
+    \reimp
+*/
+QDomDocument ReplaceOperation::toXml() const
+{
+    // we don't want to save the backupOfFile
+    if (!hasValue(QLatin1String("backupOfFile")))
+        return UpdateOperation::toXml();
+
+    ReplaceOperation *const me = const_cast<ReplaceOperation *>(this);
+
+    const QVariant v = value(QLatin1String("backupOfFile"));
+    me->clearValue(QLatin1String("backupOfFile"));
+    const QDomDocument xml = UpdateOperation::toXml();
+    me->setValue(QLatin1String("backupOfFile"), v);
+    return xml;
+}
@@ -37,12 +37,15 @@ class INSTALLER_EXPORT ReplaceOperation : public Operation
 {
 public:
     ReplaceOperation();
+    ~ReplaceOperation();
 
     void backup();
     bool performOperation();
     bool undoOperation();
     bool testOperation();
     Operation *clone() const;
+
+    QDomDocument toXml() const;
 };
 
 } // namespace QInstaller
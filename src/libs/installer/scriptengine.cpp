@@ -45,6 +45,7 @@
 #include "messageboxhandler.h"
 #include "errors.h"
 
+#include <QCryptographicHash>
 #include <QDesktopServices>
 #include <QFileDialog>
 #include <QMetaEnum>
@@ -232,7 +233,8 @@ void ScriptEngine::setGuiQObject(QObject *guiQObject)
 }
 
 /*!
-    Loads a script into the given \a context at \a fileName inside the ScriptEngine.
+    Loads a script into the given \a context at \a fileName inside the ScriptEngine. The script
+    gets \a component passed as variable \c component.
 
     The installer and all its components as well as other useful stuff are being exported into the script.
     Read \link componentscripting Component Scripting \endlink for details.
@@ -240,25 +242,43 @@ void ScriptEngine::setGuiQObject(QObject *guiQObject)
     couldn't evaluate the script.
 */
 QScriptValue ScriptEngine::loadInConext(const QString &context, const QString &fileName,
-    const QString &scriptInjection)
+    const QScriptValue &component)
 {
     QFile file(fileName);
     if (!file.open(QIODevice::ReadOnly)) {
         throw Error(tr("Could not open the requested script file at %1: %2.").arg(
             fileName, file.errorString()));
     }
+    const QByteArray content = file.readAll();
+
+    // the script is only parsed and compiled once per content, components sharing a script and
+    // reloading a script reuse the compiled factory function
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(context.toUtf8());
+    hash.addData(QByteArray(1, '\0'));
+    hash.addData(content);
+    const QByteArray key = hash.result();
+
+    QScriptProgram program = m_programs.value(key);
+    if (program.isNull()) {
+        // create inside closure in one line to keep linenumber in the right order
+        // which is used as a debug output in an exception case
+        // the parts are appended instead of using QString::arg(), so the file content is not
+        // scanned for place markers again and again
+        QString scriptContent;
+        scriptContent.reserve(content.size() + context.size() + 60);
+        scriptContent.append(QLatin1String("(function(component) { "))
+            .append(QString::fromLatin1(content.constData(), content.size()))
+            .append(QLatin1String(" ; return new ")).append(context)
+            .append(QLatin1String("; })"));
+        program = QScriptProgram(scriptContent, fileName);
+        m_programs.insert(key, program);
+    }
 
-    // create inside closure in one line to keep linenumber in the right order
-    // which is used as a debug output in an exception case
-    // scriptContent will be added as the last arg command to prevent wrong
-    // replacements of %1, %2 or %3 inside the scriptContent
-    QString scriptContent = QString::fromLatin1(
-        "(function() { %1 %3 ; return new %2; })();");
-
-    // merging everything together and as last we are adding the file content to prevent wrong
-    // replacements of %1 %2 or %3 inside the javascript code
-    scriptContent = scriptContent.arg(scriptInjection, context, QLatin1String(file.readAll()));
-    QScriptValue scriptContext = evaluate(scriptContent, fileName);
+    QScriptValue scriptContext;
+    const QScriptValue factory = evaluate(program);
+    if (!hasUncaughtException())
+        scriptContext = factory.call(QScriptValue(), QScriptValueList() << component);
 
     if (hasUncaughtException()) {
         throw Error(tr("Exception while loading the component script: '%1'").arg(
@@ -271,6 +291,15 @@ QScriptValue ScriptEngine::loadInConext(const QString &context, const QString &f
     return scriptContext;
 }
 
+/*!
+    \internal
+    Returns the number of scripts compiled by loadInConext().
+*/
+int ScriptEngine::compiledScriptCount() const
+{
+    return m_programs.count();
+}
+
 void ScriptEngine::handleException(const QScriptValue &value)
 {
     if (!value.engine())
@@ -289,15 +318,16 @@ void ScriptEngine::handleException(const QScriptValue &value)
 QScriptValue ScriptEngine::callScriptMethod(const QScriptValue &scriptContext,
     const QString &methodName, const QScriptValueList &arguments) const
 {
-    // don't allow such a recursion
-    if (currentContext()->backtrace().first().startsWith(methodName))
-        return QScriptValue();
-
     QScriptValue method = scriptContext.property(methodName);
     // this marks the method to be called not any longer
     if (!method.isValid())
         return QScriptValue();
 
+    // don't allow such a recursion, checked after the lookup because building the backtrace is
+    // expensive and most hooks are not implemented by the script
+    if (currentContext()->backtrace().first().startsWith(methodName))
+        return QScriptValue();
+
     const QScriptValue result = method.call(scriptContext, arguments);
     if (!result.isValid())
         return result;
@@ -44,7 +44,9 @@
 
 #include "qinstallerglobal.h"
 
+#include <QtCore/QHash>
 #include <QtScript/QScriptEngine>
+#include <QtScript/QScriptProgram>
 
 namespace QInstaller {
 
@@ -73,7 +75,9 @@ public:
     QScriptValue callScriptMethod(const QScriptValue &scriptContext, const QString &methodName,
         const QScriptValueList &arguments = QScriptValueList()) const;
 
-    QScriptValue loadInConext(const QString &context, const QString &fileName, const QString &scriptInjection = QString());
+    QScriptValue loadInConext(const QString &context, const QString &fileName,
+        const QScriptValue &component = QScriptValue());
+    int compiledScriptCount() const;
 private slots:
     void handleException(const QScriptValue &value);
     void setGuiQObject(QObject *guiQObject);
@@ -83,6 +87,7 @@ private:
     QScriptValue generateDesktopServicesObject();
     QScriptValue generateQInstallerObject();
     PackageManagerCore *m_core;
+    QHash<QByteArray, QScriptProgram> m_programs;
 };
 }
 
@@ -232,7 +232,8 @@ Settings Settings::fromFileAndPrefix(const QString &path, const QString &prefix,
                 << scDependsOnLocalInstallerBinary
                 << scAllowSpaceInPath << scAllowNonAsciiCharacters << scWizardStyle << scTitleColor
                 << scRepositorySettingsPageVisible << scTargetConfigurationFile
-                << scRemoteRepositories << scTranslations;
+                << scRemoteRepositories << scTranslations << scRepositoryCacheBusting
+                << scDownloadSegments;
 
     Settings s;
     s.d->m_data.insert(scPrefix, prefix);
@@ -435,6 +436,16 @@ bool Settings::allowNonAsciiCharacters() const
     return d->m_data.value(scAllowNonAsciiCharacters, false).toBool();
 }
 
+bool Settings::repositoryCacheBusting() const
+{
+    return d->m_data.value(scRepositoryCacheBusting, false).toBool();
+}
+
+int Settings::downloadSegments() const
+{
+    return d->m_data.value(scDownloadSegments, 1).toInt();
+}
+
 bool Settings::dependsOnLocalInstallerBinary() const
 {
     return d->m_data.value(scDependsOnLocalInstallerBinary).toBool();
@@ -139,6 +139,8 @@ public:
 
     bool allowSpaceInPath() const;
     bool allowNonAsciiCharacters() const;
+    bool repositoryCacheBusting() const;
+    int downloadSegments() const;
 
     bool containsValue(const QString &key) const;
     QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
@@ -0,0 +1,173 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+#include "trace.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+namespace QInstaller {
+
+namespace {
+
+struct TraceEvent
+{
+    const char *category;
+    const char *name;
+    QString detail;
+    qint64 start;
+    qint64 duration;
+    int thread;
+};
+
+QMutex s_mutex;
+QElapsedTimer s_clock;
+QString s_fileName;
+QVector<TraceEvent> s_events;
+QHash<Qt::HANDLE, int> s_threads;
+
+QByteArray jsonString(const QString &string)
+{
+    QString result(QLatin1Char('"'));
+    foreach (const QChar c, string) {
+        switch (c.unicode()) {
+            case '"': result.append(QLatin1String("\\\"")); break;
+            case '\\': result.append(QLatin1String("\\\\")); break;
+            case '\n': result.append(QLatin1String("\\n")); break;
+            case '\r': result.append(QLatin1String("\\r")); break;
+            case '\t': result.append(QLatin1String("\\t")); break;
+            default:
+                if (c.unicode() < 0x20) {
+                    result.append(QString::fromLatin1("\\u%1").arg(c.unicode(), 4, 16,
+                        QLatin1Char('0')));
+                } else {
+                    result.append(c);
+                }
+        }
+    }
+    return result.append(QLatin1Char('"')).toUtf8();
+}
+
+void writeOnExit()
+{
+    Trace::write();
+}
+
+} // namespace
+
+bool Trace::s_enabled = false;
+
+/*!
+    \class QInstaller::Trace
+    Records how long the phases of an installation take. Each TraceSpan measures the scope it lives
+    in. While tracing is disabled, a span costs no more than one check.
+*/
+
+/*!
+    Enables tracing and sets the file the spans get written to in the Chrome trace event format
+    when the application exits. An empty \a fileName disables tracing.
+*/
+void Trace::setOutputFile(const QString &fileName)
+{
+    QMutexLocker _(&s_mutex);
+    static bool writeOnExitAdded = false;
+    if (!writeOnExitAdded && !fileName.isEmpty()) {
+        qAddPostRoutine(writeOnExit);
+        writeOnExitAdded = true;
+    }
+    s_fileName = fileName;
+    s_enabled = !fileName.isEmpty();
+    if (s_enabled && !s_clock.isValid())
+        s_clock.start();
+}
+
+/*!
+    Writes all spans recorded so far to the trace file. Returns \c false if tracing is disabled or
+    the file cannot be written.
+*/
+bool Trace::write()
+{
+    QMutexLocker _(&s_mutex);
+    if (!s_enabled)
+        return false;
+
+    QFile file(s_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Could not write trace file" << s_fileName << file.errorString();
+        return false;
+    }
+
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray json("{\"traceEvents\":[\n");
+    for (int i = 0; i < s_events.count(); ++i) {
+        const TraceEvent &event = s_events.at(i);
+        json.append("{\"ph\":\"X\",\"cat\":\"").append(event.category)
+            .append("\",\"name\":\"").append(event.name)
+            .append("\",\"pid\":").append(pid)
+            .append(",\"tid\":").append(QByteArray::number(event.thread))
+            .append(",\"ts\":").append(QByteArray::number(event.start))
+            .append(",\"dur\":").append(QByteArray::number(event.duration));
+        if (!event.detail.isEmpty())
+            json.append(",\"args\":{\"detail\":").append(jsonString(event.detail)).append('}');
+        json.append(i + 1 < s_events.count() ? "},\n" : "}\n");
+    }
+    json.append("],\"displayTimeUnit\":\"ms\"}\n");
+
+    if (file.write(json) != json.size()) {
+        qDebug() << "Could not write trace file" << s_fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+qint64 Trace::now()
+{
+    return s_clock.nsecsElapsed() / 1000;
+}
+
+void Trace::record(const char *category, const char *name, const QString &detail, qint64 start)
+{
+    const qint64 end = now();
+    const Qt::HANDLE thread = QThread::currentThreadId();
+
+    QMutexLocker _(&s_mutex);
+    QHash<Qt::HANDLE, int>::const_iterator it = s_threads.constFind(thread);
+    if (it == s_threads.constEnd())
+        it = s_threads.insert(thread, s_threads.count());
+
+    const TraceEvent event = { category, name, detail, start, end - start, it.value() };
+    s_events.append(event);
+}
+
+}   // namespace QInstaller
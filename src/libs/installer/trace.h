@@ -0,0 +1,83 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+#ifndef QINSTALLER_TRACE_H
+#define QINSTALLER_TRACE_H
+
+#include "installer_global.h"
+
+#include <QtCore/QString>
+
+namespace QInstaller {
+
+class INSTALLER_EXPORT Trace
+{
+public:
+    static void setOutputFile(const QString &fileName);
+    static bool isEnabled() { return s_enabled; }
+    static bool write();
+
+private:
+    friend class TraceSpan;
+    static qint64 now();
+    static void record(const char *category, const char *name, const QString &detail, qint64 start);
+
+    static bool s_enabled;
+};
+
+class TraceSpan
+{
+public:
+    TraceSpan(const char *category, const char *name, const QString &detail = QString())
+        : m_category(category)
+        , m_name(name)
+        , m_start(-1)
+    {
+        if (Trace::isEnabled()) {
+            m_detail = detail;
+            m_start = Trace::now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (m_start >= 0)
+            Trace::record(m_category, m_name, m_detail, m_start);
+    }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+    const char *m_category;
+    const char *m_name;
+    QString m_detail;
+    qint64 m_start;
+};
+
+}   // namespace QInstaller
+
+#endif  // QINSTALLER_TRACE_H
@@ -45,6 +45,12 @@
 #include <QSslError>
 #include <QBasicTimer>
 #include <QTimerEvent>
+#include <QVector>
+#include <QMutex>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+
+#include <limits>
 
 using namespace KDUpdater;
 using namespace QInstaller;
@@ -54,6 +60,35 @@ static double calcProgress(qint64 done, qint64 total)
     return total ? (double(done) / double(total)) : 0;
 }
 
+// Returns the validator to send as If-Range, weak entity tags cannot be used for ranges.
+static QByteArray rangeValidator(QNetworkReply *reply)
+{
+    const QByteArray eTag = reply->rawHeader("ETag");
+    if (!eTag.isEmpty() && !eTag.startsWith("W/"))
+        return eTag;
+    return reply->rawHeader("Last-Modified");
+}
+
+// Moves the completed partial file into place, an existing file is kept until that worked.
+static bool moveIntoPlace(const QString &partFileName, const QString &fileName)
+{
+    QString backup;
+    if (QFile::exists(fileName)) {
+        backup = fileName + QLatin1String(".old");
+        QFile::remove(backup);
+        if (!QFile::rename(fileName, backup))
+            backup.clear();
+    }
+    if (!QFile::rename(partFileName, fileName)) {
+        if (!backup.isEmpty())
+            QFile::rename(backup, fileName);
+        return false;
+    }
+    if (!backup.isEmpty())
+        QFile::remove(backup);
+    return true;
+}
+
 
 // -- KDUpdater::FileDownloader
 
@@ -304,6 +339,8 @@ void KDUpdater::FileDownloader::setDownloadCompleted()
 {
     if (d->m_assumedSha1Sum.isEmpty() || (d->m_assumedSha1Sum == sha1Sum())) {
         onSuccess();
+        if (!isDownloaded())
+            return; // onSuccess() reported the error
         emit downloadCompleted();
         emit downloadStatus(tr("Download finished."));
     } else {
@@ -617,9 +654,12 @@ void KDUpdater::FileDownloader::setIgnoreSslErrors(bool ignore)
 
     The user of KDUpdater might be simultaneously downloading several files;
     sometimes in parallel to other file downloaders. If copying a local file takes
-    a long time, it will make the other downloads hang. Therefore, a timer is used
-    and one block of data is copied per unit time, even though QFile::copy() does the
-    task of copying local files from one place to another.
+    a long time, it will make the other downloads hang. Therefore, the file is
+    processed in a worker thread.
+
+    If no downloaded file name was set, the file is used in place and only read
+    to calculate its checksum. Otherwise it is copied by the kernel where possible,
+    see QInstaller::kernelCopy(), or in large blocks while calculating the checksum.
 */
 
 struct KDUpdater::LocalFileDownloader::Private
@@ -628,14 +668,29 @@ struct KDUpdater::LocalFileDownloader::Private
         : source(0)
         , destination(0)
         , downloaded(false)
-        , timerId(-1)
+        , inPlace(false)
+        , running(false)
+        , size(0)
+        , reported(0)
+        , transferred(0)
+        , canceled(false)
     {}
 
     QFile *source;
     QFile *destination;
     QString destFileName;
     bool downloaded;
-    int timerId;
+    bool inPlace;
+    bool running;
+    qint64 size;
+    qint64 reported;
+    QFutureWatcher<void> watcher;
+
+    // shared with the worker thread
+    QMutex mutex;
+    qint64 transferred;
+    bool canceled;
+    QString error;
 };
 
 /*!
@@ -645,6 +700,7 @@ KDUpdater::LocalFileDownloader::LocalFileDownloader(QObject *parent)
     : KDUpdater::FileDownloader(QLatin1String("file"), parent)
     , d (new Private)
 {
+    connect(&d->watcher, SIGNAL(finished()), this, SLOT(transferFinished()));
 }
 
 /*!
@@ -652,7 +708,15 @@ KDUpdater::LocalFileDownloader::LocalFileDownloader(QObject *parent)
 */
 KDUpdater::LocalFileDownloader::~LocalFileDownloader()
 {
-    if (this->isAutoRemoveDownloadedFile() && !d->destFileName.isEmpty())
+    if (d->running) {
+        d->mutex.lock();
+        d->canceled = true;
+        d->mutex.unlock();
+        d->watcher.waitForFinished();
+    }
+
+    // never remove a file used in place
+    if (this->isAutoRemoveDownloadedFile() && !d->inPlace && !d->destFileName.isEmpty())
         QFile::remove(d->destFileName);
 
     delete d;
@@ -682,7 +746,7 @@ void KDUpdater::LocalFileDownloader::doDownload()
         return;
 
     // Already started downloading
-    if (d->timerId >= 0)
+    if (d->running)
         return;
 
     // Open source and destination files
@@ -695,35 +759,41 @@ void KDUpdater::LocalFileDownloader::doDownload()
         return;
     }
 
-    if (d->destFileName.isEmpty()) {
-        QTemporaryFile *file = new QTemporaryFile(this);
-        file->open();
-        d->destination = file;
-    } else {
+    d->inPlace = d->destFileName.isEmpty();
+    if (!d->inPlace) {
         d->destination = new QFile(d->destFileName, this);
         d->destination->open(QIODevice::ReadWrite | QIODevice::Truncate);
-    }
 
-    if (!d->destination->isOpen()) {
-        onError();
-        setDownloadAborted(tr("Cannot open destination file '%1' for writing.")
-            .arg(QFileInfo(d->destination->fileName()).fileName()));
-        return;
+        if (!d->destination->isOpen()) {
+            onError();
+            setDownloadAborted(tr("Cannot open destination file '%1' for writing.")
+                .arg(QFileInfo(d->destination->fileName()).fileName()));
+            return;
+        }
     }
 
+    d->size = d->source->size();
+    d->reported = 0;
+    d->transferred = 0;
+    d->canceled = false;
+    d->error.clear();
+    d->running = true;
+
     runDownloadSpeedTimer();
-    // Start a timer and kickoff the copy process
-    d->timerId = startTimer(0); // as fast as possible
+    d->watcher.setFuture(QtConcurrent::run(this, &LocalFileDownloader::transferFile));
 
     emit downloadStarted();
     emit downloadProgress(0);
 }
 
 /*!
-    Returns the file name of the copied file.
+    Returns the file name of the copied file, or the name of the source file if it is used in
+    place.
 */
 QString KDUpdater::LocalFileDownloader::downloadedFileName() const
 {
+    if (d->inPlace && d->downloaded)
+        return url().toLocalFile();
     return d->destFileName;
 }
 
@@ -749,11 +819,14 @@ KDUpdater::LocalFileDownloader *KDUpdater::LocalFileDownloader::clone(QObject *p
 */
 void KDUpdater::LocalFileDownloader::cancelDownload()
 {
-    if (d->timerId < 0)
+    if (!d->running)
         return;
 
-    killTimer(d->timerId);
-    d->timerId = -1;
+    d->mutex.lock();
+    d->canceled = true;
+    d->mutex.unlock();
+    d->running = false;
+    d->watcher.waitForFinished();   // returns after the block currently processed
 
     onError();
     setDownloadCanceled();
@@ -764,43 +837,8 @@ void KDUpdater::LocalFileDownloader::cancelDownload()
 */
 void KDUpdater::LocalFileDownloader::timerEvent(QTimerEvent *event)
 {
-    if (event->timerId() == d->timerId) {
-        if (!d->source || !d->destination)
-            return;
-
-        const qint64 blockSize = 32768;
-        QByteArray buffer;
-        buffer.resize(blockSize);
-        const qint64 numRead = d->source->read(buffer.data(), buffer.size());
-        qint64 toWrite = numRead;
-        while (toWrite > 0) {
-            const qint64 numWritten = d->destination->write(buffer.constData() + numRead - toWrite, toWrite);
-            if (numWritten < 0) {
-                killTimer(d->timerId);
-                d->timerId = -1;
-                onError();
-                setDownloadAborted(tr("Writing to %1 failed: %2").arg(d->destination->fileName(),
-                    d->destination->errorString()));
-                return;
-            }
-            toWrite -= numWritten;
-        }
-        addSample(numRead);
-        addCheckSumData(buffer.data(), numRead);
-
-        if (numRead > 0) {
-            setProgress(d->source->pos(), d->source->size());
-            emit downloadProgress(calcProgress(d->source->pos(), d->source->size()));
-            return;
-        }
-
-        d->destination->flush();
-
-        killTimer(d->timerId);
-        d->timerId = -1;
-
-        setDownloadCompleted();
-    } else if (event->timerId() == downloadSpeedTimerId()) {
+    if (event->timerId() == downloadSpeedTimerId()) {
+        reportProgress();
         emitDownloadSpeed();
         emitDownloadStatus();
         emitDownloadProgress();
@@ -815,12 +853,12 @@ void KDUpdater::LocalFileDownloader::timerEvent(QTimerEvent *event)
 void LocalFileDownloader::onSuccess()
 {
     d->downloaded = true;
-    d->destFileName = d->destination->fileName();
-    if (QTemporaryFile *file = dynamic_cast<QTemporaryFile *>(d->destination))
-        file->setAutoRemove(false);
-    d->destination->close();
-    delete d->destination;
-    d->destination = 0;
+    if (d->destination) {
+        d->destFileName = d->destination->fileName();
+        d->destination->close();
+        delete d->destination;
+        d->destination = 0;
+    }
     delete d->source;
     d->source = 0;
     stopDownloadSpeedTimer();
@@ -841,6 +879,98 @@ void LocalFileDownloader::onError()
     stopDownloadSpeedTimer();
 }
 
+void KDUpdater::LocalFileDownloader::transferFinished()
+{
+    if (!d->running)
+        return; // canceled
+
+    d->running = false;
+    reportProgress();
+
+    d->mutex.lock();
+    const QString error = d->error;
+    d->mutex.unlock();
+
+    if (!error.isEmpty()) {
+        onError();
+        setDownloadAborted(error);
+        return;
+    }
+    setDownloadCompleted();
+}
+
+/*!
+    Runs in a worker thread. Copies the source file if a destination is set, and calculates its
+    checksum.
+*/
+void KDUpdater::LocalFileDownloader::transferFile()
+{
+    // A copy made by the kernel never passes user space, the checksum is then calculated by
+    // reading the source once more. Otherwise the file is copied and hashed in one pass.
+    QFile *target = d->destination;
+    if (target) {
+        if (QInstaller::kernelCopy(d->source, target)) {
+            target = 0;
+        } else {
+            target->resize(0);
+            target->seek(0);
+        }
+        d->source->seek(0);
+    }
+
+    QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+    QString error;
+    forever {
+        const qint64 numRead = d->source->read(buffer.data(), buffer.size());
+        if (numRead < 0) {
+            error = tr("Reading from %1 failed: %2").arg(d->source->fileName(),
+                d->source->errorString());
+            break;
+        }
+        if (numRead == 0)
+            break;
+
+        qint64 toWrite = target ? numRead : 0;
+        while (toWrite > 0) {
+            const qint64 numWritten = target->write(buffer.constData() + numRead - toWrite, toWrite);
+            if (numWritten < 0) {
+                error = tr("Writing to %1 failed: %2").arg(target->fileName(),
+                    target->errorString());
+                break;
+            }
+            toWrite -= numWritten;
+        }
+        if (!error.isEmpty())
+            break;
+        addCheckSumData(buffer.constData(), numRead);
+
+        QMutexLocker locker(&d->mutex);
+        d->transferred += numRead;
+        if (d->canceled)
+            break;
+    }
+
+    if (d->destination && !d->destination->flush() && error.isEmpty()) {
+        error = tr("Writing to %1 failed: %2").arg(d->destination->fileName(),
+            d->destination->errorString());
+    }
+
+    QMutexLocker locker(&d->mutex);
+    d->error = error;
+}
+
+void KDUpdater::LocalFileDownloader::reportProgress()
+{
+    d->mutex.lock();
+    const qint64 transferred = d->transferred;
+    d->mutex.unlock();
+
+    addSample(transferred - d->reported);
+    d->reported = transferred;
+    setProgress(transferred, d->size);
+    emit downloadProgress(calcProgress(transferred, d->size));
+}
+
 
 // -- ResourceFileDownloader
 
@@ -1040,6 +1170,9 @@ struct KDUpdater::HttpDownloader::Private
         , downloaded(false)
         , aborted(false)
         , m_authenticationCount(0)
+        , resumeOffset(0)
+        , validated(false)
+        , resumable(false)
     {}
 
     HttpDownloader *const q;
@@ -1051,9 +1184,30 @@ struct KDUpdater::HttpDownloader::Private
     bool aborted;
     int m_authenticationCount;
 
+    qint64 resumeOffset;    // size of the partial file requested to be continued by range
+    bool validated;         // the response has been checked for partial content
+    bool resumable;         // the partial file can be continued on a later download
+    QByteArray validator;   // ETag or Last-Modified of the file the partial file belongs to
+
+    QString partFileName() const
+    {
+        return destFileName + QLatin1String(".part");
+    }
+
+    QString validatorFileName() const
+    {
+        return partFileName() + QLatin1String(".validator");
+    }
+
+    void removePartFile()
+    {
+        QFile::remove(partFileName());
+        QFile::remove(validatorFileName());
+    }
+
     void shutDown()
     {
-        disconnect(http, SIGNAL(finished()), q, SLOT(httpReqFinished()));
+        disconnect(http, 0, q, 0);
         http->deleteLater();
         http = 0;
         destination->close();
@@ -1116,6 +1270,20 @@ void KDUpdater::HttpDownloader::doDownload()
     if (d->http)
         return;
 
+    // continue a download interrupted before, named downloads are written to a partial file; it
+    // is only continued if it is known which version of the file it belongs to
+    d->resumeOffset = 0;
+    d->validator.clear();
+    if (!d->destFileName.isEmpty()) {
+        const QFileInfo part(d->partFileName());
+        QFile validator(d->validatorFileName());
+        if (part.isFile() && validator.open(QIODevice::ReadOnly)) {
+            d->validator = validator.readAll().trimmed();
+            if (!d->validator.isEmpty())
+                d->resumeOffset = part.size();
+        }
+    }
+
     startDownload(url());
     runDownloadSpeedTimer();
 }
@@ -1147,6 +1315,63 @@ KDUpdater::HttpDownloader *KDUpdater::HttpDownloader::clone(QObject *parent) con
 
 void KDUpdater::HttpDownloader::httpReadyRead()
 {
+    if (followRedirects()
+        && d->http->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl().isValid()) {
+        d->http->readAll(); // the body of a redirect is not part of the file
+        return;
+    }
+
+    const int status = d->http->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status != 0 && status != 200 && status != 206) {
+        // an error page is not part of the file either, the partial file is kept as it is
+        d->http->readAll();
+        return;
+    }
+
+    if (!d->validated) {
+        d->validated = true;
+        d->resumable = status == 206 || (status == 200
+            && d->http->rawHeader("Accept-Ranges").trimmed().toLower() == "bytes");
+
+        if (d->resumeOffset > 0 && status == 206) {
+            // continue the checksum with the data downloaded before
+            QByteArray prefix(1024 * 1024, Qt::Uninitialized);
+            qint64 remaining = d->resumeOffset;
+            d->destination->seek(0);
+            while (remaining > 0) {
+                const qint64 read = d->destination->read(prefix.data(),
+                    qMin<qint64>(remaining, prefix.size()));
+                if (read <= 0)
+                    break;
+                addCheckSumData(prefix.constData(), read);
+                remaining -= read;
+            }
+            if (remaining > 0) {
+                const QString error = d->destination->errorString();
+                const QString fileName = d->destination->fileName();
+                d->shutDown();
+                setDownloadAborted(tr("Cannot download %1: Reading partial file '%2' failed: %3")
+                    .arg(url().toString(), fileName, error));
+                return;
+            }
+        } else {
+            // the server sends the whole file, start over
+            d->resumeOffset = 0;
+            d->destination->resize(0);
+            d->destination->seek(0);
+
+            if (!d->destFileName.isEmpty()) {
+                d->validator = rangeValidator(d->http);
+                QFile validator(d->validatorFileName());
+                if (d->validator.isEmpty() || !validator.open(QIODevice::WriteOnly)
+                    || validator.write(d->validator) != d->validator.size()) {
+                    validator.remove();
+                    d->resumable = false;   // could not be continued without a validator
+                }
+            }
+        }
+    }
+
     static QByteArray buffer(16384, '\0');
     while (d->http->bytesAvailable()) {
         const qint64 read = d->http->read(buffer.data(), buffer.size());
@@ -1170,6 +1395,17 @@ void KDUpdater::HttpDownloader::httpReadyRead()
 
 void KDUpdater::HttpDownloader::httpError(QNetworkReply::NetworkError)
 {
+    if (d->http && d->resumeOffset > 0
+        && d->http->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 416) {
+        // the partial file is complete already or does not match anymore, start over
+        const QUrl url = d->http->url();
+        d->shutDown();
+        d->removePartFile();
+        d->resumeOffset = 0;
+        startDownload(url);
+        return;
+    }
+
     if (!d->aborted)
         httpDone(true);
 }
@@ -1214,6 +1450,11 @@ void KDUpdater::HttpDownloader::httpDone(bool error)
 void KDUpdater::HttpDownloader::onError()
 {
     d->downloaded = false;
+    // keep a partial file only if the server is able to continue it
+    if (d->destination && !d->destFileName.isEmpty() && !d->resumable) {
+        d->destination->remove();
+        QFile::remove(d->validatorFileName());
+    }
     d->destFileName.clear();
     delete d->destination;
     d->destination = 0;
@@ -1227,12 +1468,24 @@ void KDUpdater::HttpDownloader::onError()
 void KDUpdater::HttpDownloader::onSuccess()
 {
     d->downloaded = true;
-    d->destFileName = d->destination->fileName();
+    const QString fileName = d->destination->fileName();
     if (QTemporaryFile *file = dynamic_cast<QTemporaryFile *>(d->destination))
         file->setAutoRemove(false);
     delete d->destination;
     d->destination = 0;
+
     stopDownloadSpeedTimer();
+    if (d->destFileName.isEmpty()) {
+        d->destFileName = fileName;
+        return;
+    }
+
+    QFile::remove(d->validatorFileName());
+    if (!moveIntoPlace(fileName, d->destFileName)) {
+        d->downloaded = false;
+        setDownloadAborted(tr("Could not rename %1 to %2.").arg(fileName, d->destFileName));
+        d->destFileName.clear();
+    }
 }
 
 void KDUpdater::HttpDownloader::httpReqFinished()
@@ -1249,7 +1502,10 @@ void KDUpdater::HttpDownloader::httpReqFinished()
             return;
 
         httpReadyRead();
+        if (!d->destination)
+            return; // aborted while reading
         d->destination->flush();
+        d->resumable = false;   // complete, a checksum mismatch must not be continued later
         setDownloadCompleted();
         d->http->deleteLater();
         d->http = 0;
@@ -1264,6 +1520,14 @@ void KDUpdater::HttpDownloader::httpReadProgress(qint64 done, qint64 total)
             return; // if we are a redirection, do not emit the progress
     }
 
+    if (d->resumeOffset > 0 && d->http
+        && d->http->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 206) {
+        // only the remaining part is transferred
+        done += d->resumeOffset;
+        if (total > 0)
+            total += d->resumeOffset;
+    }
+
     setProgress(done, total);
     emit downloadProgress(calcProgress(done, total));
 }
@@ -1285,7 +1549,16 @@ void KDUpdater::HttpDownloader::startDownload(const QUrl &url)
 {
     d->m_authenticationCount = 0;
     d->manager.setProxyFactory(proxyFactory());
-    d->http = d->manager.get(QNetworkRequest(url));
+
+    QNetworkRequest request(url);
+    if (d->resumeOffset > 0) {
+        // a changed file is sent as a whole instead of being continued
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(d->resumeOffset) + '-');
+        request.setRawHeader("If-Range", d->validator);
+    }
+    d->validated = false;
+    d->resumable = d->resumeOffset > 0;    // kept unless the server sends the whole file
+    d->http = d->manager.get(request);
 
     connect(d->http, SIGNAL(readyRead()), this, SLOT(httpReadyRead()));
     connect(d->http, SIGNAL(downloadProgress(qint64, qint64)), this,
@@ -1299,8 +1572,10 @@ void KDUpdater::HttpDownloader::startDownload(const QUrl &url)
         file->open();
         d->destination = file;
     } else {
-        d->destination = new QFile(d->destFileName, this);
-        d->destination->open(QIODevice::ReadWrite | QIODevice::Truncate);
+        // the content of the partial file is dropped once the server ignored the range
+        d->destination = new QFile(d->partFileName(), this);
+        d->destination->open(QIODevice::ReadWrite);
+        d->destination->seek(d->destination->size());
     }
 
     if (!d->destination->isOpen()) {
@@ -1397,3 +1672,751 @@ void KDUpdater::HttpDownloader::onSslErrors(QNetworkReply* reply, const QList<QS
     }
 }
 #endif
+
+
+// -- KDUpdater::SegmentedHttpDownloader
+
+struct KDUpdater::SegmentedHttpDownloader::Segment
+{
+    Segment()
+        : reply(0)
+        , begin(0)
+        , end(-1)
+        , pos(0)
+        , ranged(false)
+        , redirectCount(0)
+    {}
+
+    bool isComplete() const { return end >= 0 && pos > end; }
+
+    QNetworkReply *reply;
+    qint64 begin;
+    qint64 end;     // last byte of the segment, -1 if the size of the file is unknown
+    qint64 pos;     // offset the next received byte is written to
+    bool ranged;    // the bytes from pos to end are requested as a range
+    int redirectCount;
+};
+
+struct KDUpdater::SegmentedHttpDownloader::Private
+{
+    Private()
+        : head(0)
+        , destination(0)
+        , downloaded(false)
+        , aborted(false)
+        , resumable(false)
+        , restarted(false)
+        , askingProxyCredentials(false)
+        , redirectCount(0)
+        , segmentCount(4)
+        , segmentThreshold(64 * 1024 * 1024)
+        , size(-1)
+        , hashPos(0)
+        , buffer(65536, Qt::Uninitialized)
+    {}
+
+    QNetworkAccessManager manager;
+    QNetworkReply *head;
+    QFile *destination;
+    QString destFileName;
+    QUrl url;
+    bool downloaded;
+    bool aborted;
+    bool resumable;     // the partial file can be continued by a later download
+    bool restarted;     // the file changed after the HEAD request and the download started over
+    bool askingProxyCredentials;
+    int redirectCount;
+    int segmentCount;
+    qint64 segmentThreshold;
+    qint64 size;
+    qint64 hashPos;     // the checksum covers the file up to this offset
+    QByteArray validator;   // ETag or Last-Modified of the file, sent as If-Range
+    QByteArray buffer;
+    QVector<Segment> segments;  // ordered by offset
+    QAuthenticator proxyAuthenticator;
+
+    QString partFileName() const
+    {
+        return destFileName + QLatin1String(".part");
+    }
+
+    QString stateFileName() const
+    {
+        return destFileName + QLatin1String(".part.segments");
+    }
+
+    Segment *segment(QNetworkReply *reply)
+    {
+        for (int i = 0; i < segments.count(); ++i) {
+            if (segments.at(i).reply == reply)
+                return &segments[i];
+        }
+        return 0;
+    }
+
+    // Reads the segments an interrupted download of the current version of the file left behind.
+    // The state file holds the size and the validator of the file, followed by one
+    // "begin pos end" line per segment.
+    QVector<Segment> loadState() const
+    {
+        QFile file(stateFileName());
+        if (validator.isEmpty() || !file.open(QIODevice::ReadOnly))
+            return QVector<Segment>();
+
+        bool ok = false;
+        const QByteArray header = file.readLine().trimmed();
+        const int space = header.indexOf(' ');
+        if (space < 0 || header.left(space).toLongLong(&ok) != size || !ok
+            || header.mid(space + 1) != validator) {
+            return QVector<Segment>();
+        }
+
+        QVector<Segment> result;
+        while (!file.atEnd()) {
+            const QList<QByteArray> fields = file.readLine().trimmed().split(' ');
+            if (fields.count() != 3)
+                return QVector<Segment>();
+
+            bool beginOk = false, posOk = false, endOk = false;
+            Segment segment;
+            segment.begin = fields.at(0).toLongLong(&beginOk);
+            segment.pos = fields.at(1).toLongLong(&posOk);
+            segment.end = fields.at(2).toLongLong(&endOk);
+            segment.ranged = true;
+            const qint64 expectedBegin = result.isEmpty() ? 0 : result.last().end + 1;
+            if (!beginOk || !posOk || !endOk || segment.begin != expectedBegin
+                || segment.end < segment.begin || segment.pos < segment.begin
+                || segment.pos > segment.end + 1) {
+                return QVector<Segment>();
+            }
+            result.append(segment);
+        }
+        if (result.isEmpty() || result.last().end != size - 1
+            || QFileInfo(partFileName()).size() != size) {
+            return QVector<Segment>();
+        }
+        return result;
+    }
+
+    void saveState() const
+    {
+        QByteArray data = QByteArray::number(size) + ' ' + validator + '\n';
+        foreach (const Segment &segment, segments) {
+            data += QByteArray::number(segment.begin) + ' ' + QByteArray::number(segment.pos)
+                + ' ' + QByteArray::number(segment.end) + '\n';
+        }
+
+        QFile file(stateFileName());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size())
+            qDebug() << "Cannot write download state" << file.fileName() << ":" << file.errorString();
+    }
+};
+
+/*!
+    \internal
+    \class KDUpdater::SegmentedHttpDownloader
+
+    Downloads files of at least segmentThreshold() bytes in segmentCount() byte ranges over
+    parallel connections, each written at its offset into the preallocated target file. Smaller
+    files, or files from servers not accepting ranges, are downloaded with a single request.
+
+    Like HttpDownloader, a named download is written to a \c .part file next to the target. The
+    received ranges are recorded in a \c .part.segments file, so an interrupted download only
+    requests the missing ranges when started again. They are continued only if the ETag or
+    Last-Modified header of the file did not change, and are requested with If-Range. The checksum is calculated while the data
+    arrives in order, and from the written file for data that arrived ahead of it.
+*/
+
+/*!
+    Creates a segmented HTTP downloader with the parent \a parent.
+*/
+KDUpdater::SegmentedHttpDownloader::SegmentedHttpDownloader(QObject *parent)
+    : KDUpdater::FileDownloader(QLatin1String("http"), parent)
+    , d(new Private)
+{
+#ifndef QT_NO_OPENSSL
+    connect(&d->manager, SIGNAL(sslErrors(QNetworkReply*, QList<QSslError>)),
+        this, SLOT(onSslErrors(QNetworkReply*, QList<QSslError>)));
+#endif
+    connect(&d->manager, SIGNAL(authenticationRequired(QNetworkReply*, QAuthenticator*)), this,
+        SLOT(onAuthenticationRequired(QNetworkReply*, QAuthenticator*)));
+    connect(&d->manager, SIGNAL(proxyAuthenticationRequired(QNetworkProxy, QAuthenticator*)),
+        this, SLOT(onProxyAuthenticationRequired(QNetworkProxy, QAuthenticator*)));
+}
+
+/*!
+    Destroys the segmented HTTP downloader.
+
+    Removes the downloaded file if FileDownloader::isAutoRemoveDownloadedFile() returns \c true or
+    FileDownloader::setAutoRemoveDownloadedFile() was called with \c true.
+*/
+KDUpdater::SegmentedHttpDownloader::~SegmentedHttpDownloader()
+{
+    if (isAutoRemoveDownloadedFile() && !d->destFileName.isEmpty())
+        QFile::remove(d->destFileName);
+    delete d;
+}
+
+/*!
+    Returns \c true.
+*/
+bool KDUpdater::SegmentedHttpDownloader::canDownload() const
+{
+    return true;
+}
+
+/*!
+    Returns \c true if the file is downloaded.
+*/
+bool KDUpdater::SegmentedHttpDownloader::isDownloaded() const
+{
+    return d->downloaded;
+}
+
+/*!
+    Returns the file name of the downloaded file.
+*/
+QString KDUpdater::SegmentedHttpDownloader::downloadedFileName() const
+{
+    return d->destFileName;
+}
+
+/*!
+    Sets the file name of the downloaded file to \a name.
+*/
+void KDUpdater::SegmentedHttpDownloader::setDownloadedFileName(const QString &name)
+{
+    d->destFileName = name;
+}
+
+/*!
+    Clones the segmented HTTP downloader and assigns it the parent \a parent.
+*/
+KDUpdater::SegmentedHttpDownloader *KDUpdater::SegmentedHttpDownloader::clone(QObject *parent) const
+{
+    SegmentedHttpDownloader *downloader = new SegmentedHttpDownloader(parent);
+    downloader->setSegmentCount(d->segmentCount);
+    downloader->setSegmentThreshold(d->segmentThreshold);
+    return downloader;
+}
+
+/*!
+    Returns the number of parallel range requests used for large files.
+*/
+int KDUpdater::SegmentedHttpDownloader::segmentCount() const
+{
+    return d->segmentCount;
+}
+
+/*!
+    Sets the number of parallel range requests to \a count. As QNetworkAccessManager opens at most
+    six connections per host, the value is limited to the range from 1 to 6.
+*/
+void KDUpdater::SegmentedHttpDownloader::setSegmentCount(int count)
+{
+    d->segmentCount = qBound(1, count, 6);
+}
+
+/*!
+    Returns the minimum size in bytes a file must have to be downloaded in segments.
+*/
+qint64 KDUpdater::SegmentedHttpDownloader::segmentThreshold() const
+{
+    return d->segmentThreshold;
+}
+
+/*!
+    Sets the minimum size of files downloaded in segments to \a size bytes.
+*/
+void KDUpdater::SegmentedHttpDownloader::setSegmentThreshold(qint64 size)
+{
+    d->segmentThreshold = size;
+}
+
+/*!
+    Cancels downloading the file.
+*/
+void KDUpdater::SegmentedHttpDownloader::cancelDownload()
+{
+    if (!d->head && d->segments.isEmpty())
+        return;
+    d->aborted = true;
+    abortDownload(QString());
+}
+
+/*!
+    Keeps the partial file and its received ranges if the download can be resumed, removes them
+    otherwise, and stops the download speed timer.
+*/
+void KDUpdater::SegmentedHttpDownloader::onError()
+{
+    d->downloaded = false;
+    if (d->destination) {
+        if (d->resumable) {
+            d->destination->flush();
+            d->saveState();
+        } else {
+            d->destination->remove();
+            if (!d->destFileName.isEmpty())
+                QFile::remove(d->stateFileName());
+        }
+    }
+    delete d->destination;
+    d->destination = 0;
+    d->destFileName.clear();
+    stopDownloadSpeedTimer();
+}
+
+/*!
+    Moves the partial file into place after it has been successfully downloaded and stops the
+    download speed timer.
+*/
+void KDUpdater::SegmentedHttpDownloader::onSuccess()
+{
+    d->downloaded = true;
+    const QString fileName = d->destination->fileName();
+    if (QTemporaryFile *file = dynamic_cast<QTemporaryFile *>(d->destination))
+        file->setAutoRemove(false);
+    delete d->destination;
+    d->destination = 0;
+
+    stopDownloadSpeedTimer();
+    if (d->destFileName.isEmpty()) {
+        d->destFileName = fileName;
+        return;
+    }
+
+    QFile::remove(d->stateFileName());
+    if (!moveIntoPlace(fileName, d->destFileName)) {
+        d->downloaded = false;
+        setDownloadAborted(tr("Could not rename %1 to %2.").arg(fileName, d->destFileName));
+        d->destFileName.clear();
+    }
+}
+
+/*!
+    Called when the download timer event \a event occurs.
+*/
+void KDUpdater::SegmentedHttpDownloader::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == downloadSpeedTimerId()) {
+        if (d->resumable && d->destination && !d->segments.isEmpty()) {
+            d->destination->flush();    // the state must not claim data still buffered
+            d->saveState();
+        }
+        emitDownloadSpeed();
+        emitDownloadStatus();
+        emitDownloadProgress();
+        emitEstimatedDownloadTime();
+    }
+}
+
+void KDUpdater::SegmentedHttpDownloader::doDownload()
+{
+    if (d->downloaded || d->head || !d->segments.isEmpty())
+        return;
+
+    d->redirectCount = 0;
+    d->restarted = false;
+    d->manager.setProxyFactory(proxyFactory());
+    sendHeadRequest(url());
+    runDownloadSpeedTimer();
+}
+
+void KDUpdater::SegmentedHttpDownloader::headFinished()
+{
+    QNetworkReply *const reply = d->head;
+    d->head = 0;
+    if (!reply)
+        return;
+    reply->deleteLater();
+
+    const QUrl redirect = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    if (followRedirects() && redirect.isValid()) {
+        if (++d->redirectCount > 10) {
+            abortDownload(tr("Cannot download %1: Too many redirections.").arg(url().toString()));
+            return;
+        }
+        sendHeadRequest(reply->url().resolved(redirect));
+        return;
+    }
+
+    // Some servers do not answer HEAD requests, the single request then reports the actual error.
+    d->url = reply->url();
+    d->validator = rangeValidator(reply);
+    if (reply->error() != QNetworkReply::NoError) {
+        qDebug() << "Cannot determine size of" << d->url.toString() << ":" << reply->errorString();
+        startSegments(-1, false);
+        return;
+    }
+
+    bool ok = false;
+    const qint64 size = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+    startSegments(ok ? size : -1,
+        reply->rawHeader("Accept-Ranges").trimmed().toLower() == "bytes");
+}
+
+void KDUpdater::SegmentedHttpDownloader::segmentReadyRead()
+{
+    QNetworkReply *const reply = qobject_cast<QNetworkReply *>(sender());
+    if (d->segment(reply))
+        readSegment(reply);
+}
+
+void KDUpdater::SegmentedHttpDownloader::segmentFinished()
+{
+    QNetworkReply *const reply = qobject_cast<QNetworkReply *>(sender());
+    Segment *segment = d->segment(reply);
+    if (!segment)
+        return;
+
+    const QUrl redirect = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    if (followRedirects() && redirect.isValid()) {
+        segment->reply = 0;
+        reply->deleteLater();
+        if (++segment->redirectCount > 10) {
+            abortDownload(tr("Cannot download %1: Too many redirections.").arg(url().toString()));
+            return;
+        }
+        sendSegmentRequest(segment, reply->url().resolved(redirect));
+        return;
+    }
+
+    if (reply->error() != QNetworkReply::NoError) {
+        abortDownload(tr("Cannot download %1: %2").arg(url().toString(), reply->errorString()));
+        return;
+    }
+
+    if (!readSegment(reply))
+        return;
+
+    if (segment->end >= 0 && segment->pos != segment->end + 1) {
+        abortDownload(tr("Cannot download %1: Received %2 of %3 bytes for range starting at %4.")
+            .arg(url().toString()).arg(segment->pos - segment->begin)
+            .arg(segment->end - segment->begin + 1).arg(segment->begin));
+        return;
+    }
+
+    segment->reply = 0;
+    reply->deleteLater();
+
+    foreach (const Segment &other, d->segments) {
+        if (other.reply)
+            return; // wait for the remaining segments
+    }
+    finishDownload();
+}
+
+void KDUpdater::SegmentedHttpDownloader::onAuthenticationRequired(QNetworkReply *reply,
+    QAuthenticator *authenticator)
+{
+    Q_UNUSED(reply)
+    // QNAM fails the request if the same credentials have been rejected already
+    authenticator->setUser(this->authenticator().user());
+    authenticator->setPassword(this->authenticator().password());
+}
+
+void KDUpdater::SegmentedHttpDownloader::onProxyAuthenticationRequired(const QNetworkProxy &proxy,
+    QAuthenticator *authenticator)
+{
+    // All requests go through the same proxy, ask only once. The credentials are usually
+    // requested for the HEAD request, before the segments start.
+    if (d->proxyAuthenticator.user().isEmpty()) {
+        if (d->askingProxyCredentials)
+            return; // a concurrent segment, QNAM fails it without credentials
+
+        QDialog dlg;
+        Ui::Dialog ui;
+        ui.setupUi(&dlg);
+        dlg.adjustSize();
+        ui.siteDescription->setText(tr("%1 at %2").arg(authenticator->realm(), proxy.hostName()));
+        ui.userEdit->setText(proxy.user());
+        ui.passwordEdit->setText(proxy.password());
+
+        d->askingProxyCredentials = true;
+        const bool accepted = dlg.exec() == QDialog::Accepted;
+        d->askingProxyCredentials = false;
+        if (!accepted) {
+            d->aborted = true;
+            abortDownload(QString());
+            return;
+        }
+        d->proxyAuthenticator.setUser(ui.userEdit->text());
+        d->proxyAuthenticator.setPassword(ui.passwordEdit->text());
+    }
+    // QNAM fails the request if the same credentials have been rejected already
+    authenticator->setUser(d->proxyAuthenticator.user());
+    authenticator->setPassword(d->proxyAuthenticator.password());
+}
+
+#ifndef QT_NO_OPENSSL
+void KDUpdater::SegmentedHttpDownloader::onSslErrors(QNetworkReply *reply,
+    const QList<QSslError> &errors)
+{
+    foreach (const QSslError &error, errors)
+        qDebug() << error.errorString();
+    if (ignoreSslErrors())
+        reply->ignoreSslErrors();
+}
+#endif
+
+void KDUpdater::SegmentedHttpDownloader::sendHeadRequest(const QUrl &url)
+{
+    d->head = d->manager.head(QNetworkRequest(url));
+    connect(d->head, SIGNAL(finished()), this, SLOT(headFinished()));
+}
+
+void KDUpdater::SegmentedHttpDownloader::sendSegmentRequest(Segment *segment,
+    const QUrl &url)
+{
+    QNetworkRequest request(url);
+    if (segment->ranged) {
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(segment->pos) + '-'
+            + QByteArray::number(segment->end));
+        if (!d->validator.isEmpty())
+            request.setRawHeader("If-Range", d->validator);   // a changed file is sent as a whole
+    }
+    segment->reply = d->manager.get(request);
+    connect(segment->reply, SIGNAL(readyRead()), this, SLOT(segmentReadyRead()));
+    connect(segment->reply, SIGNAL(finished()), this, SLOT(segmentFinished()));
+}
+
+void KDUpdater::SegmentedHttpDownloader::startSegments(qint64 size, bool acceptsRanges)
+{
+    d->size = size;
+    d->hashPos = 0;
+    d->segments.clear();
+    resetCheckSumData();
+    // without a validator it cannot be told whether the partial file belongs to the same file
+    d->resumable = acceptsRanges && size > 0 && !d->destFileName.isEmpty()
+        && !d->validator.isEmpty();
+
+    if (d->destFileName.isEmpty()) {
+        QTemporaryFile *file = new QTemporaryFile(this);
+        file->open();
+        d->destination = file;
+    } else {
+        // a partial file without state was written by a single request from the start
+        QFile validator(d->partFileName() + QLatin1String(".validator"));
+        const bool singleRequest = validator.open(QIODevice::ReadOnly)
+            && validator.readAll().trimmed() == d->validator;
+        validator.close();
+        validator.remove();     // superseded by the state file
+
+        if (d->resumable) {
+            d->segments = d->loadState();
+            const qint64 written = QFileInfo(d->partFileName()).size();
+            if (d->segments.isEmpty() && singleRequest && written > 0 && written < size
+                && !QFile::exists(d->stateFileName())) {
+                Segment received;
+                received.end = written - 1;
+                received.pos = written;
+                d->segments.append(received);
+            }
+        }
+        if (d->segments.isEmpty())
+            QFile::remove(d->stateFileName());
+        d->destination = new QFile(d->partFileName(), this);
+        d->destination->open(QIODevice::ReadWrite);
+    }
+
+    if (!d->destination->isOpen()) {
+        abortDownload(tr("Cannot download %1: Could not create %2: %3").arg(url().toString(),
+            d->destination->fileName(), d->destination->errorString()));
+        return;
+    }
+
+    if ((d->segments.isEmpty() && !d->destination->resize(0))
+        || (size > 0 && !d->destination->resize(size))) {
+        abortDownload(tr("Cannot download %1: Could not allocate %2 bytes for %3: %4")
+            .arg(url().toString()).arg(size).arg(d->destination->fileName(),
+            d->destination->errorString()));
+        return;
+    }
+
+    if (!acceptsRanges || size <= 0) {
+        Segment whole;
+        whole.end = size - 1;
+        d->segments.append(whole);
+    } else if (d->segments.isEmpty() || d->segments.last().end < size - 1) {
+        // split the bytes not received yet
+        const qint64 begin = d->segments.isEmpty() ? 0 : d->segments.last().end + 1;
+        const qint64 length = size - begin;
+        const int count = length >= d->segmentThreshold ? d->segmentCount : 1;
+        for (int i = 0; i < count; ++i) {
+            Segment segment;
+            segment.begin = begin + i * (length / count);
+            segment.end = (i == count - 1) ? size - 1 : begin + (i + 1) * (length / count) - 1;
+            segment.pos = segment.begin;
+            segment.ranged = count > 1 || begin > 0;
+            d->segments.append(segment);
+        }
+    }
+
+    if (d->resumable)
+        d->saveState();
+
+    qint64 received = 0;
+    for (int i = 0; i < d->segments.count(); ++i) {
+        Segment &segment = d->segments[i];
+        received += segment.pos - segment.begin;
+        if (!segment.isComplete())
+            sendSegmentRequest(&segment, d->url);
+    }
+    setProgress(received, qMax(size, qint64(0)));
+
+    foreach (const Segment &segment, d->segments) {
+        if (segment.reply)
+            return;
+    }
+    finishDownload();   // an earlier download received everything
+}
+
+bool KDUpdater::SegmentedHttpDownloader::readSegment(QNetworkReply *reply)
+{
+    Segment *const segment = d->segment(reply);
+    if (followRedirects()
+        && reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl().isValid()) {
+        reply->readAll();   // the body of a redirection is not part of the file
+        return true;
+    }
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (segment->ranged && status == 200 && !d->validator.isEmpty() && !d->restarted) {
+        restartDownload();  // the file changed since the HEAD request, If-Range sent all of it
+        return false;
+    }
+    if (segment->ranged ? status != 206 : (status < 200 || status >= 300)) {
+        if (!reply->bytesAvailable())
+            return true;    // e.g. an error without body, reported once finished
+        abortDownload(tr("Cannot download %1: Unexpected response %2 %3.").arg(url().toString())
+            .arg(status).arg(reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute)
+            .toString()));
+        return false;
+    }
+
+    qint64 bytesRead = 0;
+    while (reply->bytesAvailable()) {
+        const qint64 read = reply->read(d->buffer.data(), d->buffer.size());
+        if (read <= 0)
+            break;
+        if (segment->end >= 0 && segment->pos + read > segment->end + 1) {
+            abortDownload(tr("Cannot download %1: Received more data than requested for range "
+                "starting at %2.").arg(url().toString()).arg(segment->begin));
+            return false;
+        }
+
+        if (!d->destination->seek(segment->pos)
+            || d->destination->write(d->buffer.constData(), read) != read) {
+            abortDownload(tr("Cannot download %1: Writing to file '%2' failed: %3").arg(url()
+                .toString(), d->destination->fileName(), d->destination->errorString()));
+            return false;
+        }
+        if (segment->pos == d->hashPos) {
+            addCheckSumData(d->buffer.constData(), read);
+            d->hashPos += read;
+        }
+        segment->pos += read;
+        bytesRead += read;
+        addSample(read);
+    }
+
+    // catch up with data that arrived ahead of the checksum, at most as much as was received
+    if (!hashWritten(bytesRead))
+        return false;
+
+    qint64 received = 0;
+    foreach (const Segment &each, d->segments)
+        received += each.pos - each.begin;
+    setProgress(received, qMax(d->size, qint64(0)));
+    emit downloadProgress(calcProgress(received, qMax(d->size, qint64(0))));
+    return true;
+}
+
+bool KDUpdater::SegmentedHttpDownloader::hashWritten(qint64 maxBytes)
+{
+    for (int i = 0; i < d->segments.count() && maxBytes > 0; ++i) {
+        const Segment &segment = d->segments.at(i);
+        if (segment.isComplete() && segment.end < d->hashPos)
+            continue;
+
+        while (maxBytes > 0 && d->hashPos < segment.pos) {
+            const qint64 length = qMin(qMin(segment.pos - d->hashPos, maxBytes),
+                qint64(d->buffer.size()));
+            if (!d->destination->seek(d->hashPos)
+                || d->destination->read(d->buffer.data(), length) != length) {
+                abortDownload(tr("Cannot download %1: Reading file '%2' failed: %3").arg(url()
+                    .toString(), d->destination->fileName(), d->destination->errorString()));
+                return false;
+            }
+            addCheckSumData(d->buffer.constData(), length);
+            d->hashPos += length;
+            maxBytes -= length;
+        }
+        if (!segment.isComplete() || d->hashPos <= segment.end)
+            break;  // the following data is not contiguous yet
+    }
+    return true;
+}
+
+void KDUpdater::SegmentedHttpDownloader::finishDownload()
+{
+    if (!hashWritten(std::numeric_limits<qint64>::max()))
+        return;
+
+    // a complete file failing the checksum must not be continued by a later download
+    d->resumable = false;
+    d->segments.clear();
+    d->destination->flush();
+    setDownloadCompleted();
+}
+
+void KDUpdater::SegmentedHttpDownloader::restartDownload()
+{
+    qDebug() << "Restarting download of" << url().toString() << ": The file has changed.";
+    for (int i = 0; i < d->segments.count(); ++i) {
+        QNetworkReply *const reply = d->segments.at(i).reply;
+        if (!reply)
+            continue;
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+    d->segments.clear();
+    delete d->destination;
+    d->destination = 0;
+    if (!d->destFileName.isEmpty())
+        QFile::remove(d->stateFileName());
+
+    d->restarted = true;
+    d->redirectCount = 0;
+    sendHeadRequest(url());
+}
+
+void KDUpdater::SegmentedHttpDownloader::abortDownload(const QString &error)
+{
+    if (d->head) {
+        d->head->disconnect(this);
+        d->head->abort();
+        d->head->deleteLater();
+        d->head = 0;
+    }
+    for (int i = 0; i < d->segments.count(); ++i) {
+        QNetworkReply *const reply = d->segments.at(i).reply;
+        if (!reply)
+            continue;
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+        d->segments[i].reply = 0;
+    }
+    onError();  // records the received ranges of a resumable download
+    d->segments.clear();
+
+    if (d->aborted) {
+        d->aborted = false;
+        setDownloadCanceled();
+    } else {
+        setDownloadAborted(error);
+    }
+}
@@ -31,6 +31,7 @@
 
 #include "kdupdaterfiledownloader.h"
 
+#include <QtNetwork/QNetworkProxy>
 #include <QtNetwork/QNetworkReply>
 
 // these classes are not a part of the public API
@@ -61,6 +62,11 @@ protected:
 
 private Q_SLOTS:
     void doDownload();
+    void transferFinished();
+
+private:
+    void transferFile();
+    void reportProgress();
 
 private:
     struct Private;
@@ -139,6 +145,63 @@ private:
     Private *d;
 };
 
+class SegmentedHttpDownloader : public FileDownloader
+{
+    Q_OBJECT
+
+public:
+    explicit SegmentedHttpDownloader(QObject *parent = 0);
+    ~SegmentedHttpDownloader();
+
+    bool canDownload() const;
+    bool isDownloaded() const;
+    QString downloadedFileName() const;
+    void setDownloadedFileName(const QString &name);
+    SegmentedHttpDownloader *clone(QObject *parent = 0) const;
+
+    int segmentCount() const;
+    void setSegmentCount(int count);
+
+    qint64 segmentThreshold() const;
+    void setSegmentThreshold(qint64 size);
+
+public Q_SLOTS:
+    void cancelDownload();
+
+protected:
+    void onError();
+    void onSuccess();
+    void timerEvent(QTimerEvent *event);
+
+private Q_SLOTS:
+    void doDownload();
+
+    void headFinished();
+    void segmentReadyRead();
+    void segmentFinished();
+    void onAuthenticationRequired(QNetworkReply *reply, QAuthenticator *authenticator);
+    void onProxyAuthenticationRequired(const QNetworkProxy &proxy, QAuthenticator *authenticator);
+#ifndef QT_NO_OPENSSL
+    void onSslErrors(QNetworkReply *reply, const QList<QSslError> &errors);
+#endif
+
+private:
+    struct Segment;
+
+    void sendHeadRequest(const QUrl &url);
+    void sendSegmentRequest(Segment *segment, const QUrl &url);
+    void startSegments(qint64 size, bool acceptsRanges);
+    bool readSegment(QNetworkReply *reply);
+    bool hashWritten(qint64 maxBytes);
+    void finishDownload();
+    void restartDownload();
+    void abortDownload(const QString &error);
+
+private:
+    struct Private;
+    Private *d;
+};
+
 } // namespace KDUpdater
 
 #endif // KD_UPDATER_FILE_DOWNLOADER_P_H
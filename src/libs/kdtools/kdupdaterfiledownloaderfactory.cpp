@@ -115,6 +115,41 @@ void FileDownloaderFactory::setIgnoreSslErrors(bool ignore)
     FileDownloaderFactory::instance().d->m_ignoreSslErrors = ignore;
 }
 
+/*!
+    Returns the number of segments large files are downloaded in over HTTP. The default value \c 1
+    disables segmented downloads.
+*/
+int FileDownloaderFactory::downloadSegments()
+{
+    return FileDownloaderFactory::instance().d->m_downloadSegments;
+}
+
+/*!
+    Downloads files of at least segmentThreshold() bytes in \a count byte ranges over parallel
+    connections, if the server accepts range requests. The value is limited to the range from
+    1 to 6, \c 1 disables segmented downloads.
+*/
+void FileDownloaderFactory::setDownloadSegments(int count)
+{
+    FileDownloaderFactory::instance().d->m_downloadSegments = qBound(1, count, 6);
+}
+
+/*!
+    Returns the minimum size in bytes of a file to be downloaded in segments.
+*/
+qint64 FileDownloaderFactory::segmentThreshold()
+{
+    return FileDownloaderFactory::instance().d->m_segmentThreshold;
+}
+
+/*!
+    Sets the minimum size of a file to be downloaded in segments to \a size bytes.
+*/
+void FileDownloaderFactory::setSegmentThreshold(qint64 size)
+{
+    FileDownloaderFactory::instance().d->m_segmentThreshold = size;
+}
+
 /*!
     Destroys the file downloader factory.
 */
@@ -143,13 +178,24 @@ bool FileDownloaderFactory::isSupportedScheme(const QString &scheme)
 /*!
      Returns a new instance of a KDUpdater::FileDownloader subclass. The
      instantiation of a subclass depends on the communication protocol string
-     stored in \a scheme with the parent \a parent.
+     stored in \a scheme with the parent \a parent. If downloadSegments() is greater than \c 1,
+     HTTP and HTTPS downloads use a downloader fetching large files in segments.
 
      \note Ownership of the created object remains with the programmer.
 */
 FileDownloader *FileDownloaderFactory::create(const QString &scheme, QObject *parent) const
 {
-    FileDownloader *downloader = KDGenericFactory<FileDownloader>::create(scheme);
+    FileDownloader *downloader = 0;
+    if (d->m_downloadSegments > 1 && d->m_supportedSchemes.contains(scheme)
+        && (scheme == QLatin1String("http") || scheme == QLatin1String("https"))) {
+        SegmentedHttpDownloader *segmented = new SegmentedHttpDownloader;
+        segmented->setSegmentCount(d->m_downloadSegments);
+        segmented->setSegmentThreshold(d->m_segmentThreshold);
+        downloader = segmented;
+    } else {
+        downloader = KDGenericFactory<FileDownloader>::create(scheme);
+    }
+
     if (downloader != 0) {
         downloader->setParent(parent);
         downloader->setScheme(scheme);
@@ -56,11 +56,14 @@ class KDTOOLS_EXPORT FileDownloaderFactory : public KDGenericFactory<FileDownloa
 {
     Q_DISABLE_COPY(FileDownloaderFactory)
     struct FileDownloaderFactoryData {
-        FileDownloaderFactoryData() : m_factory(0) {}
+        FileDownloaderFactoryData() : m_factory(0), m_downloadSegments(1),
+            m_segmentThreshold(64 * 1024 * 1024) {}
         ~FileDownloaderFactoryData() { delete m_factory; }
 
         bool m_followRedirects;
         bool m_ignoreSslErrors;
+        int m_downloadSegments;
+        qint64 m_segmentThreshold;
         QStringList m_supportedSchemes;
         FileDownloaderProxyFactory *m_factory;
     };
@@ -85,6 +88,12 @@ public:
     static bool ignoreSslErrors();
     static void setIgnoreSslErrors(bool ignore);
 
+    static int downloadSegments();
+    static void setDownloadSegments(int count);
+
+    static qint64 segmentThreshold();
+    static void setSegmentThreshold(qint64 size);
+
     static QStringList supportedSchemes();
     static bool isSupportedScheme(const QString &scheme);
 
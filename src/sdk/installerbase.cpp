@@ -56,6 +56,7 @@
 #include <packagemanagergui.h>
 #include <qinstallerglobal.h>
 #include <settings.h>
+#include <trace.h>
 #include <utils.h>
 #include <updater.h>
 #include <messageboxhandler.h>
@@ -271,6 +272,21 @@ int main(int argc, char *argv[])
             QInstaller::setVerbose(true);
         }
 
+        const int traceIndex = args.indexOf(QLatin1String("--trace"));
+        if (traceIndex >= 0) {
+            const QString traceFile = args.value(traceIndex + 1);
+            if (traceFile.isEmpty()) {
+                std::cerr << QFileInfo(app.applicationFilePath()).fileName() << " --trace [missing "
+                    "argument]" << std::endl;
+                return PackageManagerCore::Failure;
+            }
+            QInstaller::Trace::setOutputFile(QFileInfo(traceFile).absoluteFilePath());
+
+            // consume the arguments to avoid "Unknown option" output
+            args.removeAt(traceIndex + 1);
+            args.removeAt(traceIndex);
+        }
+
         if (QInstaller::isVerbose()) {
             qDebug() << VERSION;
             qDebug() << "Arguments:" << args;
@@ -223,6 +223,10 @@ void InstallerBase::showUsage()
     std::cout << std::setw(WIDTH1) << std::setiosflags(std::ios::left)
         << "  --binarydatafile [binary_data_file]" << std::setw(WIDTH2) << "Use the binary data of "
         "another installer or maintenance tool." << std::endl;
+    std::cout << std::setw(WIDTH1) << std::setiosflags(std::ios::left) << "  --trace [file]"
+        << std::setw(WIDTH2) << "Write the time spent in each installation phase, component" << std::endl
+        << std::setw(WIDTH1) << " " << std::setw(WIDTH2) << "and operation to file in the Chrome trace" << std::endl
+        << std::setw(WIDTH1) << " " << std::setw(WIDTH2) << "format." << std::endl;
     std::cout << std::setw(WIDTH1) << std::setiosflags(std::ios::left)
         << "  --update-installerbase [new_installerbase]" << std::setw(WIDTH2)
         << "Patch a full installer with a new installer base" << std::endl;
@@ -40,9 +40,12 @@
 **************************************************************************/
 
 #include <binaryformat.h>
+#include <binaryformatenginehandler.h>
 #include <errors.h>
 #include <fileutils.h>
 
+#include <QDir>
+#include <QFileInfo>
 #include <QTest>
 #include <QTemporaryFile>
 
@@ -90,6 +93,28 @@ private slots:
         }
     }
 
+    void findMagicCookieAtEndOfFile()
+    {
+        QTemporaryFile file;
+        file.open();
+
+        try {
+            QInstaller::blockingWrite(&file, QByteArray(scLargeSize, '1'));
+            QInstaller::appendInt64(&file, QInstaller::MagicCookie);
+            QInstaller::blockingWrite(&file, QByteArray(scTinySize, '2'));
+            QInstaller::appendInt64(&file, QInstaller::MagicCookie);
+            file.seek(42);
+
+            QCOMPARE(QInstaller::findMagicCookie(&file, QInstaller::MagicCookie),
+                scLargeSize + qint64(sizeof(qint64)) + scTinySize);
+            QCOMPARE(file.pos(), 42LL);
+        } catch (const QInstaller::Error &error) {
+            QFAIL(qPrintable(error.message()));
+        } catch (...) {
+            QFAIL("Unexpected error.");
+        }
+    }
+
     void testFindMagicCookieWithError()
     {
         QTest::ignoreMessage(QtDebugMsg, "create Error-Exception: \"No marker found, stopped after 71.00 KiB.\" ");
@@ -108,6 +133,42 @@ private slots:
             QFAIL("Unexpected error.");
         }
     }
+
+    void registeredArchiveLookup()
+    {
+        QTemporaryFile archive;
+        QVERIFY(archive.open());
+        QInstaller::blockingWrite(&archive, QByteArray(scTinySize, '1'));
+        archive.close();
+
+        QInstallerCreator::BinaryFormatEngineHandler handler((QInstallerCreator::ComponentIndex()));
+        handler.registerArchive(QLatin1String("installer://A/1.0data.7z"), archive.fileName());
+        handler.registerArchive(QLatin1String("installer://A/1.0meta.7z"), archive.fileName());
+        handler.registerArchive(QLatin1String("installer://B/1.0data.7z/"), archive.fileName());
+
+        QFile file(QLatin1String("installer://A/1.0data.7z"));
+        QVERIFY(file.exists());
+        QCOMPARE(file.size(), scTinySize);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readAll(), QByteArray(scTinySize, '1'));
+        file.close();
+
+        QVERIFY(QFileInfo(QLatin1String("installer://B/1.0data.7z")).isFile());
+        QVERIFY(!QFileInfo(QLatin1String("installer://B/1.0meta.7z")).exists());
+        QVERIFY(QFileInfo(QLatin1String("installer://A")).isDir());
+
+        QStringList archives = QDir(QLatin1String("installer://A")).entryList(QDir::Files);
+        archives.sort();
+        QCOMPARE(archives, QStringList() << QLatin1String("1.0data.7z")
+            << QLatin1String("1.0meta.7z"));
+
+        // ordinary paths are not handled by the engine
+        QVERIFY(QFileInfo(archive.fileName()).isFile());
+        QVERIFY(!QFileInfo(QLatin1String("install/A/1.0data.7z")).exists());
+
+        handler.resetRegisteredArchives();
+        QVERIFY(!QFile::exists(QLatin1String("installer://A/1.0data.7z")));
+    }
 };
 
 QTEST_MAIN(tst_BinaryFormat)
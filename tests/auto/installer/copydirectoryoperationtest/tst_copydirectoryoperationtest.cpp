@@ -0,0 +1,175 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+
+#include "filetesthelpers.h"
+
+#include <copydirectoryoperation.h>
+#include <errors.h>
+#include <fileutils.h>
+
+#include <QDir>
+#include <QFile>
+#include <QObject>
+#include <QTest>
+
+using namespace KDUpdater;
+using namespace QInstaller;
+
+class tst_copydirectoryoperationtest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QByteArray patternData(int size)
+    {
+        QByteArray data(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i)
+            data[i] = char(i % 251);
+        return data;
+    }
+
+private slots:
+    void init()
+    {
+        m_source = m_directories.create(QLatin1String("copydirectory-source"));
+        m_target = m_directories.create(QLatin1String("copydirectory-target"));
+
+        m_tree = m_source + QLatin1String("/tree");
+        QVERIFY(QDir(m_tree).mkpath(QLatin1String("sub/deeper")));
+        writeFile(m_tree + QLatin1String("/file.txt"), "file");
+        writeFile(m_tree + QLatin1String("/sub/deeper/data.bin"), patternData(5 * 1024 * 1024 + 7));
+    }
+
+    void cleanup()
+    {
+        m_directories.removeAll();
+    }
+
+    void testCopyFile_data()
+    {
+        QTest::addColumn<int>("size");
+        QTest::newRow("empty") << 0;
+        QTest::newRow("small") << 100;
+        QTest::newRow("odd sized") << 3 * 64 * 1024 + 1;
+        QTest::newRow("several blocks") << 9 * 1024 * 1024 + 13;
+    }
+
+    void testCopyFile()
+    {
+        QFETCH(int, size);
+
+        const QByteArray content = patternData(size);
+        const QString source = m_source + QLatin1String("/source.bin");
+        const QString target = m_target + QLatin1String("/target.bin");
+        writeFile(source, content);
+        QVERIFY(QFile::setPermissions(source, QFile::ReadOwner | QFile::WriteOwner
+            | QFile::ExeOwner));
+
+        // an existing target is replaced, not appended to
+        writeFile(target, QByteArray(size + 100, 'x'));
+
+        try {
+            copyFile(source, target);
+        } catch (const Error &e) {
+            QFAIL(qPrintable(e.message()));
+        }
+        QCOMPARE(readFile(target), content);
+        QVERIFY(QFileInfo(target).permissions() & QFile::ExeOwner);
+    }
+
+    void testCopyBufferSize()
+    {
+        QCOMPARE(copyBufferSize(0), qint64(64 * 1024));
+        QCOMPARE(copyBufferSize(16 * 1024 * 1024), qint64(1024 * 1024));
+        QCOMPARE(copyBufferSize(Q_INT64_C(10) * 1024 * 1024 * 1024), qint64(4 * 1024 * 1024));
+    }
+
+    void testCopyDirectoryAndUndo()
+    {
+        CopyDirectoryOperation op;
+        op.setArguments(QStringList() << m_tree << m_target);
+        op.backup();
+        QVERIFY2(op.performOperation(), qPrintable(op.errorString()));
+
+        const QString target = m_target + QLatin1String("/tree");
+        QCOMPARE(readFile(target + QLatin1String("/file.txt")), QByteArray("file"));
+        QCOMPARE(readFile(target + QLatin1String("/sub/deeper/data.bin")),
+            patternData(5 * 1024 * 1024 + 7));
+
+        QCOMPARE(op.value(QLatin1String("files")).type(), QVariant::String);
+        const QStringList files = fileManifestPaths(op.value(QLatin1String("files")));
+        QCOMPARE(files.count(), 2);
+        QVERIFY(files.contains(QDir(m_target).absoluteFilePath(QLatin1String("tree/file.txt"))));
+
+        QVERIFY2(op.undoOperation(), qPrintable(op.errorString()));
+        QVERIFY(!QFile::exists(target + QLatin1String("/file.txt")));
+        QVERIFY(!QFileInfo(target + QLatin1String("/sub")).exists());
+    }
+
+    void testExistingTargetWithoutOverwrite()
+    {
+        QVERIFY(QDir(m_target).mkpath(QLatin1String("tree")));
+        writeFile(m_target + QLatin1String("/tree/file.txt"), "existing");
+
+        CopyDirectoryOperation op;
+        op.setArguments(QStringList() << m_tree << m_target);
+        QVERIFY(!op.performOperation());
+        QCOMPARE(UpdateOperation::Error(op.error()), UpdateOperation::UserDefinedError);
+        QCOMPARE(readFile(m_target + QLatin1String("/tree/file.txt")), QByteArray("existing"));
+
+        CopyDirectoryOperation overwriteOp;
+        overwriteOp.setArguments(QStringList() << m_tree << m_target
+            << QLatin1String("forceOverwrite"));
+        QVERIFY2(overwriteOp.performOperation(), qPrintable(overwriteOp.errorString()));
+        QCOMPARE(readFile(m_target + QLatin1String("/tree/file.txt")), QByteArray("file"));
+    }
+
+    void testUndoLegacyFileList()
+    {
+        QVERIFY(QDir(m_target).mkpath(QLatin1String("tree/sub")));
+        const QString file = m_target + QLatin1String("/tree/sub/legacy.txt");
+        writeFile(file, "legacy");
+
+        CopyDirectoryOperation op;
+        op.setArguments(QStringList() << m_tree << m_target);
+        op.setValue(QLatin1String("files"), QStringList() << file);
+        QVERIFY2(op.undoOperation(), qPrintable(op.errorString()));
+        QVERIFY(!QFile::exists(file));
+    }
+
+private:
+    TemporaryDirectories m_directories;
+    QString m_source;
+    QString m_target;
+    QString m_tree;
+};
+
+QTEST_MAIN(tst_copydirectoryoperationtest)
+
+#include "tst_copydirectoryoperationtest.moc"
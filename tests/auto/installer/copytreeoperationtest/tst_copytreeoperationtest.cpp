@@ -0,0 +1,141 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+#include "filetesthelpers.h"
+
+#include <copytreeoperation.h>
+#include <fileutils.h>
+
+#include <QDir>
+#include <QFile>
+#include <QObject>
+#include <QTest>
+
+using namespace KDUpdater;
+using namespace QInstaller;
+
+class tst_copytreeoperationtest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init()
+    {
+        m_source = m_directories.create(QLatin1String("copytree-source"));
+        m_target = m_directories.create(QLatin1String("copytree-target"));
+
+        QVERIFY(QDir(m_source).mkpath(QLatin1String("sub/deeper")));
+        writeFile(m_source + QLatin1String("/file.txt"), "file");
+        writeFile(m_source + QLatin1String("/file.txt.sha1"), "checksum");
+        writeFile(m_source + QLatin1String("/sub/deeper/data.bin"), QByteArray(3 * 1024 * 1024, 'x'));
+    }
+
+    void cleanup()
+    {
+        m_directories.removeAll();
+    }
+
+    void testMissingArguments()
+    {
+        CopyTreeOperation op;
+
+        QVERIFY(op.testOperation());
+        QVERIFY(!op.performOperation());
+
+        QCOMPARE(UpdateOperation::Error(op.error()), UpdateOperation::InvalidArguments);
+        QCOMPARE(op.errorString(), QString("Invalid arguments in CopyTree: 0 arguments given, "
+            "2 or 3 expected (<source> <target> [skipChecksumFiles])."));
+    }
+
+    void testCopyTreeAndUndo()
+    {
+        const QString target = m_target + QLatin1String("/new/tree");
+
+        CopyTreeOperation op;
+        op.setArguments(QStringList() << m_source << target << QLatin1String("skipChecksumFiles"));
+        op.backup();
+        QVERIFY2(op.performOperation(), qPrintable(op.errorString()));
+
+        QCOMPARE(readFile(target + QLatin1String("/file.txt")), QByteArray("file"));
+        QCOMPARE(readFile(target + QLatin1String("/sub/deeper/data.bin")),
+            QByteArray(3 * 1024 * 1024, 'x'));
+        QVERIFY(!QFile::exists(target + QLatin1String("/file.txt.sha1")));
+
+        // the manifest is a compact list of relative paths
+        QCOMPARE(fileManifestPaths(op.value(QLatin1String("files"))), QStringList()
+            << QLatin1String("file.txt") << QLatin1String("sub/deeper/data.bin"));
+
+        QVERIFY2(op.undoOperation(), qPrintable(op.errorString()));
+        QVERIFY(!QFileInfo(m_target + QLatin1String("/new")).exists());
+        QVERIFY(QFileInfo(m_target).isDir());
+    }
+
+    void testOverwriteAndRestore()
+    {
+        writeFile(m_target + QLatin1String("/file.txt"), "existing");
+        writeFile(m_target + QLatin1String("/other.txt"), "other");
+
+        CopyTreeOperation op;
+        op.setArguments(QStringList() << m_source << m_target);
+        op.backup();
+        QVERIFY2(op.performOperation(), qPrintable(op.errorString()));
+
+        QCOMPARE(readFile(m_target + QLatin1String("/file.txt")), QByteArray("file"));
+        QCOMPARE(readFile(m_target + QLatin1String("/file.txt.sha1")), QByteArray("checksum"));
+        QVERIFY(!op.toXml().toString().contains(QLatin1String("backups")));
+
+        QVERIFY2(op.undoOperation(), qPrintable(op.errorString()));
+        QCOMPARE(readFile(m_target + QLatin1String("/file.txt")), QByteArray("existing"));
+        QCOMPARE(readFile(m_target + QLatin1String("/other.txt")), QByteArray("other"));
+        QVERIFY(!QFile::exists(m_target + QLatin1String("/file.txt.sha1")));
+        QVERIFY(!QFileInfo(m_target + QLatin1String("/sub")).exists());
+    }
+
+    void testUndoMalformedManifest()
+    {
+        CopyTreeOperation op;
+        op.setArguments(QStringList() << m_source << m_target);
+        op.backup();
+        QVERIFY2(op.performOperation(), qPrintable(op.errorString()));
+
+        op.setValue(QLatin1String("files"), QLatin1String("file.txt"));
+        QVERIFY(!op.undoOperation());
+        QCOMPARE(UpdateOperation::Error(op.error()), UpdateOperation::UserDefinedError);
+        QCOMPARE(op.errorString(), QString("Malformed file manifest at position 0."));
+        QVERIFY(QFile::exists(m_target + QLatin1String("/file.txt")));
+    }
+
+private:
+    TemporaryDirectories m_directories;
+    QString m_source;
+    QString m_target;
+};
+
+QTEST_MAIN(tst_copytreeoperationtest)
+
+#include "tst_copytreeoperationtest.moc"
@@ -0,0 +1,113 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+#include <errors.h>
+#include <fileutils.h>
+
+#include <QObject>
+#include <QTest>
+
+using namespace QInstaller;
+
+class tst_fileutils : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testFileManifest()
+    {
+        const QStringList paths = QStringList() << QLatin1String("/opt/app/bin/tool")
+            << QLatin1String("/opt/app/bin/tool2") << QLatin1String("/opt/app/lib/lib 1.so")
+            << QLatin1String("/opt/app/lib") << QLatin1String("/opt/other") << QString();
+
+        const QString manifest = fileManifest(paths);
+        QCOMPARE(manifest, QString::fromLatin1("0 /opt/app/bin/tool\n17 2\n9 lib/lib 1.so\n"
+            "12 \n5 other\n0 \n"));
+        QCOMPARE(fileManifestPaths(manifest), paths);
+
+        // lists stored by older installers are read as they are
+        QCOMPARE(fileManifestPaths(QVariant(paths)), paths);
+        QCOMPARE(fileManifestPaths(QVariant()), QStringList());
+    }
+
+    void testFileManifestEscaping()
+    {
+        const QStringList paths = QStringList() << QLatin1String("/opt/line\nbreak")
+            << QLatin1String("/opt/line\nbreak\\n") << QLatin1String("C:\\app\\bin");
+
+        const QString manifest = fileManifest(paths);
+        QCOMPARE(manifest, QString::fromLatin1("0 /opt/line\\nbreak\n15 \\\\n\n0 C:\\\\app\\\\bin\n"));
+        QCOMPARE(manifest.count(QLatin1Char('\n')), paths.count());
+        QCOMPARE(fileManifestPaths(manifest), paths);
+    }
+
+    void testMalformedFileManifest_data()
+    {
+        QTest::addColumn<QString>("manifest");
+        QTest::addColumn<QStringList>("paths");
+        QTest::addColumn<QString>("error");
+
+        QTest::newRow("prefix too long") << QString::fromLatin1("0 /a/b\n9 c\n")
+            << (QStringList() << QLatin1String("/a/b"))
+            << QString::fromLatin1("Malformed file manifest at position 7.");
+        QTest::newRow("missing prefix") << QString::fromLatin1("/a/b\n")
+            << QStringList() << QString::fromLatin1("Malformed file manifest at position 0.");
+        QTest::newRow("bad escape") << QString::fromLatin1("0 /a\n2 b\\t\n")
+            << (QStringList() << QLatin1String("/a"))
+            << QString::fromLatin1("Malformed file manifest at position 9.");
+        QTest::newRow("trailing backslash") << QString::fromLatin1("0 /a\\")
+            << QStringList() << QString::fromLatin1("Malformed file manifest at position 5.");
+    }
+
+    void testMalformedFileManifest()
+    {
+        QFETCH(QString, manifest);
+        QFETCH(QStringList, paths);
+        QFETCH(QString, error);
+
+        QStringList read;
+        FileManifestReader reader(manifest);
+        QString path;
+        while (reader.next(&path))
+            read.append(path);
+        QCOMPARE(read, paths);
+        QVERIFY(reader.hasError());
+        QCOMPARE(reader.errorString(), error);
+
+        try {
+            fileManifestPaths(manifest);
+            QFAIL("Exception expected.");
+        } catch (const QInstaller::Error &e) {
+            QCOMPARE(e.message(), error);
+        }
+    }
+};
+
+QTEST_MAIN(tst_fileutils)
+
+#include "tst_fileutils.moc"
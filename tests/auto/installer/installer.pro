@@ -2,7 +2,9 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     settings \
+    fileutils \
     repository \
+    repositorygen \
     componentmodel \
     fakestopprocessforupdateoperation \
     messageboxhandler \
@@ -12,8 +14,13 @@ SUBDIRS += \
     consumeoutputoperationtest \
     mkdiroperationtest \
     copyoperationtest \
+    copydirectoryoperationtest \
+    copytreeoperationtest \
+    replaceoperationtest \
+    qtpatch \
     solver \
     binaryformat \
     packagemanagercore \
     settingsoperation \
+    trace \
     task
@@ -42,6 +42,8 @@
 #include "init.h"
 #include "lib7z_facade.h"
 
+#include <QBuffer>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QObject>
 #include <QTemporaryFile>
@@ -81,6 +83,52 @@ private slots:
             QVERIFY(file.open(QIODevice::ReadOnly));
             QCOMPARE(Lib7z::isSupportedArchive(&file), false);
         }
+
+        {
+            // the check looks at the start of the device and keeps its position
+            QFile file(":///data/valid.7z");
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QVERIFY(file.seek(3));
+            QCOMPARE(Lib7z::isSupportedArchive(&file), true);
+            QCOMPARE(file.pos(), 3LL);
+        }
+
+        {
+            // lzma streams have no start signature, they are recognized by their header
+            QFile file(":///data/valid.lzma");
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QVERIFY(file.seek(3));
+            QCOMPARE(Lib7z::isSupportedArchive(&file), true);
+            QCOMPARE(file.pos(), 3LL);
+        }
+    }
+
+    void testIsSupportedArchiveLzmaHeader_data()
+    {
+        QTest::addColumn<QByteArray>("header");
+        QTest::addColumn<bool>("supported");
+
+        const QByteArray unknownSize(8, char(0xff));
+        QTest::newRow("valid") << QByteArray::fromHex("5d00008000") + unknownSize << true;
+        QTest::newRow("3 * 2^n dictionary") << QByteArray::fromHex("5d00000c00") + unknownSize
+            << true;
+        QTest::newRow("known size") << QByteArray::fromHex("5d00008000" "0000500000000000") << true;
+        QTest::newRow("properties") << QByteArray::fromHex("e100008000") + unknownSize << false;
+        QTest::newRow("dictionary") << QByteArray::fromHex("5d01008000") + unknownSize << false;
+        QTest::newRow("size") << QByteArray::fromHex("5d00008000" "0000000000000001") << false;
+        QTest::newRow("truncated") << QByteArray::fromHex("5d00008000ffff") << false;
+        QTest::newRow("text") << QByteArray("This is not an archive.") << false;
+    }
+
+    void testIsSupportedArchiveLzmaHeader()
+    {
+        QFETCH(QByteArray, header);
+        QFETCH(bool, supported);
+
+        QBuffer buffer(&header);
+        QVERIFY(buffer.open(QIODevice::ReadOnly));
+        QCOMPARE(Lib7z::isSupportedArchive(&buffer), supported);
+        QCOMPARE(buffer.pos(), 0LL);
     }
 
     void testListArchive()
@@ -146,6 +194,38 @@ private slots:
         }
     }
 
+    void testExtractArchiveWithChecksum()
+    {
+        QFile source(":///data/valid.7z");
+        QVERIFY(source.open(QIODevice::ReadOnly));
+        const QByteArray sha1 = QCryptographicHash::hash(source.readAll(), QCryptographicHash::Sha1)
+            .toHex();
+        QVERIFY(source.seek(0));
+
+        try {
+            Lib7z::ExtractCallback callback;
+            callback.setExpectedSha1(sha1);
+            Lib7z::extractArchive(&source, QDir::tempPath(), &callback);
+        } catch (const Lib7z::SevenZipException& e) {
+            QFAIL(e.message().toUtf8());
+        } catch (...) {
+            QFAIL("Unexpected error during extract archive!");
+        }
+
+        QFile corrupt(":///data/valid.7z");
+        QVERIFY(corrupt.open(QIODevice::ReadOnly));
+        try {
+            Lib7z::ExtractCallback callback;
+            callback.setExpectedSha1(QByteArray(40, '0'));
+            Lib7z::extractArchive(&corrupt, QDir::tempPath(), &callback);
+            QFAIL("Extracting with a wrong checksum should fail!");
+        } catch (const Lib7z::SevenZipException& e) {
+            QVERIFY(e.message().startsWith(QLatin1String("Checksum mismatch")));
+        } catch (...) {
+            QFAIL("Unexpected error during extract archive!");
+        }
+    }
+
     void testExtractFileFromArchive()
     {
         QFile source(":///data/valid.7z");
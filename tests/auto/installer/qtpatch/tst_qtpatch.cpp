@@ -0,0 +1,172 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+
+#include <fileutils.h>
+#include <qtpatch.h>
+
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QObject>
+#include <QTest>
+
+Q_DECLARE_METATYPE(QInstaller::SearchReplacePairs)
+
+class tst_qtpatch : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QByteArray padded(const char *path, int size)
+    {
+        QByteArray result(path);
+        return result.append(QByteArray(size - result.size(), '\0'));
+    }
+
+private slots:
+    void init()
+    {
+        m_testDirectory = QInstaller::createTemporaryDirectory(QLatin1String("qtpatchtest"));
+    }
+
+    void cleanup()
+    {
+        QInstaller::removeDirectory(m_testDirectory, true);
+    }
+
+    void testPatchBinary_data()
+    {
+        static const int chunkSize = 1024 * 1024;
+        QTest::addColumn<QByteArray>("content");
+        QTest::addColumn<QByteArray>("expected");
+
+        QTest::newRow("empty") << QByteArray() << QByteArray();
+        QTest::newRow("start and end") << QByteArray("/old/qt....../old/qt")
+            << QByteArray("/new\0\0\0....../new\0\0\0", 20);
+        QTest::newRow("adjacent") << QByteArray("/old/qt/old/qt")
+            << QByteArray("/new\0\0\0/new\0\0\0", 14);
+        QTest::newRow("partial match") << QByteArray("/old/q/old/qt") << QByteArray("/old/q/new\0\0\0", 13);
+
+        // the chunked scan reads one megabyte at a time
+        QByteArray content(3 * chunkSize, 'x');
+        content.replace(chunkSize - 7, 7, "/old/qt");
+        content.replace(2 * chunkSize - 3, 7, "/old/qt");
+        content.replace(3 * chunkSize - 7, 7, "/old/qt");
+        QByteArray expected = content;
+        expected.replace("/old/qt", QByteArray("/new\0\0\0", 7));
+        QTest::newRow("chunk boundaries") << content << expected;
+    }
+
+    void testPatchBinary()
+    {
+        QFETCH(QByteArray, content);
+        QFETCH(QByteArray, expected);
+
+        // files are patched through a memory mapping
+        QFile file(QDir(m_testDirectory).absoluteFilePath(QLatin1String("file.bin")));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(content), qint64(content.size()));
+        file.close();
+        QVERIFY(QtPatch::patchBinaryFile(file.fileName(), "/old/qt", "/new"));
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readAll(), expected);
+
+        // other devices are patched chunk by chunk
+        QBuffer buffer(&content);
+        QVERIFY(buffer.open(QIODevice::ReadWrite));
+        QVERIFY(QtPatch::patchBinaryFile(&buffer, "/old/qt", "/new"));
+        QCOMPARE(buffer.pos(), 0LL);
+        QCOMPARE(buffer.data(), expected);
+    }
+
+    void testPatchBinaryPairs_data()
+    {
+        static const int chunkSize = 1024 * 1024;
+        QTest::addColumn<QByteArray>("content");
+        QTest::addColumn<QInstaller::SearchReplacePairs>("pairs");
+        QTest::addColumn<QByteArray>("expected");
+
+        const QInstaller::SearchReplacePairs prefixes = QInstaller::SearchReplacePairs()
+            << qMakePair(QByteArray("/opt/qt"), QByteArray("/a"))
+            << qMakePair(QByteArray("/opt/qt/lib"), QByteArray("/b"));
+        QTest::newRow("overlapping prefixes") << QByteArray("/opt/qt/lib:/opt/qt/bin:/opt/q")
+            << prefixes << padded("/b", 11) + ':' + padded("/a", 7) + "/bin:/opt/q";
+
+        QTest::newRow("different first bytes") << QByteArray("C:/qt;/opt/qt;C:/q")
+            << (QInstaller::SearchReplacePairs() << qMakePair(QByteArray("/opt/qt"), QByteArray("/a"))
+            << qMakePair(QByteArray("C:/qt"), QByteArray("D:/x")))
+            << padded("D:/x", 5) + ';' + padded("/a", 7) + ";C:/q";
+
+        // the chunks overlap by the length of the longest path
+        QByteArray content(3 * chunkSize, 'x');
+        content.replace(chunkSize - 5, 11, "/opt/qt/lib");
+        content.replace(2 * chunkSize - 3, 7, "/opt/qt");
+        content.replace(3 * chunkSize - 11, 11, "/opt/qt/lib");
+        QByteArray expected = content;
+        expected.replace("/opt/qt/lib", padded("/b", 11));
+        expected.replace("/opt/qt", padded("/a", 7));
+        QTest::newRow("chunk boundaries") << content << prefixes << expected;
+    }
+
+    void testPatchBinaryPairs()
+    {
+        QFETCH(QByteArray, content);
+        QFETCH(QInstaller::SearchReplacePairs, pairs);
+        QFETCH(QByteArray, expected);
+
+        QFile file(QDir(m_testDirectory).absoluteFilePath(QLatin1String("file.bin")));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(content), qint64(content.size()));
+        file.close();
+        QVERIFY(QtPatch::patchBinaryFile(file.fileName(), pairs));
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readAll(), expected);
+
+        QBuffer buffer(&content);
+        QVERIFY(buffer.open(QIODevice::ReadWrite));
+        QVERIFY(QtPatch::patchBinaryFile(&buffer, pairs));
+        QCOMPARE(buffer.data(), expected);
+    }
+
+    void testPatchReadOnlyDevice()
+    {
+        QByteArray content("/old/qt");
+        QBuffer buffer(&content);
+        QVERIFY(buffer.open(QIODevice::ReadOnly));
+        QVERIFY(!QtPatch::patchBinaryFile(&buffer, "/old/qt", "/new"));
+        QCOMPARE(content, QByteArray("/old/qt"));
+    }
+
+private:
+    QString m_testDirectory;
+};
+
+QTEST_MAIN(tst_qtpatch)
+
+#include "tst_qtpatch.moc"
@@ -0,0 +1,9 @@
+include(../../qttest.pri)
+
+QT -= gui
+QT += testlib
+
+INCLUDEPATH += ../shared
+HEADERS = ../shared/filetesthelpers.h
+
+SOURCES = tst_replaceoperationtest.cpp
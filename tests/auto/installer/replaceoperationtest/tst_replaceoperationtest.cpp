@@ -0,0 +1,178 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+
+#include "filetesthelpers.h"
+
+#include <fileutils.h>
+#include <linereplaceoperation.h>
+#include <replaceoperation.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QTest>
+
+using namespace KDUpdater;
+using namespace QInstaller;
+
+class tst_replaceoperationtest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init()
+    {
+        m_testDirectory = m_directories.create(QLatin1String("replaceoperationtest"));
+        m_testFile = QDir(m_testDirectory).absoluteFilePath(QLatin1String("file.txt"));
+    }
+
+    void cleanup()
+    {
+        m_directories.removeAll();
+    }
+
+    void testMissingArguments()
+    {
+        ReplaceOperation op;
+        op.setArguments(QStringList() << m_testFile << QLatin1String("search"));
+
+        QVERIFY(!op.performOperation());
+        QCOMPARE(UpdateOperation::Error(op.error()), UpdateOperation::InvalidArguments);
+    }
+
+    void testReplaceAndUndo()
+    {
+        writeFile(m_testFile, "prefix=/old/path\nbin=/old/path/bin\nname=foo\n");
+
+        ReplaceOperation op;
+        op.setArguments(QStringList() << m_testFile << QLatin1String("/old/path")
+            << QLatin1String("/new/location") << QLatin1String("foo") << QLatin1String("bar"));
+        op.backup();
+        QVERIFY2(op.performOperation(), qPrintable(op.errorString()));
+        QCOMPARE(readFile(m_testFile),
+            QByteArray("prefix=/new/location\nbin=/new/location/bin\nname=bar\n"));
+        QVERIFY(op.hasValue(QLatin1String("backupOfFile")));
+
+        QVERIFY2(op.undoOperation(), qPrintable(op.errorString()));
+        QCOMPARE(readFile(m_testFile), QByteArray("prefix=/old/path\nbin=/old/path/bin\nname=foo\n"));
+        QCOMPARE(QDir(m_testDirectory).entryList(QDir::Files).count(), 1);
+    }
+
+    void testNothingToReplace()
+    {
+        writeFile(m_testFile, "nothing to see here\n");
+
+        ReplaceOperation op;
+        op.setArguments(QStringList() << m_testFile << QLatin1String("missing")
+            << QLatin1String("found"));
+        QVERIFY2(op.performOperation(), qPrintable(op.errorString()));
+        QVERIFY(!op.hasValue(QLatin1String("backupOfFile")));
+        QCOMPARE(readFile(m_testFile), QByteArray("nothing to see here\n"));
+        QCOMPARE(QDir(m_testDirectory).entryList(QDir::Files).count(), 1);
+    }
+
+    void testMatchAcrossChunks()
+    {
+        // put matches right in front of the first chunk boundary, across and behind the second one
+        const int chunkSize = 1024 * 1024;
+        QByteArray content(3 * chunkSize, 'x');
+        content.replace(chunkSize - 6, 6, "needle");
+        content.replace(2 * chunkSize - 3, 6, "needle");
+        content.replace(2 * chunkSize + 3, 6, "needle");
+        writeFile(m_testFile, content);
+
+        QByteArray expected = content;
+        expected.replace("needle", "pin");
+
+        SearchReplacePairs pairs;
+        pairs.append(qMakePair(QByteArray("needle"), QByteArray("pin")));
+        QCOMPARE(replaceInFile(m_testFile, pairs), 3);
+        QCOMPARE(readFile(m_testFile), expected);
+    }
+
+    void testFirstMatchInLaterChunk()
+    {
+        // the unchanged chunks in front of the first match are only written once it is found
+        const int chunkSize = 1024 * 1024;
+        QByteArray content(3 * chunkSize, 'x');
+        content.replace(2 * chunkSize + 100, 6, "needle");
+        writeFile(m_testFile, content);
+
+        SearchReplacePairs pairs;
+        pairs.append(qMakePair(QByteArray("needle"), QByteArray("pin")));
+        QCOMPARE(replaceInFile(m_testFile, pairs), 1);
+        QCOMPARE(readFile(m_testFile), content.replace("needle", "pin"));
+    }
+
+#ifdef Q_OS_UNIX
+    void testReplaceThroughSymlink()
+    {
+        writeFile(m_testFile, "prefix=/old/path\n");
+        const QString link = QDir(m_testDirectory).absoluteFilePath(QLatin1String("link.txt"));
+        QVERIFY(QFile::link(m_testFile, link));
+
+        SearchReplacePairs pairs;
+        pairs.append(qMakePair(QByteArray("/old/path"), QByteArray("/new/location")));
+        QCOMPARE(replaceInFile(link, pairs), 1);
+
+        // the file the link points to is rewritten, the link stays
+        QVERIFY(QFileInfo(link).isSymLink());
+        QCOMPARE(readFile(m_testFile), QByteArray("prefix=/new/location\n"));
+        QCOMPARE(QDir(m_testDirectory).entryList(QDir::Files).count(), 2);
+    }
+#endif
+
+    void testLineReplaceAndUndo()
+    {
+        writeFile(m_testFile, "  Prefix = /old\nName = foo\nOther = 1\n");
+
+        LineReplaceOperation op;
+        op.setArguments(QStringList() << m_testFile << QLatin1String("Prefix")
+            << QLatin1String("Prefix = /new") << QLatin1String("Name") << QLatin1String("Name = bar"));
+        QVERIFY2(op.performOperation(), qPrintable(op.errorString()));
+
+        QFile file(m_testFile);
+        QVERIFY(file.open(QIODevice::ReadOnly | QIODevice::Text));
+        QCOMPARE(file.readAll(), QByteArray("Prefix = /new\nName = bar\nOther = 1\n"));
+        file.close();
+
+        QVERIFY2(op.undoOperation(), qPrintable(op.errorString()));
+        QCOMPARE(readFile(m_testFile), QByteArray("  Prefix = /old\nName = foo\nOther = 1\n"));
+    }
+
+private:
+    TemporaryDirectories m_directories;
+    QString m_testDirectory;
+    QString m_testFile;
+};
+
+QTEST_MAIN(tst_replaceoperationtest)
+
+#include "tst_replaceoperationtest.moc"
@@ -0,0 +1,10 @@
+include(../../qttest.pri)
+
+QT -= gui
+QT += testlib script xml
+
+INCLUDEPATH += ../../../../tools/common ../shared
+SOURCES = tst_repositorygen.cpp \
+    ../../../../tools/common/repositorygen.cpp
+HEADERS += ../../../../tools/common/repositorygen.h \
+    ../shared/filetesthelpers.h
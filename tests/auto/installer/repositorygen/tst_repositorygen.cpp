@@ -0,0 +1,185 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+
+#include "filetesthelpers.h"
+#include "repositorygen.h"
+
+#include <fileutils.h>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QTest>
+
+using namespace QInstaller;
+using namespace QInstallerTools;
+
+class tst_repositorygen : public QObject
+{
+    Q_OBJECT
+
+private:
+    void writePackage(const QString &name)
+    {
+        writeFile(QString::fromLatin1("%1/%2/meta/package.xml").arg(m_packagesDir, name),
+            "<Package><DisplayName>" + name.toLatin1() + "</DisplayName><Version>1.0.0</Version>"
+            "<ReleaseDate>2017-01-01</ReleaseDate></Package>");
+        writeFile(QString::fromLatin1("%1/%2/data/file.txt").arg(m_packagesDir, name), name.toLatin1());
+    }
+
+    // Runs the steps of repogen on the packages, \a update as with --update.
+    void generate(bool update)
+    {
+        QStringList filter;
+        PackageInfoVector packages = createListOfPackages(QStringList() << m_packagesDir, &filter,
+            Exclude);
+        const QString tmpMetaDir = createTemporaryDirectory();
+        copyComponentData(QStringList() << m_packagesDir, m_repositoryDir, &packages,
+            update ? SkipUnchanged : WriteFingerprint);
+        copyMetaData(tmpMetaDir, m_repositoryDir, packages, QLatin1String("{AnyApplication}"),
+            QLatin1String("1.0.0"));
+        compressMetaDirectories(tmpMetaDir, tmpMetaDir, buildPathToVersionMapping(packages), false,
+            update ? m_repositoryDir : QString());
+        QFile::remove(m_repositoryDir + QLatin1String("/Updates.xml"));
+        moveDirectoryContents(tmpMetaDir, m_repositoryDir);
+        removeDirectory(tmpMetaDir, true);
+    }
+
+    QDomElement packageUpdate(const QString &name)
+    {
+        QDomDocument doc;
+        QFile file(m_repositoryDir + QLatin1String("/Updates.xml"));
+        if (!file.open(QIODevice::ReadOnly) || !doc.setContent(&file))
+            return QDomElement();
+
+        QDomElement update = doc.documentElement().firstChildElement(QLatin1String("PackageUpdate"));
+        for (; !update.isNull(); update = update.nextSiblingElement(QLatin1String("PackageUpdate"))) {
+            if (update.firstChildElement(QLatin1String("Name")).text() == name)
+                return update;
+        }
+        return QDomElement();
+    }
+
+private slots:
+    void init()
+    {
+        m_packagesDir = m_directories.create(QLatin1String("repositorygen-packages"));
+        m_repositoryDir = m_directories.create(QLatin1String("repositorygen-repository"));
+        writePackage(QLatin1String("A"));
+        writePackage(QLatin1String("B"));
+    }
+
+    void cleanup()
+    {
+        m_directories.removeAll();
+    }
+
+    void testMetaDataOfSameVersion()
+    {
+        generate(false);
+
+        // the meta data archives of both components are compressed at the same time
+        foreach (const QString &name, QStringList() << QLatin1String("A") << QLatin1String("B")) {
+            QFile archive(QString::fromLatin1("%1/%2/1.0.0meta.7z").arg(m_repositoryDir, name));
+            QVERIFY(archive.open(QIODevice::ReadOnly));
+            const QByteArray sha1 = QCryptographicHash::hash(archive.readAll(),
+                QCryptographicHash::Sha1).toHex();
+            QCOMPARE(packageUpdate(name).firstChildElement(QLatin1String("SHA1")).text().toLatin1(),
+                sha1);
+        }
+        QVERIFY(QDir(m_repositoryDir).entryList(QStringList(QLatin1String("*meta.7z")),
+            QDir::Files).isEmpty());
+    }
+
+    void testUpdateUnchanged()
+    {
+        generate(false);
+        const QString archive = m_repositoryDir + QLatin1String("/A/1.0.0content.7z");
+        const QDateTime modified = QFileInfo(archive).lastModified();
+        QCOMPARE(packageUpdate(QLatin1String("A")).firstChildElement(QLatin1String("DownloadableArchives"))
+            .text(), QLatin1String("content.7z"));
+
+        QTest::qSleep(1100);    // file times might have a resolution of one second
+        generate(true);
+
+        // the archive is kept, the meta data archive next to it is not listed as downloadable
+        QCOMPARE(QFileInfo(archive).lastModified(), modified);
+        QFile meta(m_repositoryDir + QLatin1String("/A/1.0.0meta.7z"));
+        QVERIFY(meta.open(QIODevice::ReadOnly));
+        QCOMPARE(packageUpdate(QLatin1String("A")).firstChildElement(QLatin1String("SHA1")).text()
+            .toLatin1(), QCryptographicHash::hash(meta.readAll(), QCryptographicHash::Sha1).toHex());
+        QCOMPARE(packageUpdate(QLatin1String("A")).firstChildElement(QLatin1String("DownloadableArchives"))
+            .text(), QLatin1String("content.7z"));
+    }
+
+    void testUpdateFromOtherLocation()
+    {
+        generate(false);
+        const QString archive = m_repositoryDir + QLatin1String("/A/1.0.0content.7z");
+        const QDateTime modified = QFileInfo(archive).lastModified();
+
+        const QString moved = m_directories.create(QLatin1String("repositorygen-moved"))
+            + QLatin1String("/packages");
+        QVERIFY(QDir().rename(m_packagesDir, moved));
+        m_packagesDir = moved;
+
+        QTest::qSleep(1100);    // file times might have a resolution of one second
+        generate(true);
+        QCOMPARE(QFileInfo(archive).lastModified(), modified);
+    }
+
+    void testUpdateChanged()
+    {
+        generate(false);
+        writeFile(m_packagesDir + QLatin1String("/A/data/other.txt"), "other");
+        generate(true);
+
+        QFile archive(m_repositoryDir + QLatin1String("/A/1.0.0content.7z"));
+        QVERIFY(archive.open(QIODevice::ReadOnly));
+        QFile hash(archive.fileName() + QLatin1String(".sha1"));
+        QVERIFY(hash.open(QIODevice::ReadOnly));
+        QCOMPARE(hash.readAll(), QCryptographicHash::hash(archive.readAll(),
+            QCryptographicHash::Sha1).toHex());
+        QCOMPARE(packageUpdate(QLatin1String("A")).firstChildElement(QLatin1String("DownloadableArchives"))
+            .text(), QLatin1String("content.7z"));
+    }
+
+private:
+    TemporaryDirectories m_directories;
+    QString m_packagesDir;
+    QString m_repositoryDir;
+};
+
+QTEST_MAIN(tst_repositorygen)
+
+#include "tst_repositorygen.moc"
@@ -42,21 +42,290 @@
 #include <copyfiletask.h>
 #include <downloadfiletask.h>
 #include <fileutils.h>
+#include <kdupdaterfiledownloader.h>
+#include <kdupdaterfiledownloaderfactory.h>
 
+#include <QCryptographicHash>
+#include <QEventLoop>
+#include <QFileInfo>
 #include <QFutureWatcher>
+#include <QSemaphore>
 #include <QSignalSpy>
+#include <QTcpServer>
+#include <QTcpSocket>
 #include <QTest>
 #include <QTemporaryFile>
+#include <QThread>
+#include <QTimer>
 
 using namespace QInstaller;
 
 static const qint64 scLargeSize = 4194304LL;
 
+static QByteArray eTag(const QByteArray &body)
+{
+    return '"' + QCryptographicHash::hash(body, QCryptographicHash::Sha1).toHex().left(8) + '"';
+}
+
+// Minimal keep-alive HTTP/1.1 server answering every GET with the same body, supports HEAD,
+// "Range: bytes=<begin>-[<end>]" and "If-Range: <etag>" requests.
+class HttpServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    enum Option {
+        NoOptions = 0x00,
+        NoRanges = 0x01,            // ignore ranges and answer with the whole body
+        RedirectDownloads = 0x02,   // answer GET requests for any path but /data with a redirect
+        FailMiddleRange = 0x04,     // fail the first range starting in the middle of the body
+        FailRanges = 0x08,          // answer every ranged GET with an error page
+        StaleFirstHead = 0x10       // answer the first HEAD with the ETag of another file
+    };
+    Q_DECLARE_FLAGS(Options, Option)
+
+    HttpServer(const QByteArray &body, QAtomicInt *bytesSent, Options options)
+        : m_body(body)
+        , m_eTag(eTag(body))
+        , m_bytesSent(bytesSent)
+        , m_options(options)
+    {}
+
+protected:
+#if QT_VERSION < 0x050000
+    void incomingConnection(int socketDescriptor)
+#else
+    void incomingConnection(qintptr socketDescriptor)
+#endif
+    {
+        QTcpSocket *socket = new QTcpSocket(this);
+        socket->setSocketDescriptor(socketDescriptor);
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+
+private slots:
+    void onReadyRead()
+    {
+        QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+        while (socket && socket->canReadLine()) {
+            const QByteArray line = socket->readLine();
+            if (!socket->property("request").isValid()) {
+                socket->setProperty("request", line.trimmed());
+                continue;
+            }
+            if (line.toLower().startsWith("range: bytes=")) {
+                socket->setProperty("range", line.mid(13).trimmed());
+                continue;
+            }
+            if (line.toLower().startsWith("if-range:")) {
+                socket->setProperty("ifRange", line.mid(9).trimmed());
+                continue;
+            }
+            if (line != "\r\n")
+                continue;   // answer on the empty line terminating the request
+
+            const QList<QByteArray> request = socket->property("request").toByteArray().split(' ');
+            QByteArray range = socket->property("range").toByteArray();
+            const QVariant ifRange = socket->property("ifRange");
+            if (ifRange.isValid() && ifRange.toByteArray() != m_eTag)
+                range.clear();  // the client has parts of another file, send the whole body
+            socket->setProperty("request", QVariant());
+            socket->setProperty("range", QVariant());
+            socket->setProperty("ifRange", QVariant());
+            respond(socket, request.value(0), request.value(1), range);
+        }
+    }
+
+private:
+    void respond(QTcpSocket *socket, const QByteArray &method, const QByteArray &path,
+        const QByteArray &range)
+    {
+        if (method == "GET" && (m_options & RedirectDownloads) && path != "/data") {
+            socket->write("HTTP/1.1 302 Found\r\nLocation: /data\r\nContent-Length: 0\r\n\r\n");
+            return;
+        }
+
+        qint64 begin = 0;
+        qint64 end = m_body.size() - 1;
+        const bool ranged = !range.isEmpty() && !(m_options & NoRanges);
+        if (ranged) {
+            const int dash = range.indexOf('-');
+            begin = range.left(dash).toLongLong();
+            if (dash < range.size() - 1)
+                end = range.mid(dash + 1).toLongLong();
+            if (method == "GET" && (m_options & FailMiddleRange) && begin == m_body.size() / 2) {
+                m_options &= ~FailMiddleRange;
+                socket->write("HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+                return;
+            }
+            if (method == "GET" && (m_options & FailRanges)) {
+                socket->write("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 11\r\n\r\n"
+                    "unavailable");
+                return;
+            }
+            socket->write("HTTP/1.1 206 Partial Content\r\nContent-Range: bytes "
+                + QByteArray::number(begin) + '-' + QByteArray::number(end) + '/'
+                + QByteArray::number(m_body.size()) + "\r\n");
+        } else {
+            socket->write("HTTP/1.1 200 OK\r\n");
+            if (!(m_options & NoRanges))
+                socket->write("Accept-Ranges: bytes\r\n");
+        }
+        if (method == "HEAD" && (m_options & StaleFirstHead)) {
+            m_options &= ~StaleFirstHead;
+            socket->write("ETag: \"stale\"\r\n");
+        } else {
+            socket->write("ETag: " + m_eTag + "\r\n");
+        }
+        socket->write("Content-Type: application/octet-stream\r\nContent-Length: "
+            + QByteArray::number(end - begin + 1) + "\r\n\r\n");
+        if (method == "HEAD")
+            return;
+        m_bytesSent->fetchAndAddRelaxed(end - begin + 1);
+        socket->write(m_body.mid(begin, end - begin + 1));
+    }
+
+private:
+    QByteArray m_body;
+    QByteArray m_eTag;
+    QAtomicInt *m_bytesSent;
+    Options m_options;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(HttpServer::Options)
+
+class HttpServerThread : public QThread
+{
+public:
+    explicit HttpServerThread(const QByteArray &body,
+            HttpServer::Options options = HttpServer::NoOptions)
+        : m_body(body)
+        , m_options(options)
+        , m_port(0)
+        , m_bytesSent(0)
+    {}
+
+    quint16 waitForPort()
+    {
+        m_ready.acquire();
+        return m_port;
+    }
+
+    int bytesSent() { return m_bytesSent.fetchAndAddRelaxed(0); }
+
+protected:
+    void run()
+    {
+        HttpServer server(m_body, &m_bytesSent, m_options);
+        if (server.listen(QHostAddress::LocalHost))
+            m_port = server.serverPort();
+        m_ready.release();
+        exec();
+    }
+
+private:
+    QByteArray m_body;
+    HttpServer::Options m_options;
+    quint16 m_port;
+    QAtomicInt m_bytesSent;
+    QSemaphore m_ready;
+};
+
+static QByteArray testBody()
+{
+    QByteArray body(scLargeSize, Qt::Uninitialized);
+    for (int i = 0; i < body.size(); ++i)
+        body[i] = char(i % 251);
+    return body;
+}
+
+// Downloads \a url to \a target with the downloader the factory creates, which must inherit
+// \a className.
+static bool factoryDownload(const char *className, const QString &url, const QString &target,
+    QByteArray *sha1 = 0)
+{
+    QScopedPointer<KDUpdater::FileDownloader> downloader(KDUpdater::FileDownloaderFactory::instance()
+        .create(QLatin1String("http")));
+    if (!downloader || !downloader->inherits(className))
+        return false;
+    downloader->setUrl(QUrl(url));
+    downloader->setDownloadedFileName(target);
+
+    QEventLoop loop;
+    QObject::connect(downloader.data(), SIGNAL(downloadCompleted()), &loop, SLOT(quit()));
+    QObject::connect(downloader.data(), SIGNAL(downloadAborted(QString)), &loop, SLOT(quit()));
+    QTimer::singleShot(30000, &loop, SLOT(quit()));
+    downloader->download();
+    loop.exec();
+    if (sha1)
+        *sha1 = downloader->sha1Sum();
+    return downloader->isDownloaded();
+}
+
+static bool segmentedDownload(const QString &url, const QString &target, QByteArray *sha1 = 0)
+{
+    return factoryDownload("KDUpdater::SegmentedHttpDownloader", url, target, sha1);
+}
+
+// Leaves \a data in the partial file of \a target as if a previous download got interrupted,
+// together with the \a validator of the file it belongs to.
+static bool writePartialDownload(const QString &target, const QByteArray &data,
+    const QByteArray &validator)
+{
+    QFile part(target + QLatin1String(".part"));
+    if (!part.open(QIODevice::WriteOnly) || part.write(data) != data.size())
+        return false;
+    part.close();
+
+    QFile::remove(target + QLatin1String(".part.validator"));
+    if (validator.isEmpty())
+        return true;
+    QFile file(target + QLatin1String(".part.validator"));
+    return file.open(QIODevice::WriteOnly) && file.write(validator) == validator.size();
+}
+
+static QByteArray readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+// Returns the number of bytes the state of an interrupted segmented download records as received.
+static qint64 receivedBytes(const QString &stateFileName)
+{
+    QFile file(stateFileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+    file.readLine();    // the size and the validator of the file
+
+    qint64 received = 0;
+    while (!file.atEnd()) {
+        const QList<QByteArray> segment = file.readLine().trimmed().split(' ');
+        received += segment.value(1).toLongLong() - segment.value(0).toLongLong();
+    }
+    return received;
+}
+
 class tst_Task : public QObject
 {
     Q_OBJECT
 
 private slots:
+    void init()
+    {
+        KDUpdater::FileDownloaderFactory::setDownloadSegments(4);
+        KDUpdater::FileDownloaderFactory::setSegmentThreshold(scLargeSize / 4);
+        KDUpdater::FileDownloaderFactory::setFollowRedirects(true);
+    }
+
+    void cleanup()
+    {
+        KDUpdater::FileDownloaderFactory::setDownloadSegments(1);
+        KDUpdater::FileDownloaderFactory::setSegmentThreshold(64 * 1024 * 1024);
+        KDUpdater::FileDownloaderFactory::setFollowRedirects(false);
+    }
+
     void copyFile()
     {
         QTemporaryFile file;
@@ -124,6 +393,343 @@ private slots:
             QCOMPARE(result.checkSum().toHex(), QByteArray("85304f87b8d90554a63c6f6d1e9cc974fbef8d32"));
         }
     }
+
+    void resumeDownload_data()
+    {
+        QTest::addColumn<QByteArray>("validator");
+        QTest::addColumn<bool>("resumed");
+        QTest::newRow("same file") << eTag(testBody()) << true;
+        QTest::newRow("changed file") << QByteArray("\"v0\"") << false;
+        QTest::newRow("no validator") << QByteArray() << false;
+    }
+
+    void resumeDownload()
+    {
+        QFETCH(QByteArray, validator);
+        QFETCH(bool, resumed);
+
+        const QByteArray body = testBody();
+        const QByteArray expected = QCryptographicHash::hash(body, QCryptographicHash::Sha1);
+
+        HttpServerThread server(body);
+        server.start();
+        const quint16 port = server.waitForPort();
+        QVERIFY(port != 0);
+
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        const QString target = file.fileName();
+        file.close();
+
+        QVERIFY(writePartialDownload(target, body.left(body.size() / 2), validator));
+
+        DownloadFileTask fileTask(QString::fromLatin1("http://127.0.0.1:%1/file").arg(port), target);
+        QFutureWatcher<FileTaskResult> watcher;
+        watcher.setFuture(QtConcurrent::run(&DownloadFileTask::doTask, &fileTask));
+        watcher.waitForFinished();
+
+        server.quit();
+        server.wait();
+
+        QCOMPARE(watcher.future().resultCount(), 1);
+        const FileTaskResult result = watcher.result();
+        QCOMPARE(result.target(), target);
+        QCOMPARE(result.checkSum(), expected);
+        QCOMPARE(QFileInfo(target).size(), qint64(body.size()));
+        QVERIFY(!QFile::exists(target + QLatin1String(".part")));
+        QVERIFY(!QFile::exists(target + QLatin1String(".part.validator")));
+        QCOMPARE(server.bytesSent(), resumed ? body.size() - body.size() / 2 : body.size());
+    }
+
+    void keepPartialDownloadOnError()
+    {
+        const QByteArray body = testBody();
+        HttpServerThread server(body, HttpServer::FailRanges);
+        server.start();
+        const quint16 port = server.waitForPort();
+        QVERIFY(port != 0);
+
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        const QString target = file.fileName();
+        file.close();
+
+        const QByteArray partial = body.left(body.size() / 2);
+        QVERIFY(writePartialDownload(target, partial, eTag(body)));
+
+        DownloadFileTask fileTask(QString::fromLatin1("http://127.0.0.1:%1/file").arg(port), target);
+        QFutureWatcher<FileTaskResult> watcher;
+        watcher.setFuture(QtConcurrent::run(&DownloadFileTask::doTask, &fileTask));
+        try {
+            watcher.waitForFinished();
+            QFAIL("The download of an error page succeeded.");
+        } catch (const TaskException &) {
+            // expected, the server answered with 503
+        }
+
+        server.quit();
+        server.wait();
+
+        // the error page neither replaced nor extended the partial file
+        QVERIFY(readFile(target + QLatin1String(".part")) == partial);
+        QCOMPARE(readFile(target + QLatin1String(".part.validator")), eTag(body));
+    }
+
+    void resumeHttpDownload_data()
+    {
+        QTest::addColumn<int>("options");
+        QTest::addColumn<QByteArray>("validator");
+        QTest::addColumn<bool>("downloaded");
+        QTest::addColumn<int>("expectedBytesSent");
+
+        const int size = int(scLargeSize);
+        QTest::newRow("same file") << int(HttpServer::NoOptions) << eTag(testBody()) << true
+            << size - size / 2;
+        QTest::newRow("changed file") << int(HttpServer::NoOptions) << QByteArray("\"v0\"")
+            << true << size;
+        QTest::newRow("error page") << int(HttpServer::FailRanges) << eTag(testBody()) << false
+            << 0;
+    }
+
+    void resumeHttpDownload()
+    {
+        QFETCH(int, options);
+        QFETCH(QByteArray, validator);
+        QFETCH(bool, downloaded);
+        QFETCH(int, expectedBytesSent);
+
+        KDUpdater::FileDownloaderFactory::setDownloadSegments(1);
+
+        const QByteArray body = testBody();
+        HttpServerThread server(body, HttpServer::Options(QFlag(options)));
+        server.start();
+        const quint16 port = server.waitForPort();
+        QVERIFY(port != 0);
+
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        const QString target = file.fileName();
+        file.close();
+
+        const QByteArray partial = body.left(body.size() / 2);
+        QVERIFY(writePartialDownload(target, partial, validator));
+
+        QByteArray sha1;
+        const bool result = factoryDownload("KDUpdater::HttpDownloader",
+            QString::fromLatin1("http://127.0.0.1:%1/file").arg(port), target, &sha1);
+
+        server.quit();
+        server.wait();
+
+        QCOMPARE(result, downloaded);
+        QCOMPARE(server.bytesSent(), expectedBytesSent);
+        if (downloaded) {
+            QCOMPARE(sha1, QCryptographicHash::hash(body, QCryptographicHash::Sha1));
+            QVERIFY(readFile(target) == body);
+            QVERIFY(!QFile::exists(target + QLatin1String(".part")));
+            QVERIFY(!QFile::exists(target + QLatin1String(".part.validator")));
+        } else {
+            QVERIFY(readFile(target + QLatin1String(".part")) == partial);
+            QCOMPARE(readFile(target + QLatin1String(".part.validator")), validator);
+        }
+    }
+
+    void segmentedDownload_data()
+    {
+        QTest::addColumn<int>("options");
+        QTest::newRow("ranges") << int(HttpServer::NoOptions);
+        QTest::newRow("no ranges") << int(HttpServer::NoRanges);
+        QTest::newRow("redirect") << int(HttpServer::RedirectDownloads);
+    }
+
+    void segmentedDownload()
+    {
+        QFETCH(int, options);
+
+        const QByteArray body = testBody();
+        HttpServerThread server(body, HttpServer::Options(QFlag(options)));
+        server.start();
+        const quint16 port = server.waitForPort();
+        QVERIFY(port != 0);
+
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        const QString target = file.fileName();
+        file.close();
+
+        QByteArray sha1;
+        const bool downloaded = ::segmentedDownload(QString::fromLatin1("http://127.0.0.1:%1/file")
+            .arg(port), target, &sha1);
+
+        server.quit();
+        server.wait();
+
+        QVERIFY(downloaded);
+        QCOMPARE(sha1, QCryptographicHash::hash(body, QCryptographicHash::Sha1));
+        QFile result(target);
+        QVERIFY(result.open(QIODevice::ReadOnly));
+        QVERIFY(result.readAll() == body);
+        QVERIFY(!QFile::exists(target + QLatin1String(".part")));
+        QVERIFY(!QFile::exists(target + QLatin1String(".part.segments")));
+        QCOMPARE(server.bytesSent(), body.size());
+    }
+
+    void resumeSegmentedDownload()
+    {
+        const QByteArray body = testBody();
+        HttpServerThread server(body, HttpServer::FailMiddleRange);
+        server.start();
+        const quint16 port = server.waitForPort();
+        QVERIFY(port != 0);
+
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        const QString target = file.fileName();
+        file.close();
+
+        const QString url = QString::fromLatin1("http://127.0.0.1:%1/file").arg(port);
+        QVERIFY(!::segmentedDownload(url, target));
+
+        // the failed download keeps what it received and requests only the missing ranges
+        const QString stateFileName = target + QLatin1String(".part.segments");
+        const qint64 received = receivedBytes(stateFileName);
+        QVERIFY(received >= 0);
+        QVERIFY(received < body.size());
+        int sentBefore = 0;
+        do {
+            sentBefore = server.bytesSent();
+            QTest::qWait(100);  // let the server answer requests of the aborted download
+        } while (sentBefore != server.bytesSent());
+
+        QByteArray sha1;
+        const bool downloaded = ::segmentedDownload(url, target, &sha1);
+
+        server.quit();
+        server.wait();
+
+        QVERIFY(downloaded);
+        QCOMPARE(sha1, QCryptographicHash::hash(body, QCryptographicHash::Sha1));
+        QFile result(target);
+        QVERIFY(result.open(QIODevice::ReadOnly));
+        QVERIFY(result.readAll() == body);
+        QVERIFY(!QFile::exists(target + QLatin1String(".part")));
+        QVERIFY(!QFile::exists(stateFileName));
+        QCOMPARE(qint64(server.bytesSent() - sentBefore), body.size() - received);
+    }
+
+    void resumeChangedSegmentedDownload()
+    {
+        const QByteArray body = testBody();
+        QByteArray changed = body;
+        for (int i = 0; i < changed.size(); ++i)
+            changed[i] = ~changed.at(i);
+
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        const QString target = file.fileName();
+        file.close();
+
+        HttpServerThread server(body, HttpServer::FailMiddleRange);
+        server.start();
+        const quint16 port = server.waitForPort();
+        QVERIFY(port != 0);
+        QVERIFY(!::segmentedDownload(QString::fromLatin1("http://127.0.0.1:%1/file").arg(port),
+            target));
+        server.quit();
+        server.wait();
+
+        const QString stateFileName = target + QLatin1String(".part.segments");
+        QVERIFY(receivedBytes(stateFileName) > 0);
+
+        // the ranges received before belong to another version of the file and are dropped
+        HttpServerThread changedServer(changed);
+        changedServer.start();
+        const quint16 changedPort = changedServer.waitForPort();
+        QVERIFY(changedPort != 0);
+
+        QByteArray sha1;
+        const bool downloaded = ::segmentedDownload(QString::fromLatin1("http://127.0.0.1:%1/file")
+            .arg(changedPort), target, &sha1);
+
+        changedServer.quit();
+        changedServer.wait();
+
+        QVERIFY(downloaded);
+        QCOMPARE(sha1, QCryptographicHash::hash(changed, QCryptographicHash::Sha1));
+        QVERIFY(readFile(target) == changed);
+        QVERIFY(!QFile::exists(target + QLatin1String(".part")));
+        QVERIFY(!QFile::exists(stateFileName));
+        QCOMPARE(changedServer.bytesSent(), changed.size());
+    }
+
+    void changeDuringSegmentedDownload()
+    {
+        const QByteArray body = testBody();
+        HttpServerThread server(body, HttpServer::StaleFirstHead);
+        server.start();
+        const quint16 port = server.waitForPort();
+        QVERIFY(port != 0);
+
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        const QString target = file.fileName();
+        file.close();
+
+        // the segment requests carry the stale ETag, are answered with the whole file and the
+        // download starts over
+        QByteArray sha1;
+        const bool downloaded = ::segmentedDownload(QString::fromLatin1("http://127.0.0.1:%1/file")
+            .arg(port), target, &sha1);
+
+        server.quit();
+        server.wait();
+
+        QVERIFY(downloaded);
+        QCOMPARE(sha1, QCryptographicHash::hash(body, QCryptographicHash::Sha1));
+        QVERIFY(readFile(target) == body);
+        QVERIFY(!QFile::exists(target + QLatin1String(".part.segments")));
+    }
+
+    void downloadManyFiles_data()
+    {
+        QTest::addColumn<int>("maxDownloadsPerHost");
+        QTest::newRow("one") << 1;
+        QTest::newRow("default") << int(DownloadFileTask::DefaultMaxDownloadsPerHost);
+        QTest::newRow("unbounded") << 1000; // all at once, as done before the limit was added
+    }
+
+    void downloadManyFiles()
+    {
+        QFETCH(int, maxDownloadsPerHost);
+
+        HttpServerThread server(QByteArray(16384, 'x'));
+        server.start();
+        const quint16 port = server.waitForPort();
+        QVERIFY(port != 0);
+
+        QList<FileTaskItem> items;
+        for (int i = 0; i < 500; ++i)
+            items.append(FileTaskItem(QString::fromLatin1("http://127.0.0.1:%1/%2").arg(port).arg(i)));
+
+        int resultCount = 0;
+        QBENCHMARK {
+            DownloadFileTask fileTask(items);
+            fileTask.setMaxDownloadsPerHost(maxDownloadsPerHost);
+
+            QFutureWatcher<FileTaskResult> watcher;
+            watcher.setFuture(QtConcurrent::run(&DownloadFileTask::doTask, &fileTask));
+            watcher.waitForFinished();
+
+            const QList<FileTaskResult> results = watcher.future().results();
+            foreach (const FileTaskResult &result, results)
+                QFile::remove(result.target());
+            resultCount = results.count();
+        }
+
+        server.quit();
+        server.wait();
+        QCOMPARE(resultCount, items.count());
+    }
 };
 
 QTEST_MAIN(tst_Task)
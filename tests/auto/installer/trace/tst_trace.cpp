@@ -0,0 +1,84 @@
+/**************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Installer Framework.
+**
+** $QT_BEGIN_LICENSE:GPL-EXCEPT$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+**************************************************************************/
+
+
+#include <trace.h>
+
+#include <QDir>
+#include <QFile>
+#include <QObject>
+#include <QTest>
+
+using namespace QInstaller;
+
+class tst_trace : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testDisabled()
+    {
+        QVERIFY(!Trace::isEnabled());
+        {
+            TraceSpan span("test", "disabled");
+        }
+        QVERIFY(!Trace::write());
+    }
+
+    void testWriteSpans()
+    {
+        const QString fileName = QDir::tempPath() + QLatin1String("/tst_trace.json");
+        Trace::setOutputFile(fileName);
+        QVERIFY(Trace::isEnabled());
+        {
+            TraceSpan outer("phase", "outer");
+            TraceSpan inner("operation", "inner", QLatin1String("say \"hi\"\n"));
+        }
+        QVERIFY(Trace::write());
+        Trace::setOutputFile(QString());
+
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const QByteArray json = file.readAll();
+        file.close();
+        QFile::remove(fileName);
+
+        QVERIFY(json.startsWith("{\"traceEvents\":["));
+        QVERIFY(json.contains("\"ph\":\"X\",\"cat\":\"phase\",\"name\":\"outer\""));
+        QVERIFY(json.contains("\"cat\":\"operation\",\"name\":\"inner\""));
+        QVERIFY(json.contains("\"args\":{\"detail\":\"say \\\"hi\\\"\\n\"}"));
+        QVERIFY(!json.contains("\"disabled\""));
+
+        // the inner span ends first
+        QVERIFY(json.indexOf("\"inner\"") < json.indexOf("\"outer\""));
+    }
+};
+
+QTEST_MAIN(tst_trace)
+
+#include "tst_trace.moc"
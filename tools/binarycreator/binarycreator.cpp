@@ -212,8 +212,9 @@ static int assemble(Input input, const QInstaller::Settings &settings)
             tempFile, instExe.errorString()));
     }
 
-    QtPatch::patchBinaryFile(tempFile, QByteArray("MY_InstallerCreateDateTime_MY"),
-        QDateTime::currentDateTime().toString(QLatin1String("yyyy-MM-dd - HH:mm:ss")).toLatin1());
+    QtPatch::patchBinaryFile(tempFile, QInstaller::SearchReplacePairs()
+        << qMakePair(QByteArray("MY_InstallerCreateDateTime_MY"), QDateTime::currentDateTime()
+        .toString(QLatin1String("yyyy-MM-dd - HH:mm:ss")).toLatin1()));
 
 
     input.installerExePath = tempFile;
@@ -432,6 +433,29 @@ static QStringList createBinaryResourceFiles(const QStringList &resources)
     return result;
 }
 
+/*!
+    Puts the compressed meta data of each package next to its uncompressed files. Offline
+    installers turn their meta data into a local repository, and that way the archives are only
+    written out there instead of being compressed again on every installation.
+*/
+static void createMetaArchives(const QString &metaDir,
+    const QInstallerTools::PackageInfoVector &packages)
+{
+    foreach (const QInstallerTools::PackageInfo &info, packages) {
+        const QString packageDir = metaDir + QLatin1Char('/') + info.name;
+        if (!QDir().mkpath(packageDir))
+            throw Error(QString::fromLatin1("Could not create directory %1.").arg(packageDir));
+
+        const QString fileName = info.version + QLatin1String("meta.7z");
+        const QString tmpTarget = metaDir + QLatin1Char('/') + info.name + QLatin1Char('-') + fileName;
+        QInstallerTools::compressPaths(QStringList() << packageDir, tmpTarget);
+
+        const QString target = packageDir + QLatin1Char('/') + fileName;
+        if (!QFile::rename(tmpTarget, target))
+            throw Error(QString::fromLatin1("Could not move %1 to %2.").arg(tmpTarget, target));
+    }
+}
+
 static void printUsage()
 {
     QString suffix;
@@ -738,6 +762,8 @@ int main(int argc, char **argv)
             Input input;
             input.outputPath = target;
             input.installerExePath = templateBinary;
+            if (offlineOnly)
+                createMetaArchives(tmpMetaDir, packages);
             input.binaryResourcePath = createBinaryResourceFile(tmpMetaDir, generateTemporaryFileName());
             input.binaryResources = createBinaryResourceFiles(resources);
 
@@ -38,14 +38,89 @@
 
 #include <kdupdater.h>
 
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
 #include <QtCore/QDirIterator>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
 
 #include <QtXml/QDomDocument>
 
+#include <functional>
 #include <iostream>
 
 using namespace QInstallerTools;
 
+namespace {
+
+// Runs jobs on a pool bounded by the number of cores. waitForFinished() rethrows the error of the
+// first job (in the order they were added) that failed.
+class JobPool
+{
+public:
+    JobPool()
+    {
+        m_pool.setMaxThreadCount(QThread::idealThreadCount());
+    }
+
+    ~JobPool()
+    {
+        m_pool.waitForDone();
+        qDeleteAll(m_jobs);
+    }
+
+    void add(const std::function<void()> &function)
+    {
+        Job *job = new Job(function);
+        job->setAutoDelete(false);
+        m_jobs.append(job);
+        m_pool.start(job);
+    }
+
+    void waitForFinished()
+    {
+        m_pool.waitForDone();
+        foreach (const Job *job, m_jobs) {
+            if (job->sevenZipError)
+                throw Lib7z::SevenZipException(job->error);
+            if (!job->error.isNull())
+                throw QInstaller::Error(job->error);
+        }
+    }
+
+private:
+    struct Job : public QRunnable
+    {
+        explicit Job(const std::function<void()> &f)
+            : function(f)
+            , sevenZipError(false)
+        {}
+
+        void run()
+        {
+            try {
+                function();
+            } catch (const Lib7z::SevenZipException &e) {
+                error = e.message();
+                sevenZipError = true;
+            } catch (const QInstaller::Error &e) {
+                error = e.message();
+            } catch (...) {
+                error = QLatin1String("Unknown exception caught");
+            }
+        }
+
+        std::function<void()> function;
+        QString error;
+        bool sevenZipError;
+    };
+
+    QThreadPool m_pool;
+    QList<Job *> m_jobs;
+};
+
+} // namespace
+
 void QInstallerTools::printRepositoryGenOptions()
 {
     std::cout << "  -p|--packages dir         The directory containing the available packages." << std::endl;
@@ -498,8 +573,66 @@ static void writeSHA1ToNodeWithName(QDomDocument &doc, QDomNodeList &list, const
     }
 }
 
+static void removeChildElements(QDomElement &parent, const QString &tagName)
+{
+    QDomElement child = parent.firstChildElement(tagName);
+    while (!child.isNull()) {
+        const QDomElement next = child.nextSiblingElement(tagName);
+        parent.removeChild(child);
+        child = next;
+    }
+}
+
+static void writeUnifiedMetaData(QDomDocument &doc, const QString &repoDir, const QStringList &subDirs,
+    const QString &existingRepoDir)
+{
+    QStringList paths;
+    foreach (const QString &subDir, subDirs)
+        paths.append(QDir(repoDir).absoluteFilePath(subDir));
+
+    // The unified archive has to describe the whole repository, so the meta data of components
+    // that are not part of this run is taken from the already existing repository.
+    QInstaller::TempDirDeleter tmpDirDeleter;
+    if (!existingRepoDir.isEmpty()) {
+        const QSet<QString> generated = subDirs.toSet();
+        const QString tmpDir = QInstaller::createTemporaryDirectory(QLatin1String("unifiedmeta-"));
+        tmpDirDeleter.add(tmpDir);
+
+        const QDomNodeList packages = doc.elementsByTagName(QLatin1String("PackageUpdate"));
+        for (int i = 0; i < packages.count(); ++i) {
+            const QDomElement package = packages.at(i).toElement();
+            const QString name = package.firstChildElement(QLatin1String("Name")).text();
+            if (generated.contains(name))
+                continue;
+
+            const QString version = package.firstChildElement(QLatin1String("Version")).text();
+            QFile archive(QString::fromLatin1("%1/%2/%3meta.7z").arg(existingRepoDir, name, version));
+            QInstaller::openForRead(&archive, archive.fileName());
+            Lib7z::extractArchive(&archive, tmpDir);
+            paths.append(QString::fromLatin1("%1/%2").arg(tmpDir, name));
+        }
+    }
+
+    const QString metaDataName = QDateTime::currentDateTime().toString(QLatin1String("yyyy-MM-dd-hhmm"))
+        + QLatin1String("_meta.7z");
+    const QString archivePath = QString::fromLatin1("%1/%2").arg(repoDir, metaDataName);
+    qDebug() << "Creating unified meta data archive" << archivePath;
+    compressPaths(paths, archivePath);
+
+    QFile archive(archivePath);
+    QInstaller::openForRead(&archive, archivePath);
+    const QByteArray sha1Sum = QInstaller::calculateHash(&archive, QCryptographicHash::Sha1);
+
+    QDomElement root = doc.documentElement();
+    root.appendChild(doc.createElement(QLatin1String("MetadataName"))).appendChild(doc
+        .createTextNode(metaDataName));
+    root.appendChild(doc.createElement(QLatin1String("SHA1"))).appendChild(doc
+        .createTextNode(QString::fromLatin1(sha1Sum.toHex().constData())));
+}
+
 void QInstallerTools::compressMetaDirectories(const QString &repoDir, const QString &baseDir,
-    const QHash<QString, QString> &versionMapping)
+    const QHash<QString, QString> &versionMapping, bool createUnifiedMetadata,
+    const QString &existingRepoDir)
 {
     QDomDocument doc;
     QDomElement root;
@@ -512,33 +645,50 @@ void QInstallerTools::compressMetaDirectories(const QString &repoDir, const QStr
     }
     existingUpdatesXml.close();
 
+    // a unified archive of a previous run is outdated now, drop the reference to it
+    removeChildElements(root, QLatin1String("MetadataName"));
+    removeChildElements(root, QLatin1String("SHA1"));
+
     QDir dir(repoDir);
     const QStringList sub = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-    QDomNodeList elements =  doc.elementsByTagName(QLatin1String("PackageUpdate"));
-    foreach (const QString &i, sub) {
-        QDir sd(dir);
-        sd.cd(i);
-        const QString path = QString(i).remove(baseDir);
-        const QString versionPrefix = versionMapping[path];
+    if (createUnifiedMetadata)
+        writeUnifiedMetaData(doc, repoDir, sub, existingRepoDir);
+
+    // compress the meta directories concurrently, the document is only touched afterwards
+    QVector<QPair<QString, QByteArray> > sha1Sums(sub.count());
+    JobPool pool;
+    for (int i = 0; i < sub.count(); ++i) {
+        const QString path = QString(sub.at(i)).remove(baseDir);
         if (path.isNull())
             continue;
-        const QString absPath = sd.absolutePath();
-        const QString fn = QLatin1String(versionPrefix.toLatin1() + "meta.7z");
-        const QString tmpTarget = repoDir + QLatin1String("/") +fn;
-        compressPaths(QStringList() << absPath, tmpTarget);
-
-        // remove the files that got compressed
-        QInstaller::removeFiles(absPath, true);
-
-        QFile tmp(tmpTarget);
-        tmp.open(QFile::ReadOnly);
-        const QByteArray sha1Sum = QInstaller::calculateHash(&tmp, QCryptographicHash::Sha1);
-        writeSHA1ToNodeWithName(doc, elements, sha1Sum, path);
-        const QString finalTarget = absPath + QLatin1String("/") + fn;
-        if (!tmp.rename(finalTarget)) {
-            throw QInstaller::Error(QString::fromLatin1("Could not move '%1' to '%2'").arg(tmpTarget,
-                finalTarget));
-        }
+        const QString versionPrefix = versionMapping[path];
+        const QString absPath = dir.absoluteFilePath(sub.at(i));
+        QPair<QString, QByteArray> *const sha1Sum = &sha1Sums[i];
+        pool.add([=]() {
+            const QString fn = QLatin1String(versionPrefix.toLatin1() + "meta.7z");
+            // next to the compressed directory, components of the same version run in parallel
+            const QString tmpTarget = absPath + QLatin1String("-") + fn;
+            compressPaths(QStringList() << absPath, tmpTarget);
+
+            // remove the files that got compressed
+            QInstaller::removeFiles(absPath, true);
+
+            QFile tmp(tmpTarget);
+            QInstaller::openForRead(&tmp, tmpTarget);
+            *sha1Sum = qMakePair(path, QInstaller::calculateHash(&tmp, QCryptographicHash::Sha1));
+            const QString finalTarget = absPath + QLatin1String("/") + fn;
+            if (!tmp.rename(finalTarget)) {
+                throw QInstaller::Error(QString::fromLatin1("Could not move '%1' to '%2'").arg(tmpTarget,
+                    finalTarget));
+            }
+        });
+    }
+    pool.waitForFinished();
+
+    QDomNodeList elements =  doc.elementsByTagName(QLatin1String("PackageUpdate"));
+    for (int i = 0; i < sha1Sums.count(); ++i) {
+        if (!sha1Sums.at(i).first.isNull())
+            writeSHA1ToNodeWithName(doc, elements, sha1Sums.at(i).second, sha1Sums.at(i).first);
     }
 
     QInstaller::openForWrite(&existingUpdatesXml, existingUpdatesXml.fileName());
@@ -546,85 +696,205 @@ void QInstallerTools::compressMetaDirectories(const QString &repoDir, const QStr
     existingUpdatesXml.close();
 }
 
-void QInstallerTools::copyComponentData(const QStringList &packageDirs, const QString &repoDir,
-    PackageInfoVector *const infos)
+static const QLatin1String scFingerprintFile(".fingerprint");
+
+/*
+    Returns a fingerprint of everything that ends up in the archives of the package: the version and
+    name, size, modification time and permissions of all files in its data directories.
+*/
+static QByteArray packageFingerprint(const QStringList &packageDirs, const PackageInfo &info)
 {
-    for (int i = 0; i < infos->count(); ++i) {
-        const PackageInfo info = infos->at(i);
-        const QString name = info.name;
-        qDebug() << "Copying component data for" << name;
-
-        const QString namedRepoDir = QString::fromLatin1("%1/%2").arg(repoDir, name);
-        if (!QDir().mkpath(namedRepoDir)) {
-            throw QInstaller::Error(QString::fromLatin1("Could not create repository folder for component '%1'")
-                .arg(name));
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(info.version.toUtf8());
+    foreach (const QString &packageDir, packageDirs) {
+        const QString dataDir = QString::fromLatin1("%1/%2/data").arg(packageDir, info.name);
+        if (!QFileInfo(dataDir).isDir())
+            continue;
+        // relative, so that the same packages in another location keep their fingerprint
+        hash.addData(QDir(packageDir).relativeFilePath(dataDir).toUtf8());
+
+        QStringList entries;
+        QDirIterator it(dataDir, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
+            QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            it.next();
+            const QFileInfo fi = it.fileInfo();
+            entries.append(QString::fromLatin1("%1:%2:%3:%4:%5").arg(it.filePath().mid(dataDir.length()),
+                QString::number(fi.size()), QString::number(fi.lastModified().toMSecsSinceEpoch()),
+                QString::number(int(fi.permissions())), fi.symLinkTarget()));
         }
+        entries.sort();
+        hash.addData(entries.join(QLatin1String("\n")).toUtf8());
+    }
+    return hash.result().toHex();
+}
+
+/*
+    Copies \a source to \a target and returns the SHA1 of the copied data, calculated while copying.
+*/
+static QByteArray copyAndHash(const QString &source, const QString &target)
+{
+    QFile in(source);
+    QInstaller::openForRead(&in, source);
+    QFile out(target);
+    if (out.exists()) {
+        throw QInstaller::Error(QString::fromLatin1("Could not copy '%1' to '%2': %3").arg(source, target,
+            QLatin1String("Target already exists.")));
+    }
+    QInstaller::openForWrite(&out, target);
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QByteArray buffer(1024 * 1024, '\0');
+    qint64 size = in.size();
+    while (size > 0) {
+        const qint64 length = QInstaller::blockingRead(&in, buffer.data(), qMin<qint64>(buffer.size(), size));
+        hash.addData(buffer.constData(), length);
+        QInstaller::blockingWrite(&out, buffer.constData(), length);
+        size -= length;
+    }
+    return hash.result();
+}
 
-        QStringList compressedFiles;
-        QStringList filesToCompress;
-        foreach (const QString &packageDir, packageDirs) {
-            const QDir dataDir(QString::fromLatin1("%1/%2/data").arg(packageDir, name));
-            foreach (const QString &entry, dataDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Files)) {
-                QFileInfo fileInfo(dataDir.absoluteFilePath(entry));
-                if (fileInfo.isFile() && !fileInfo.isSymLink()) {
-                    const QString absoluteEntryFilePath = dataDir.absoluteFilePath(entry);
-                    if (Lib7z::isSupportedArchive(absoluteEntryFilePath)) {
-                        QFile tmp(absoluteEntryFilePath);
-                        QString target = QString::fromLatin1("%1/%3%2").arg(namedRepoDir, entry, info.version);
-                        qDebug() << QString::fromLatin1("Copying archive from '%1' to '%2'").arg(tmp.fileName(),
-                            target);
-                        if (!tmp.copy(target)) {
-                            throw QInstaller::Error(QString::fromLatin1("Could not copy '%1' to '%2': %3")
-                                .arg(tmp.fileName(), target, tmp.errorString()));
+static void copyPackageData(const QStringList &packageDirs, const QString &repoDir, PackageInfo *info,
+    FingerprintMode mode)
+{
+    const QString name = info->name;
+    const QString namedRepoDir = QString::fromLatin1("%1/%2").arg(repoDir, name);
+
+    QByteArray fingerprint;
+    if (mode != IgnoreFingerprint) {
+        fingerprint = packageFingerprint(packageDirs, *info);
+        if (mode == SkipUnchanged) {
+            // the fingerprint is followed by the archives it was written for, other files in the
+            // directory such as the meta data archive are not part of the package data
+            QFile file(QString::fromLatin1("%1/%2").arg(namedRepoDir, scFingerprintFile));
+            if (file.open(QIODevice::ReadOnly) && file.readLine().trimmed() == fingerprint) {
+                const QDir dir(namedRepoDir);
+                QStringList copiedFiles;
+                while (!file.atEnd()) {
+                    const QString entry = QString::fromUtf8(file.readLine().trimmed());
+                    if (!entry.isEmpty())
+                        copiedFiles.append(dir.absoluteFilePath(entry));
+                }
+                bool complete = true;
+                foreach (const QString &copiedFile, copiedFiles)
+                    complete = complete && QFileInfo(copiedFile).isFile();
+                if (complete) {
+                    qDebug() << "Component data for" << name << "did not change, keeping the archives";
+                    info->copiedFiles = copiedFiles;
+                    // the meta data archive gets created again and cannot be moved over an old one
+                    foreach (const QFileInfo &fi, dir.entryInfoList(QStringList(QLatin1String("*meta.7z")),
+                        QDir::Files)) {
+                        QFile metaArchive(fi.absoluteFilePath());
+                        if (!copiedFiles.contains(metaArchive.fileName()) && !metaArchive.remove()) {
+                            throw QInstaller::Error(QString::fromLatin1("Could not remove '%1': %2")
+                                .arg(metaArchive.fileName(), metaArchive.errorString()));
                         }
-                        compressedFiles.append(target);
-                    } else {
-                        filesToCompress.append(absoluteEntryFilePath);
                     }
-                } else if (fileInfo.isDir()) {
-                    qDebug() << "Compressing data directory" << entry;
-                    QString target = QString::fromLatin1("%1/%3%2.7z").arg(namedRepoDir, entry, info.version);
-                    QInstallerTools::compressPaths(QStringList() << dataDir.absoluteFilePath(entry), target);
-                    compressedFiles.append(target);
-                } else if (fileInfo.isSymLink()) {
-                    filesToCompress.append(dataDir.absoluteFilePath(entry));
+                    return;
                 }
             }
+            file.close();
         }
+        if (QFileInfo(namedRepoDir).exists())
+            QInstaller::removeDirectory(namedRepoDir);
+    }
+
+    qDebug() << "Copying component data for" << name;
+
+    if (!QDir().mkpath(namedRepoDir)) {
+        throw QInstaller::Error(QString::fromLatin1("Could not create repository folder for component '%1'")
+            .arg(name));
+    }
 
-        if (!filesToCompress.isEmpty()) {
-            qDebug() << "Compressing files found in data directory:" << filesToCompress;
-            QString target = QString::fromLatin1("%1/%3%2").arg(namedRepoDir, QLatin1String("content.7z"),
-                info.version);
-            QInstallerTools::compressPaths(filesToCompress, target);
-            compressedFiles.append(target);
+    // hashes of archives that got calculated while copying
+    QHash<QString, QByteArray> hashes;
+    QStringList compressedFiles;
+    QStringList filesToCompress;
+    foreach (const QString &packageDir, packageDirs) {
+        const QDir dataDir(QString::fromLatin1("%1/%2/data").arg(packageDir, name));
+        foreach (const QString &entry, dataDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Files)) {
+            QFileInfo fileInfo(dataDir.absoluteFilePath(entry));
+            if (fileInfo.isFile() && !fileInfo.isSymLink()) {
+                const QString absoluteEntryFilePath = dataDir.absoluteFilePath(entry);
+                if (Lib7z::isSupportedArchive(absoluteEntryFilePath)) {
+                    QString target = QString::fromLatin1("%1/%3%2").arg(namedRepoDir, entry, info->version);
+                    qDebug() << QString::fromLatin1("Copying archive from '%1' to '%2'").arg(
+                        absoluteEntryFilePath, target);
+                    hashes.insert(target, copyAndHash(absoluteEntryFilePath, target));
+                    compressedFiles.append(target);
+                } else {
+                    filesToCompress.append(absoluteEntryFilePath);
+                }
+            } else if (fileInfo.isDir()) {
+                qDebug() << "Compressing data directory" << entry;
+                QString target = QString::fromLatin1("%1/%3%2.7z").arg(namedRepoDir, entry, info->version);
+                QInstallerTools::compressPaths(QStringList() << dataDir.absoluteFilePath(entry), target);
+                compressedFiles.append(target);
+            } else if (fileInfo.isSymLink()) {
+                filesToCompress.append(dataDir.absoluteFilePath(entry));
+            }
         }
+    }
 
-        foreach (const QString &target, compressedFiles) {
-            (*infos)[i].copiedFiles.append(target);
+    if (!filesToCompress.isEmpty()) {
+        qDebug() << "Compressing files found in data directory:" << filesToCompress;
+        QString target = QString::fromLatin1("%1/%3%2").arg(namedRepoDir, QLatin1String("content.7z"),
+            info->version);
+        QInstallerTools::compressPaths(filesToCompress, target);
+        compressedFiles.append(target);
+    }
 
-            QFile archiveFile(target);
-            QFile archiveHashFile(archiveFile.fileName() + QLatin1String(".sha1"));
+    foreach (const QString &target, compressedFiles) {
+        info->copiedFiles.append(target);
 
-            qDebug() << "Hash is stored in" << archiveHashFile.fileName();
-            qDebug() << "Creating hash of archive" << archiveFile.fileName();
+        QFile archiveFile(target);
+        QFile archiveHashFile(archiveFile.fileName() + QLatin1String(".sha1"));
 
-            try {
-                QInstaller::openForRead(&archiveFile, archiveFile.fileName());
-                const QByteArray hashOfArchiveData = QInstaller::calculateHash(&archiveFile,
-                    QCryptographicHash::Sha1).toHex();
-                archiveFile.close();
+        qDebug() << "Hash is stored in" << archiveHashFile.fileName();
 
-                QInstaller::openForWrite(&archiveHashFile, archiveHashFile.fileName());
-                archiveHashFile.write(hashOfArchiveData);
-                qDebug() << "Generated sha1 hash:" << hashOfArchiveData;
-                (*infos)[i].copiedFiles.append(archiveHashFile.fileName());
-                archiveHashFile.close();
-            } catch (const QInstaller::Error &/*e*/) {
+        try {
+            QByteArray hashOfArchiveData = hashes.value(target).toHex();
+            if (hashOfArchiveData.isEmpty()) {
+                // 7z archives get their header written last at the start of the file, so they have
+                // to be read once more
+                qDebug() << "Creating hash of archive" << archiveFile.fileName();
+                QInstaller::openForRead(&archiveFile, archiveFile.fileName());
+                hashOfArchiveData = QInstaller::calculateHash(&archiveFile, QCryptographicHash::Sha1).toHex();
                 archiveFile.close();
-                archiveHashFile.close();
-                throw;
             }
+
+            QInstaller::openForWrite(&archiveHashFile, archiveHashFile.fileName());
+            archiveHashFile.write(hashOfArchiveData);
+            qDebug() << "Generated sha1 hash:" << hashOfArchiveData;
+            info->copiedFiles.append(archiveHashFile.fileName());
+            archiveHashFile.close();
+        } catch (const QInstaller::Error &/*e*/) {
+            archiveFile.close();
+            archiveHashFile.close();
+            throw;
         }
     }
+
+    if (mode != IgnoreFingerprint) {
+        QByteArray content = fingerprint + '\n';
+        foreach (const QString &copiedFile, info->copiedFiles)
+            content += QFileInfo(copiedFile).fileName().toUtf8() + '\n';
+
+        QFile file(QString::fromLatin1("%1/%2").arg(namedRepoDir, scFingerprintFile));
+        QInstaller::openForWrite(&file, file.fileName());
+        QInstaller::blockingWrite(&file, content);
+    }
+}
+
+void QInstallerTools::copyComponentData(const QStringList &packageDirs, const QString &repoDir,
+    PackageInfoVector *const infos, FingerprintMode mode)
+{
+    // packages are independent of each other, so build them concurrently
+    JobPool pool;
+    for (int i = 0; i < infos->count(); ++i) {
+        PackageInfo *const info = &(*infos)[i];
+        pool.add([=]() { copyPackageData(packageDirs, repoDir, info, mode); });
+    }
+    pool.waitForFinished();
 }
@@ -52,6 +52,12 @@ enum FilterType {
     Exclude
 };
 
+enum FingerprintMode {
+    IgnoreFingerprint,      // neither read nor write the package data fingerprint
+    WriteFingerprint,       // rebuild all packages, store the fingerprint next to the archives
+    SkipUnchanged           // keep the archives of packages with an unchanged fingerprint
+};
+
 void printRepositoryGenOptions();
 QString makePathAbsolute(const QString &path);
 void copyWithException(const QString &source, const QString &target, const QString &kind = QString());
@@ -62,11 +68,13 @@ QHash<QString, QString> buildPathToVersionMapping(const PackageInfoVector &info)
 
 void compressPaths(const QStringList &paths, const QString &archivePath);
 void compressMetaDirectories(const QString &repoDir, const QString &baseDir,
-    const QHash<QString, QString> &versionMapping);
+    const QHash<QString, QString> &versionMapping, bool createUnifiedMetadata = false,
+    const QString &existingRepoDir = QString());
 
 void copyMetaData(const QString &outDir, const QString &dataDir, const PackageInfoVector &packages,
     const QString &appName, const QString& appVersion);
-void copyComponentData(const QStringList &packageDir, const QString &repoDir, PackageInfoVector *const infos);
+void copyComponentData(const QStringList &packageDir, const QString &repoDir, PackageInfoVector *const infos,
+    FingerprintMode mode = IgnoreFingerprint);
 
 
 } // namespace QInstallerTools
@@ -61,12 +61,16 @@ static void printUsage()
     std::cout << "  -r|--remove               Force removing target directory if existent." << std::endl;
 
     std::cout << "  --update                  Update a set of existing components (defined by " << std::endl;
-    std::cout << "                            --include or --exclude) in the repository" << std::endl;
+    std::cout << "                            --include or --exclude) in the repository. Components" << std::endl;
+    std::cout << "                            whose data did not change keep their archives" << std::endl;
 
     std::cout << "  --update-new-components   Update a set of existing components (defined by " << std::endl;
     std::cout << "                            --include or --exclude) in the repository with all new components"
         << std::endl;
 
+    std::cout << "  --unite-metadata          Combine the meta data of all components into one archive" << std::endl;
+    std::cout << "                            that clients fetch with a single request" << std::endl;
+
     std::cout << "  -v|--verbose              Verbose output" << std::endl;
 
     std::cout << std::endl;
@@ -106,6 +110,7 @@ int main(int argc, char** argv)
         QInstallerTools::FilterType filterType = QInstallerTools::Exclude;
         bool remove = false;
         bool updateExistingRepositoryWithNewComponents = false;
+        bool createUnifiedMetadata = false;
 
         //TODO: use a for loop without removing values from args like it is in binarycreator.cpp
         //for (QStringList::const_iterator it = args.begin(); it != args.end(); ++it) {
@@ -150,6 +155,9 @@ int main(int argc, char** argv)
             } else if (args.first() == QLatin1String("--update-new-components")) {
                 args.removeFirst();
                 updateExistingRepositoryWithNewComponents = true;
+            } else if (args.first() == QLatin1String("--unite-metadata")) {
+                args.removeFirst();
+                createUnifiedMetadata = true;
             } else if (args.first() == QLatin1String("-p") || args.first() == QLatin1String("--packages")) {
                 args.removeFirst();
                 if (args.isEmpty()) {
@@ -256,19 +264,17 @@ int main(int argc, char** argv)
 
         QHash<QString, QString> pathToVersionMapping = QInstallerTools::buildPathToVersionMapping(packages);
 
-        foreach (const QInstallerTools::PackageInfo &package, packages) {
-            const QFileInfo fi(repositoryDir, package.name);
-            if (fi.exists())
-                removeDirectory(fi.absoluteFilePath());
-        }
-
+        // existing component directories get replaced, unless --update finds the data unchanged
         tmpMetaDir = QInstaller::createTemporaryDirectory();
-        QInstallerTools::copyComponentData(packagesDirectories, repositoryDir, &packages);
+        QInstallerTools::copyComponentData(packagesDirectories, repositoryDir, &packages,
+            update ? QInstallerTools::SkipUnchanged : QInstallerTools::WriteFingerprint);
         QInstallerTools::copyMetaData(tmpMetaDir, repositoryDir, packages, QLatin1String("{AnyApplication}"),
             QLatin1String(QUOTE(IFW_REPOSITORY_FORMAT_VERSION)));
-        QInstallerTools::compressMetaDirectories(tmpMetaDir, tmpMetaDir, pathToVersionMapping);
+        QInstallerTools::compressMetaDirectories(tmpMetaDir, tmpMetaDir, pathToVersionMapping,
+            createUnifiedMetadata, update ? repositoryDir : QString());
 
-        QDirIterator it(repositoryDir, QStringList(QLatin1String("Updates*.xml")), QDir::Files | QDir::CaseSensitive);
+        QDirIterator it(repositoryDir, QStringList() << QLatin1String("Updates*.xml")
+            << QLatin1String("*_meta.7z"), QDir::Files | QDir::CaseSensitive);
         while (it.hasNext()) {
             it.next();
             QFile::remove(it.fileInfo().absoluteFilePath());